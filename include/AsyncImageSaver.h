@@ -0,0 +1,123 @@
+/*
+ * AsyncImageSaver.h is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#ifndef ASYNCIMAGESAVER_H
+#define ASYNCIMAGESAVER_H
+
+#include <Image.h>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
+/*!
+ * \brief Saves images on a dedicated I/O thread
+ *
+ * Image::save() opens, writes and closes the file on the calling thread.
+ * An AsyncImageSaver instead queues the image and returns, and its own
+ * thread writes everything that has queued up in one batch.
+ *
+ * Memory is bounded: once \c maxQueuedBytes of pixel data are waiting,
+ * save() blocks until the I/O thread catches up, and trySave() refuses the
+ * image. An image larger than the bound is still accepted when the queue is
+ * empty.
+ *
+ * \code
+ * AsyncImageSaver saver;
+ * for( int i = 0; i < n; ++i ) {
+ *    Image<uint8_t> rgb(rows, cols, 3);
+ *    opticalFlowToRgb(rgb, flow[i], 2.f);
+ *    saver.save(std::move(rgb), "flow." + std::to_string(i));
+ * }
+ * saver.flush();
+ * \endcode
+ */
+class AsyncImageSaver {
+public:
+
+   //! \brief Shared handle to an image that must not change until written
+   typedef std::shared_ptr< Image<uint8_t> const > ImagePtr;
+
+   /*!
+    * \brief Start the I/O thread
+    *
+    * \param maxQueuedBytes bound on the pixel data waiting to be written
+    */
+   AsyncImageSaver(size_t maxQueuedBytes = 64 << 20);
+
+   //! \brief Write everything still queued, then stop the I/O thread
+   ~AsyncImageSaver();
+
+   /*!
+    * \brief Queue an image, taking ownership of it
+    *
+    * Blocks while the queue is full.
+    *
+    * \param img the image to write. It is moved from.
+    * \param basename the filename without extension, as for Image::save()
+    */
+   void save(Image<uint8_t>&& img, std::string const& basename);
+
+   /*!
+    * \brief Queue a shared image
+    *
+    * Blocks while the queue is full. The saver keeps a reference until the
+    * image is written, so the caller must not modify it in the meantime.
+    */
+   void save(ImagePtr const& img, std::string const& basename);
+
+   /*!
+    * \brief Queue an image only if there is room
+    *
+    * \returns true if the image was queued and moved from, or false if the
+    *          queue is full, in which case \c img is left untouched
+    */
+   bool trySave(Image<uint8_t>&& img, std::string const& basename);
+
+   //! \brief Block until every image queued so far is on disk
+   void flush();
+
+   //! \brief Bytes of pixel data waiting to be written
+   size_t queuedBytes() const;
+   //! \brief Number of images written so far
+   size_t imagesWritten() const;
+
+private:
+
+   AsyncImageSaver(AsyncImageSaver const&);
+   AsyncImageSaver& operator=(AsyncImageSaver const&);
+
+   struct Job {
+      ImagePtr image;
+      std::string basename;
+      size_t bytes;
+   };
+
+   static size_t bytesOf(Image<uint8_t> const& img);
+   // Queue a job if it fits, waiting for room if wait is true
+   bool enqueue(ImagePtr const& img, std::string const& basename, size_t bytes, bool wait);
+   // I/O thread
+   void run();
+
+   size_t const _maxQueuedBytes;
+   std::deque<Job> _queue;
+   // Bytes in _queue plus the batch being written
+   size_t _queuedBytes;
+   // Number of images in the batch being written
+   size_t _writing;
+   size_t _imagesWritten;
+   bool _stop;
+
+   mutable std::mutex _mutex;
+   // Signals the I/O thread that there is work
+   std::condition_variable _work;
+   // Signals producers that room was freed or a batch finished
+   std::condition_variable _room;
+   std::thread _thread;
+};
+
+#endif /*ASYNCIMAGESAVER_H*/
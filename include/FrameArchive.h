@@ -0,0 +1,191 @@
+/*
+ * FrameArchive.h is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#ifndef FRAMEARCHIVE_H
+#define FRAMEARCHIVE_H
+
+#include <pgvl.h>
+#include <ImageView.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+#include "config.h"
+
+/*!
+ * \defgroup FrameArchive Frame archives
+ * \brief Many frames in one file
+ *
+ * A frame archive stores a sequence of images in a single file, so that
+ * millions of frames do not mean millions of files. The layout is
+ *
+ * - a 64-byte FrameArchiveHeader,
+ * - the frames, each starting on a \c CACHE_LINE_SIZE boundary, with every
+ *   row padded to a multiple of \c CACHE_LINE_SIZE exactly like Image,
+ * - an index of one FrameInfo per frame, located by the header.
+ *
+ * The index goes at the end so frames can be streamed in without knowing
+ * their number. All fields are in host byte order.
+ */
+
+//! \ingroup FrameArchive
+//! \brief Channel types a frame archive can hold
+enum FrameType {
+   FRAME_UINT8 = 1,
+   FRAME_UINT16 = 2,
+   FRAME_FLOAT = 3
+};
+
+//! \ingroup FrameArchive
+//! \brief Maps a channel type to its FrameType
+template<class T> struct FrameTypeOf;
+template<> struct FrameTypeOf<uint8_t> { enum { value = FRAME_UINT8 }; };
+template<> struct FrameTypeOf<uint16_t> { enum { value = FRAME_UINT16 }; };
+template<> struct FrameTypeOf<float> { enum { value = FRAME_FLOAT }; };
+
+//! \ingroup FrameArchive
+//! \brief The first 64 bytes of a frame archive
+struct FrameArchiveHeader {
+   //! \brief "PGVLFRM1"
+   char magic[8];
+   //! \brief Row and frame alignment used by the writer
+   uint32_t alignment;
+   uint32_t reserved0;
+   //! \brief Number of frames
+   uint64_t frameCount;
+   //! \brief Byte offset of the index
+   uint64_t indexOffset;
+   uint8_t reserved1[32];
+};
+
+//! \ingroup FrameArchive
+//! \brief Index entry describing one frame
+struct FrameInfo {
+   //! \brief Byte offset of the first row
+   uint64_t offset;
+   int32_t rows;
+   int32_t cols;
+   int32_t channels;
+   //! \brief Number of bytes from the start of one row to the next
+   int32_t rowWidth;
+   //! \brief A FrameType
+   int32_t type;
+   int32_t reserved;
+};
+
+/*!
+ * \ingroup FrameArchive
+ * \brief Writes frames to a new archive
+ *
+ * The index is written by close() or the destructor. Until then the file is
+ * not a valid archive.
+ */
+class FrameArchiveWriter {
+public:
+
+   //! \brief Create (or truncate) an archive
+   FrameArchiveWriter(std::string const& filename);
+   //! \brief Close the archive
+   ~FrameArchiveWriter();
+
+   //! \brief True if the file was opened and nothing has failed yet
+   bool good() const { return _file != 0; }
+   //! \brief Number of frames appended so far
+   size_t frameCount() const { return _index.size(); }
+
+   /*!
+    * \brief Append a frame
+    *
+    * \returns false if the frame could not be written
+    */
+   template<class T, int C>
+   bool append(ImageView<T, C> const& img) {
+      return appendRows(
+         reinterpret_cast<uint8_t const*>(img[0]),
+         img.rows(), img.cols(), img.channels(), sizeof(T), img.rowWidth(),
+         FrameTypeOf<T>::value
+      );
+   }
+
+   /*!
+    * \brief Write the index and close the file
+    *
+    * \returns false if anything failed since the archive was created
+    */
+   bool close();
+
+private:
+
+   FrameArchiveWriter(FrameArchiveWriter const&);
+   FrameArchiveWriter& operator=(FrameArchiveWriter const&);
+
+   bool appendRows(uint8_t const* data, int rows, int cols, int channels, int channelWidth, int srcRowWidth, int type);
+   // Write zeros until the file offset is a multiple of CACHE_LINE_SIZE
+   bool pad();
+   void fail();
+
+   FILE* _file;
+   uint64_t _offset;
+   std::vector<FrameInfo> _index;
+};
+
+/*!
+ * \ingroup FrameArchive
+ * \brief Memory-mapped, random-access view of an archive
+ *
+ * Opening only reads the header and index. frame() is O(1) and returns a
+ * view straight into the mapping, with the aligned rows the writer laid
+ * down. The mapping is private, so writes through a view never reach the
+ * file. Views are valid for the lifetime of the reader.
+ */
+class FrameArchiveReader {
+public:
+
+   //! \brief Map an archive. Check good() afterwards.
+   FrameArchiveReader(std::string const& filename);
+   ~FrameArchiveReader();
+
+   //! \brief True if the archive was mapped and its index is consistent
+   bool good() const { return _base != 0; }
+   //! \brief Number of frames
+   size_t frameCount() const { return _count; }
+   //! \brief Shape and type of the kth frame
+   FrameInfo const& info(size_t k) const { return _index[k]; }
+
+   /*!
+    * \brief View of the kth frame
+    *
+    * \tparam T the channel type. It must match the type the frame was
+    *         written with, otherwise the result is an empty view.
+    */
+   template<class T>
+   ImageView<T> frame(size_t k) const {
+      if( k >= _count ) {
+         LOGE("Frame " << k << " out of range");
+         return ImageView<T>();
+      }
+
+      FrameInfo const& fi = _index[k];
+      if( fi.type != FrameTypeOf<T>::value ) {
+         LOGE("Frame " << k << " has type " << fi.type << ", expected " << FrameTypeOf<T>::value);
+         return ImageView<T>();
+      }
+
+      return ImageView<T>(reinterpret_cast<T*>(_base + fi.offset), fi.rows, fi.cols, fi.channels, fi.rowWidth);
+   }
+
+private:
+
+   FrameArchiveReader(FrameArchiveReader const&);
+   FrameArchiveReader& operator=(FrameArchiveReader const&);
+
+   void unmap();
+
+   uint8_t* _base;
+   size_t _length;
+   FrameInfo const* _index;
+   size_t _count;
+};
+
+#endif /*FRAMEARCHIVE_H*/
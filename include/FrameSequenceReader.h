@@ -0,0 +1,201 @@
+/*
+ * FrameSequenceReader.h is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#ifndef FRAMESEQUENCEREADER_H
+#define FRAMESEQUENCEREADER_H
+
+#include <pgvl.h>
+#include <Image.h>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#include <unistd.h>
+
+/*!
+ * \brief Reads numbered frames ahead of the consumer on a background thread
+ *
+ * Frame \c k is the file named by formatting \c k into a printf-style
+ * pattern, e.g. \c "office.%d.ppm". A background thread decodes upcoming
+ * frames into a ring of \c depth Image buffers, so as long as it keeps ahead,
+ * next() hands back a frame that is already in memory. The buffers are
+ * reused with Image::load(), so reading a sequence of same-sized frames does
+ * not allocate.
+ *
+ * The sequence ends at the first frame file that does not exist, or after
+ * \c count frames.
+ *
+ * \code
+ * FrameSequenceReader<uint8_t> reader("office.%d.ppm");
+ * while( Image<uint8_t> const* frame = reader.next() )
+ *    process(*frame);
+ * \endcode
+ *
+ * \tparam T the type of an individual channel
+ * \tparam C the number of channels, or \c DYNAMIC_CHANNELS
+ */
+template<class T, int C = DYNAMIC_CHANNELS>
+class FrameSequenceReader {
+public:
+
+   /*!
+    * \brief Start reading a sequence
+    *
+    * \param pattern printf-style filename pattern with one integer conversion
+    * \param first number of the first frame
+    * \param count maximum number of frames to read, or -1 for no limit
+    * \param depth number of frames to decode ahead
+    */
+   FrameSequenceReader(
+      std::string const& pattern,
+      int first = 0,
+      int count = -1,
+      int depth = 4
+   ) :
+      _pattern(pattern),
+      _next(first),
+      _remaining(count),
+      _frames(depth < 2 ? 2 : depth),
+      _head(0),
+      _filled(0),
+      _holding(false),
+      _done(false),
+      _stop(false),
+      _framesRead(0),
+      _stalls(0),
+      _stallSeconds(0.0)
+   {
+      _thread = std::thread(&FrameSequenceReader::run, this);
+   }
+
+   ~FrameSequenceReader() {
+      {
+         std::lock_guard<std::mutex> lock(_mutex);
+         _stop = true;
+      }
+      _cond.notify_all();
+      _thread.join();
+   }
+
+   /*!
+    * \brief Get the next frame
+    *
+    * Blocks only if the background thread has not finished decoding it yet,
+    * which counts as a stall. The frame stays valid until the next call.
+    *
+    * \returns the next frame, or null at the end of the sequence
+    */
+   Image<T, C> const* next() {
+      std::unique_lock<std::mutex> lock(_mutex);
+
+      // Give the previous frame back to the reader thread
+      if( _holding ) {
+         _head = (_head + 1) % _frames.size();
+         --_filled;
+         _holding = false;
+         _cond.notify_all();
+      }
+
+      if( _filled == 0 && !_done ) {
+         std::chrono::steady_clock::time_point const beg = std::chrono::steady_clock::now();
+         _cond.wait(lock, [this]{ return _filled > 0 || _done; });
+         std::chrono::duration<double> const waited = std::chrono::steady_clock::now() - beg;
+
+         ++_stalls;
+         _stallSeconds += waited.count();
+      }
+
+      if( _filled == 0 )
+         return 0;
+
+      _holding = true;
+      ++_framesRead;
+      return &_frames[_head];
+   }
+
+   //! \brief Number of frames handed out by next()
+   int framesRead() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _framesRead;
+   }
+   //! \brief Number of calls to next() that had to wait for the disk
+   int stalls() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _stalls;
+   }
+   //! \brief Total time next() spent waiting, in seconds
+   double stallSeconds() const {
+      std::lock_guard<std::mutex> lock(_mutex);
+      return _stallSeconds;
+   }
+
+private:
+
+   FrameSequenceReader(FrameSequenceReader const&);
+   FrameSequenceReader& operator=(FrameSequenceReader const&);
+
+   // Background thread: decode frames into free slots until the sequence ends
+   void run() {
+      std::vector<char> filename(_pattern.size() + 32);
+
+      for(;;) {
+         size_t slot;
+         {
+            std::unique_lock<std::mutex> lock(_mutex);
+            _cond.wait(lock, [this]{ return _stop || _filled < _frames.size(); });
+            if( _stop )
+               return;
+            slot = (_head + _filled) % _frames.size();
+         }
+
+         bool ok = _remaining != 0;
+         if( ok ) {
+            snprintf(&filename[0], filename.size(), _pattern.c_str(), _next);
+            // Missing files end the sequence quietly
+            ok = access(&filename[0], R_OK) == 0 && _frames[slot].load(&filename[0]);
+         }
+
+         std::lock_guard<std::mutex> lock(_mutex);
+         if( ok ) {
+            ++_next;
+            if( _remaining > 0 )
+               --_remaining;
+            ++_filled;
+         }
+         else
+            _done = true;
+         _cond.notify_all();
+
+         if( _done )
+            return;
+      }
+   }
+
+   std::string const _pattern;
+   int _next;
+   int _remaining;
+
+   // Ring of frames: _filled decoded frames start at _head. While _holding,
+   // the consumer owns the frame at _head.
+   std::vector< Image<T, C> > _frames;
+   size_t _head;
+   size_t _filled;
+   bool _holding;
+   bool _done;
+   bool _stop;
+
+   int _framesRead;
+   int _stalls;
+   double _stallSeconds;
+
+   mutable std::mutex _mutex;
+   std::condition_variable _cond;
+   std::thread _thread;
+};
+
+#endif /*FRAMESEQUENCEREADER_H*/
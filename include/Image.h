@@ -7,9 +7,13 @@
 #define IMAGE_H
 
 #include <pgvl.h>
+#include <ImageAllocator.h>
+#include <ImageView.h>
 #include <functional>
+#include <limits>
 #include <string>
-#include <regex>
+#include <string.h>
+#include <utility>
 #include <inttypes.h>
 #include <stdlib.h>
 #include <ppm.h>
@@ -20,131 +24,120 @@
  * \brief An image class for bitmaps
  *
  * For efficiency, each row is aligned to \c CACHE_LINE_SIZE byte boundaries.
+ * An Image owns its pixels and is also an ImageView of them. Pixel memory
+ * comes from an ImageAllocator, by default a pool shared by all images, so
+ * temporaries created in a loop recycle the same blocks.
+ *
+ * Fixing \c C at compile time (e.g. \c Image<float,3>) lets the processing
+ * functions unroll their channel loops. The default keeps the channel count
+ * a runtime property.
+ *
  * \tparam T the type of an individual channel
+ * \tparam C the number of channels, or \c DYNAMIC_CHANNELS
  */
-template<class T>
-class Image {
+template<class T, int C = DYNAMIC_CHANNELS>
+class Image : public ImageView<T, C> {
 public:
 
    //! \brief Default constructor
    Image(
       int rows = 0,
       int cols = 0,
-      int channels = 0
+      int channels = C,
+      ImageAllocator* allocator = 0
    )
-   : _data(0),
-     _unalignedData(0),
-     _channelWidth(sizeof(T)),
-     _rows(0),
-     _cols(0),
-     _channels(0),
-     _rowWidth(0)
+   : ImageView<T, C>(),
+     _capacity(0),
+     _allocator(allocator ? allocator : ImageAllocator::defaultAllocator()),
+     _channelWidth(sizeof(T))
    {
       resize(rows, cols, channels);
-      memset(_data, 0x00, rowWidth()*rows);
+      // Empty images get no block from the allocator
+      if( _data )
+         memset(_data, 0x00, _rowWidth*rows);
    }
    ~Image() {
-      delete[] _unalignedData;
+      _allocator->deallocate(_data, _capacity);
    }
 
    //! \brief Copy constructor
    Image(Image const& other) :
-      _data(0),
-      _unalignedData(0),
-      _channelWidth(other._channelWidth),
-      _rows(0),
-      _cols(0),
-      _channels(0),
-      _rowWidth(0)
+      ImageView<T, C>(),
+      _capacity(0),
+      _allocator(other._allocator),
+      _channelWidth(other._channelWidth)
    {
       resize(other._rows, other._cols, other._channels);
       for( int i = 0; i < _rows; ++i ) {
-         memcpy(_data + i*_rowWidth, other._data + i*other._rowWidth, _channels*_cols);
+         memcpy(_data + i*_rowWidth, other._data + i*other._rowWidth, _channels*_channelWidth*_cols);
       }
    }
 
    //! \brief Move constructor
    Image(Image&& other) :
-      _data( other._data ),
-      _unalignedData( other._unalignedData ),
-      _channelWidth(other._channelWidth),
-      _rows(other._rows),
-      _cols(other._cols),
-      _channels(other._channels),
-      _rowWidth(other._rowWidth)
+      ImageView<T, C>(other),
+      _capacity( other._capacity ),
+      _allocator( other._allocator ),
+      _channelWidth(other._channelWidth)
    {
       // Kill the other pointers so that its destructor does not free the
       // memory we now own.
-      other._data = other._unalignedData = 0;
+      other._data = 0;
+      other._capacity = 0;
+      other._rows = other._cols = other._channels = other._rowWidth = 0;
    }
 
    /*!
     * \brief Constructor from image filename
     *
+    * Binary files are memory-mapped and decoded straight from the page cache
+    * into the aligned rows, so loading costs one allocation and one pass.
+    * Samples are converted to \c T on the way: floating-point images are
+    * normalized to [0,1] by the file's maxval, and integer images keep the
+    * stored values when they fit, so 16-bit files load losslessly into
+    * \c Image<uint16_t>.
+    *
     * \param filename a .ppm or a .pgm image
     */
    Image(std::string const& filename) :
-      _data(0),
-      _unalignedData(0),
-      _channelWidth(sizeof(T)),
-      _rows(0),
-      _cols(0),
-      _channels(0),
-      _rowWidth(0)
+      ImageView<T, C>(),
+      _capacity(0),
+      _allocator(ImageAllocator::defaultAllocator()),
+      _channelWidth(sizeof(T))
    {
-      int maxval;
-      uint8_t* rawData = 0;
-
-      switch( fileType(filename) ) {
-      case FILETYPE_PGM:
-         rawData = pgmread(filename.c_str(), &_cols, &_rows);
-         _channels = 1;
-         break;
-      case FILETYPE_PPM:
-         rawData = ppmread(filename.c_str(), &_cols, &_rows, &maxval);
-         _channels = 3;
-         break;
-      default:
-         LOGE("Bad image format");
-         return;
-      }
-
-      // Make the row width a multiple of CACHE_LINE_SIZE
-      _rowWidth = _channels*_channelWidth*_cols;
-      if( _rowWidth % CACHE_LINE_SIZE )
-         _rowWidth += CACHE_LINE_SIZE - (_rowWidth % CACHE_LINE_SIZE);
-
-      // Make each row line up with CACHE_LINE_SIZE
-      _unalignedData = new uint8_t[_rowWidth*_rows + CACHE_LINE_SIZE];
-      _data = _unalignedData;
-      if( reinterpret_cast<size_t>(_data) % CACHE_LINE_SIZE )
-         _data += CACHE_LINE_SIZE - (reinterpret_cast<size_t>(_data) % CACHE_LINE_SIZE);
-
-      // Copy the data to aligned memory
-      for( int i = 0; i < _rows; ++i ) {
-         memcpy(_data + i*_rowWidth, rawData + i*_channels*_cols, _channels*_cols);
-      }
-
-      delete[] rawData;
+      load(filename);
    }
 
    //! \brief Assignment operator
-   Image<T>& operator=(Image<T> const& rhs) {
+   Image<T, C>& operator=(Image<T, C> const& rhs) {
       // Don't self-assign
       if( this == &rhs )
          return *this;
 
       resize(rhs._rows, rhs._cols, rhs._channels);
       for( int i = 0; i < _rows; ++i ) {
-         memcpy(_data + i*_rowWidth, rhs._data + i*rhs._rowWidth, _channels*_cols);
+         memcpy(_data + i*_rowWidth, rhs._data + i*rhs._rowWidth, _channels*_channelWidth*_cols);
       }
 
       return *this;
    }
 
+   //! \brief Move assignment operator
+   Image<T, C>& operator=(Image<T, C>&& rhs) {
+      std::swap(_data, rhs._data);
+      std::swap(_capacity, rhs._capacity);
+      std::swap(_allocator, rhs._allocator);
+      std::swap(_rows, rhs._rows);
+      std::swap(_cols, rhs._cols);
+      std::swap(_channels, rhs._channels);
+      std::swap(_rowWidth, rhs._rowWidth);
+
+      return *this;
+   }
+
    //! \brief Conversion assignment
    template<class U>
-   Image<T>& operator=(Image<U> const& rhs) {
+   Image<T, C>& operator=(Image<U, C> const& rhs) {
       convertFrom(rhs);
       return *this;
    }
@@ -158,45 +151,77 @@ public:
     * \param rhs the image to convert
     * \param elementConversion function that converts \c U to \c T
     */
-   template<class U>
+   template<class U, int C2>
    void convertFrom(
-      Image<U> const& rhs,
+      ImageView<U, C2> const& rhs,
       std::function<T(U)> elementConversion = [](U u) -> T {return static_cast<T>(u);} ) {
       // Don't self-assign
       if( reinterpret_cast<void const*>(this) == reinterpret_cast<void const*>(&rhs) )
          return;
 
-      Image<T>& me = *this;
+      Image<T, C>& me = *this;
 
       resize(rhs.rows(), rhs.cols(), rhs.channels());
 #pragma omp parallel for shared(me, rhs, elementConversion)
       for( int i = 0; i < _rows; ++i ) {
-         for( int j = 0; j < _cols*_channels; ++j ) {
+         for( int j = 0; j < _cols*me.channels(); ++j ) {
             me[i][j] = elementConversion(rhs[i][j]);
          }
       }
    }
 
-   //! \brief Number of rows in the image
-   int rows() const { return _rows; }
-   //! \brief Number of columns in the image
-   int cols() const { return _cols; }
-   //! \brief Number of channels in the image
-   int channels() const { return _channels; }
-   //! \brief Number of bytes in a row of pixels
-   int rowWidth() const { return _rowWidth; }
+   /*!
+    * \brief Load an image file into this image
+    *
+    * Decodes exactly like the filename constructor, but reuses the existing
+    * buffer when the file fits in capacity(), so a loop that loads frames
+    * into the same Image does not allocate.
+    *
+    * \param filename a .ppm or a .pgm image
+    * \returns false if the file could not be read. The image is then left
+    *          with whatever shape it had.
+    */
+   bool load(std::string const& filename) {
+      int maxval = 0;
+      int rows = 0;
+      int cols = 0;
+      int channels = 0;
+      PnmMap map;
+
+      if( pnmmap(filename.c_str(), &map) == 0 ) {
+         bool const ok = decodePackedRows(map.data, map.h, map.w, map.channels, map.maxval, map.sampleBytes);
+         pnmunmap(&map);
+         return ok;
+      }
+
+      // Not a binary file, so fall back to the slower ASCII reader
+      uint8_t* rawData = pnmreadAscii(filename.c_str(), &cols, &rows, &channels, &maxval);
+      if( !rawData ) {
+         LOGE("Cannot read " << filename << " as a PGM or PPM image");
+         return false;
+      }
+
+      bool const ok = decodePackedRows(rawData, rows, cols, channels, maxval, maxval > 255 ? 2 : 1);
+      delete[] rawData;
+      return ok;
+   }
+
+   //! \brief Number of bytes available before resize() must reallocate
+   size_t capacity() const { return _capacity; }
+   //! \brief Allocator that owns the pixel memory
+   ImageAllocator* allocator() const { return _allocator; }
 
    /*!
     * \brief Resize the image
     *
-    * Destructively resize the image.
+    * Destructively resize the image. The existing buffer is reused whenever
+    * the new shape fits in capacity().
     * \param nRows number of rows
     * \param nCols number of columns
     * \param nChans number of channels
     */
    void resize(int nRows, int nCols, int nChans) {
-      delete[] _unalignedData;
-      _unalignedData = 0;
+      assert( C == DYNAMIC_CHANNELS || nChans == C );
 
       _rows = nRows;
       _cols = nCols;
@@ -207,11 +232,14 @@ public:
       if( _rowWidth % CACHE_LINE_SIZE )
          _rowWidth += CACHE_LINE_SIZE - (_rowWidth % CACHE_LINE_SIZE);
 
-      // Make each row line up with CACHE_LINE_SIZE
-      _unalignedData = new uint8_t[_rowWidth*_rows + CACHE_LINE_SIZE];
-      _data = _unalignedData;
-      if( reinterpret_cast<size_t>(_data) % CACHE_LINE_SIZE )
-         _data += CACHE_LINE_SIZE - (reinterpret_cast<size_t>(_data) % CACHE_LINE_SIZE);
+      size_t const bytes = static_cast<size_t>(_rowWidth)*_rows;
+      if( bytes <= _capacity )
+         return;
+
+      // The allocator hands back blocks aligned to CACHE_LINE_SIZE, so each
+      // row lines up as well.
+      _allocator->deallocate(_data, _capacity);
+      _data = _allocator->allocate(bytes, &_capacity);
    }
 
    /*!
@@ -233,11 +261,11 @@ public:
       switch( _channels ) {
       case 1:
          filename += ".pgm";
-         pgmwrite(filename.c_str(), _cols, _rows, rowWidth(), _data);
+         pgmwrite(filename.c_str(), _cols, _rows, _rowWidth, _data);
          break;
       case 3:
          filename += ".ppm";
-         ppmwrite(filename.c_str(), _cols, _rows, rowWidth(), _data);
+         ppmwrite(filename.c_str(), _cols, _rows, _rowWidth, _data);
          break;
       default:
          LOGE("Bad image format");
@@ -245,16 +273,12 @@ public:
       }
    }
 
-   //! \brief Pointer to the ith row of pixel data
-   T* operator[](size_t i) { return reinterpret_cast<T*>(_data + i*_rowWidth); }
-   //! \brief Pointer to the ith row of pixel data (const version)
-   T const* operator[](size_t i) const { return reinterpret_cast<T const*>(_data + i*_rowWidth); }
-
    /*!
     * \brief Extract a patch from the image
     *
-    * If the specified region is outside the image boundary, the output is a
-    * size 0 image.
+    * Copies the region into \c out. Use view() instead to work on the region
+    * in place without copying. If the specified region is outside the image
+    * boundary, the output is a size 0 image.
     *
     * \param[out] out the output patch
     * \param[in] left the left boundary
@@ -262,44 +286,71 @@ public:
     * \param[in] top the upper boundary
     * \param[in] bottom the lower boundary
     */
-   void patch(Image<T>& out, int left, int right, int top, int bottom) {
-      if( left > right ||
-         top > bottom ||
-         left < 0 ||
-         right >= _cols ||
-         top < 0 ||
-         bottom >= _rows ) {
-         out.resize(0,0,0);
-         return;
-      }
+   void patch(Image<T, C>& out, int left, int right, int top, int bottom) {
+      ImageView<T, C> const region = this->view(left, right, top, bottom);
 
-      out.resize(bottom-top+1, right-left+1, _channels);
-      for(int i = top; i <= bottom; ++i) {
-         memcpy(out._data + (i-top)*out._rowWidth, _data + i*_rowWidth + left*_channels, (right-left+1)*_channels);
+      out.resize(region.rows(), region.cols(), region.channels());
+      for(int i = 0; i < region.rows(); ++i) {
+         memcpy(out[i], region[i], region.cols()*region.channels()*_channelWidth);
       }
    }
 
 private:
 
-   uint8_t* _data;
-   uint8_t* _unalignedData;
+   using ImageView<T, C>::_data;
+   using ImageView<T, C>::_rows;
+   using ImageView<T, C>::_cols;
+   using ImageView<T, C>::_channels;
+   using ImageView<T, C>::_rowWidth;
+
+   size_t _capacity;
+   ImageAllocator* _allocator;
    int _channelWidth;
-   int _rows;
-   int _cols;
-   int _channels;
-   int _rowWidth;
-
-   enum FileType { FILETYPE_NONE, FILETYPE_PGM, FILETYPE_PPM };
-   static FileType fileType(std::string const& filename) {
-      std::regex ppm(".*[.]ppm$");
-      std::regex pgm(".*[.]pgm$");
-
-      if( std::regex_match(filename, pgm) )
-         return FILETYPE_PGM;
-      else if( std::regex_match(filename, ppm) )
-         return FILETYPE_PPM;
-      else
-         return FILETYPE_NONE;
+
+   // Resize to the given shape and fill from tightly-packed rows of 8-bit
+   // or big-endian 16-bit samples, converting each one to T
+   bool decodePackedRows(uint8_t const* src, int rows, int cols, int channels, int maxval, int sampleBytes) {
+      if( C != DYNAMIC_CHANNELS && channels != C ) {
+         LOGE("Image has " << channels << " channels, expected " << C);
+         return false;
+      }
+
+      resize(rows, cols, channels);
+      int const rowSamples = _channels*_cols;
+      int const rowBytes = rowSamples*sampleBytes;
+
+      // Already in the target format
+      if( sizeof(T) == 1 && !std::is_floating_point<T>::value && sampleBytes == 1 ) {
+         for( int i = 0; i < _rows; ++i )
+            memcpy(_data + i*_rowWidth, src + static_cast<size_t>(i)*rowBytes, rowBytes);
+         return true;
+      }
+
+      // Floating-point images are normalized. Integer images keep the stored
+      // values unless they do not fit, e.g. 16-bit files into Image<uint8_t>.
+      float scale = 1.f;
+      if( std::is_floating_point<T>::value )
+         scale = 1.f/maxval;
+      else if( maxval > std::numeric_limits<T>::max() )
+         scale = static_cast<float>(std::numeric_limits<T>::max())/maxval;
+      Image<T, C>& me = *this;
+
+#pragma omp parallel for shared(me, src)
+      for( int i = 0; i < _rows; ++i ) {
+         uint8_t const* in = src + static_cast<size_t>(i)*rowBytes;
+         T* out = me[i];
+
+         if( sampleBytes == 2 ) {
+            for( int j = 0; j < rowSamples; ++j )
+               out[j] = static_cast<T>(scale*((in[2*j] << 8) | in[2*j+1]));
+         }
+         else {
+            for( int j = 0; j < rowSamples; ++j )
+               out[j] = static_cast<T>(scale*in[j]);
+         }
+      }
+
+      return true;
    }
 };
 
@@ -310,7 +361,7 @@ private:
  *
  * \param[in] img the image to convert to a surface
  */
-SDL_Surface* toSurface(Image<uint8_t>& img);
+SDL_Surface* toSurface(ImageView<uint8_t> img);
 
 /*!
  * \defgroup Colorspaces Colorspaces
@@ -326,7 +377,7 @@ SDL_Surface* toSurface(Image<uint8_t>& img);
  *
  * \param[in,out] img the image to convert
  */
-void rgb2srgb(Image<float>& img);
+void rgb2srgb(ImageView<float> img);
 /*!
  * \ingroup Colorspaces
  * \brief Convert from sRGB to linear RGB
@@ -336,7 +387,7 @@ void rgb2srgb(Image<float>& img);
  *
  * \param[in,out] img the image to convert
  */
-void srgb2rgb(Image<float>& img);
+void srgb2rgb(ImageView<float> img);
 /*!
  * \ingroup Colorspaces
  * \brief Convert from linear RGB to XYZ
@@ -345,7 +396,7 @@ void srgb2rgb(Image<float>& img);
  *
  * \param[in,out] img the image to convert
  */
-void rgb2xyz(Image<float>& img);
+void rgb2xyz(ImageView<float> img);
 /*!
  * \ingroup Colorspaces
  * \brief Convert from XYZ to linear RGB
@@ -354,7 +405,7 @@ void rgb2xyz(Image<float>& img);
  *
  * \param[in,out] img the image to convert
  */
-void xyz2rgb(Image<float>& img);
+void xyz2rgb(ImageView<float> img);
 /*!
  * \ingroup Colorspaces
  * \brief Convert from linear RGB to HSL
@@ -363,7 +414,7 @@ void xyz2rgb(Image<float>& img);
  *
  * \param[in,out] img the image to convert
  */
-void rgb2hsl(Image<float>& img);
+void rgb2hsl(ImageView<float> img);
 /*!
  * \ingroup Colorspaces
  * \brief Convert from HSL to linear RGB
@@ -372,7 +423,7 @@ void rgb2hsl(Image<float>& img);
  *
  * \param[in,out] img the image to convert
  */
-void hsl2rgb(Image<float>& img);
+void hsl2rgb(ImageView<float> img);
 /*!
  * \ingroup Colorspaces
  * \brief Convert from linear RGB to HSV
@@ -381,7 +432,7 @@ void hsl2rgb(Image<float>& img);
  *
  * \param[in,out] img the image to convert
  */
-void rgb2hsv(Image<float>& img);
+void rgb2hsv(ImageView<float> img);
 /*!
  * \ingroup Colorspaces
  * \brief Convert from HSV to linear RGB
@@ -390,6 +441,6 @@ void rgb2hsv(Image<float>& img);
  *
  * \param[in,out] img the image to convert
  */
-void hsv2rgb(Image<float>& img);
+void hsv2rgb(ImageView<float> img);
 
 #endif /*IMAGE_H*/
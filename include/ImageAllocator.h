@@ -0,0 +1,120 @@
+/*
+ * ImageAllocator.h is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#ifndef IMAGEALLOCATOR_H
+#define IMAGEALLOCATOR_H
+
+#include <stddef.h>
+#include <inttypes.h>
+#include <mutex>
+#include <vector>
+#include "config.h"
+
+/*!
+ * \brief Source of the pixel memory behind an Image
+ *
+ * Every non-null block handed out must be aligned to \c CACHE_LINE_SIZE.
+ * Implementations must be safe to call from several threads at once.
+ */
+class ImageAllocator {
+public:
+   virtual ~ImageAllocator() {}
+
+   /*!
+    * \brief Allocate an aligned block
+    *
+    * \param[in] bytes minimum number of usable bytes
+    * \param[out] capacity actual number of usable bytes in the block
+    * \returns the block, or 0 if \c bytes is 0
+    */
+   virtual uint8_t* allocate(size_t bytes, size_t* capacity) = 0;
+
+   /*!
+    * \brief Give back a block from allocate()
+    *
+    * \param[in] block the block to release. May be 0.
+    * \param[in] capacity the capacity reported when \c block was allocated
+    */
+   virtual void deallocate(uint8_t* block, size_t capacity) = 0;
+
+   /*!
+    * \brief Allocator used by images that were not given one explicitly
+    *
+    * Unless changed with setDefaultAllocator(), this is a process-wide
+    * PoolAllocator.
+    */
+   static ImageAllocator* defaultAllocator();
+
+   /*!
+    * \brief Change the allocator returned by defaultAllocator()
+    *
+    * Only affects images created afterwards. The allocator must outlive every
+    * image that uses it.
+    *
+    * \param[in] allocator the new default, or 0 to restore the built-in pool
+    */
+   static void setDefaultAllocator(ImageAllocator* allocator);
+};
+
+/*!
+ * \brief Allocator that goes straight to the heap every time
+ */
+class HeapAllocator : public ImageAllocator {
+public:
+   virtual uint8_t* allocate(size_t bytes, size_t* capacity);
+   virtual void deallocate(uint8_t* block, size_t capacity);
+};
+
+/*!
+ * \brief Size-class pool of cache-line-aligned blocks
+ *
+ * Requests are rounded up to one of four size classes per power of two, so a
+ * block wastes at most a quarter of its size. Released blocks are kept on a
+ * free list for their class and handed out again by the next request of the
+ * same class, which means a loop that keeps creating same-sized temporaries
+ * only touches the heap on its first iteration.
+ */
+class PoolAllocator : public ImageAllocator {
+public:
+   /*!
+    * \param[in] maxCachedBytes upper bound on the bytes held in free lists.
+    *            Blocks released past this bound go back to the heap.
+    */
+   PoolAllocator(size_t maxCachedBytes = size_t(256) << 20);
+   virtual ~PoolAllocator();
+
+   virtual uint8_t* allocate(size_t bytes, size_t* capacity);
+   virtual void deallocate(uint8_t* block, size_t capacity);
+
+   //! \brief Number of requests served from a free list
+   size_t hits() const;
+   //! \brief Number of requests that had to go to the heap
+   size_t misses() const;
+   //! \brief Number of bytes currently held in free lists
+   size_t cachedBytes() const;
+   //! \brief Zero the hit and miss counters
+   void resetStats();
+   //! \brief Return every cached block to the heap
+   void release();
+
+   //! \brief Capacity of the size class that \c bytes falls into
+   static size_t classSize(size_t bytes);
+
+private:
+   // 4 classes per power of two covers every size_t on 64-bit machines
+   static int const NUM_CLASSES = 4*64;
+
+   static int classIndex(size_t capacity);
+
+   mutable std::mutex _mutex;
+   std::vector<uint8_t*> _free[NUM_CLASSES];
+   size_t _maxCachedBytes;
+   size_t _cachedBytes;
+   size_t _hits;
+   size_t _misses;
+   HeapAllocator _heap;
+};
+
+#endif /*IMAGEALLOCATOR_H*/
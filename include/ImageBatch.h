@@ -0,0 +1,105 @@
+/*
+ * ImageBatch.h is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#ifndef IMAGEBATCH_H
+#define IMAGEBATCH_H
+
+#include <pgvl.h>
+#include <Image.h>
+#include <string>
+#include <vector>
+
+/*!
+ * \brief Regular files in a directory, sorted by name
+ *
+ * \param dir the directory to list
+ * \returns full paths, or nothing if \c dir cannot be read
+ */
+std::vector<std::string> listDirectory(std::string const& dir);
+
+/*!
+ * \brief Load many images at once
+ *
+ * Files are decoded in parallel with a dynamic OpenMP schedule, so a few
+ * large files do not hold up the rest. \c images[k] always corresponds to
+ * \c filenames[k], whatever order the threads finish in. Images already in
+ * \c images are reused, so loading batch after batch into the same vector
+ * does not allocate.
+ *
+ * \param[out] images resized to one image per file. Files that fail to load
+ *             give an empty image.
+ * \param[in] filenames .pgm and .ppm files
+ * \param[out] failed if not null, receives the files that failed, in order
+ * \returns the number of files loaded
+ */
+template<class T, int C>
+size_t loadImages(
+   std::vector< Image<T, C> >& images,
+   std::vector<std::string> const& filenames,
+   std::vector<std::string>* failed = 0
+) {
+   long const n = filenames.size();
+   std::vector<char> ok(n);
+
+   images.resize(n);
+#pragma omp parallel for schedule(dynamic) shared(images, filenames, ok)
+   for( long k = 0; k < n; ++k )
+      ok[k] = images[k].load(filenames[k]);
+
+   size_t loaded = 0;
+   for( long k = 0; k < n; ++k ) {
+      if( ok[k] ) {
+         ++loaded;
+         continue;
+      }
+
+      images[k].resize(0, 0, C);
+      if( failed )
+         failed->push_back(filenames[k]);
+   }
+
+   return loaded;
+}
+
+/*!
+ * \brief Load every PGM and PPM image in a directory
+ *
+ * Files are recognized by their magic number, not their name, and other
+ * files are skipped. Images come out sorted by filename.
+ *
+ * \param[out] images one image per PGM/PPM file
+ * \param[in] dir the directory to load
+ * \param[out] filenames if not null, receives the file behind each image
+ * \param[out] failed if not null, receives the image files that failed
+ * \returns the number of images loaded
+ */
+template<class T, int C>
+size_t loadDirectory(
+   std::vector< Image<T, C> >& images,
+   std::string const& dir,
+   std::vector<std::string>* filenames = 0,
+   std::vector<std::string>* failed = 0
+) {
+   std::vector<std::string> const files = listDirectory(dir);
+   long const n = files.size();
+   std::vector<char> isImage(n);
+
+   // Classifying opens every file, so it is worth spreading too
+#pragma omp parallel for schedule(dynamic) shared(files, isImage)
+   for( long k = 0; k < n; ++k )
+      isImage[k] = pnmchannels(files[k].c_str()) != 0;
+
+   std::vector<std::string> imageFiles;
+   for( long k = 0; k < n; ++k )
+      if( isImage[k] )
+         imageFiles.push_back(files[k]);
+
+   size_t const loaded = loadImages(images, imageFiles, failed);
+   if( filenames )
+      filenames->swap(imageFiles);
+   return loaded;
+}
+
+#endif /*IMAGEBATCH_H*/
@@ -6,9 +6,14 @@
 #ifndef IMAGEPROCESSING_H
 #define IMAGEPROCESSING_H
 
+#include <algorithm>
 #include <cmath>
+#include <vector>
 #include <Image.h>
+#include <PlanarImage.h>
 #include <Point.h>
+#include <Integral.h>
+#include <Stencil.h>
 #include <Eigen/Dense>
 
 /*!
@@ -18,122 +23,121 @@
 
 /*!
  * \ingroup ImageProcessing
- * \brief Create an integral image
+ * \brief Block of output the 2D filters work on at a time
  *
- * For now, purposefully ignores overflowing
- *
- * \param[in,out] img the input image and output integral image
+ * \see filterBlock()
  */
-template<class T>
-void integrate(Image<T>& img) {
-   int i,j;
-   int const channels = img.channels();
-
-   // Prefix scan all the rows
-#pragma omp parallel for shared(img) private(i,j)
-   for( i = 0; i < img.rows(); ++i ) {
-      for( j = channels; j < img.rowWidth(); ++j )
-         img[i][j] += img[i][j-channels];
-   }
-
-   // Prefix scan all the columns
-#pragma omp parallel for shared(img) private(i,j)
-   for( j = 0; j < img.rowWidth(); ++j ) {
-      for( i = 1; i < img.rows(); ++i )
-         img[i][j] += img[i-1][j];
-   }
-}
+struct FilterBlock {
+   //! Output rows per block
+   int rows;
+   //! Output samples (not pixels) per block row
+   int cols;
+};
 
 /*!
  * \ingroup ImageProcessing
- * \brief Create a squared integral image
+ * \brief Pick a cache-sized output block for a 2D filter
  *
- * For now, purposefully ignores overflowing
+ * The block is narrow enough that the \c krows input rows under one row of
+ * it, plus that output row, fit in L1 together. Working down the block,
+ * each output row then finds all but one of its input rows already in
+ * cache, however wide the image is.
  *
- * \param[in,out] img the input image and output squared integral image
+ * \param krows kernel rows
+ * \param kcols kernel columns
+ * \param channels image channels
+ * \param sampleBytes bytes per sample
+ * \param align the block width is a multiple of this many samples
  */
-template<class T>
-void integrateSquare(Image<T>& img) {
-   int i,j;
-   int const channels = img.channels();
-
-   // Square the first pixel in each row
-#pragma omp parallel for shared(img) private(i,j)
-   for( i = 0; i < img.rows(); ++i )
-      for( j = 0; j < channels; ++j )
-         img[i][j] *= img[i][j];
-
-   // Prefix scan all the rows
-#pragma omp parallel for shared(img) private(i,j)
-   for( i = 0; i < img.rows(); ++i ) {
-      for( j = channels; j < img.rowWidth(); ++j )
-         img[i][j] = (img[i][j]*img[i][j]) + img[i][j-channels];
-   }
-
-   // Prefix scan all the columns
-   // NOTE: we do not have to square any pixels here, because
-   // all pixels have been squared in the row scan above
-#pragma omp parallel for shared(img) private(i,j)
-   for( j = 0; j < img.rowWidth(); ++j ) {
-      for( i = 1; i < img.rows(); ++i )
-         img[i][j] += img[i-1][j];
-   }
-}
+FilterBlock filterBlock(int krows, int kcols, int channels, int sampleBytes, int align);
 
 /*!
  * \ingroup ImageProcessing
  * \brief Filter an image with a kernel
  *
+ * The output is computed in cache-sized blocks (see filterBlock()), and the
+ * blocks are shared between threads.
+ *
  * \note This does not do convolution, but correlation
- * \note For now, only does non-fft filtering
+ * \note Cost grows with kernel area; for large float kernels see filterFft()
  *
  * \param out The output of the filtering
  * \param img Image to be filtered
- * \param kernel Kernel to apply to the \c img
+ * \param kernel Kernel to apply to the \c img. It either has one channel,
+ *        which is applied to every channel of \c img, or as many as \c img.
  * \param anchor point within the kernel considered to be the center. If left
  *        at its default value, the anchor will be set to the center of the kernel.
  * \param delta value to add to the filtered value before storing in \c out
  */
-template<class T, class U>
+template<class T, int C, class U, int KC>
 void filter(
-   Image<T>& out,
-   Image<T> const& img,
-   Image<U> const& kernel,
+   ImageView<T, C> out,
+   ImageView<T, C> const& img,
+   ImageView<U, KC> const& kernel,
    Point const& anchor = Point(-1,-1),
    float delta = 0.f
 ) {
    int const kcols = kernel.cols();
    int const krows = kernel.rows();
+   int const kchans = kernel.channels();
 
    int const rows = out.rows();
    int const cols = out.cols();
    int const channels = out.channels();
 
+   if( kchans != 1 && kchans != channels ) {
+      LOGE("Kernel has " << kchans << " channels, image has " << channels);
+      return;
+   }
+
    int const anchorRow = (anchor==Point(-1,-1)) ? krows/2 : anchor.y;
    int const anchorCol = (anchor==Point(-1,-1)) ? kcols/2 : anchor.x;
 
+   // Coefficient of tap (m,n) for each channel, broadcasting one-channel kernels
+   std::vector<U> coef(krows*kcols*channels);
+   for( int m = 0; m < krows; ++m )
+      for( int n = 0; n < kcols; ++n )
+         for( int k = 0; k < channels; ++k )
+            coef[(m*kcols + n)*channels + k] = kernel[m][n*kchans + (kchans == 1 ? 0 : k)];
+
    // Indices must always be valid:
    // img row: i + m - anchorRow
    // img col: j + n - anchorCol
    //
    // i + m - anchorRow >= 0:   i >= anchorRow
    // i + m - anchorRow < rows: i < rows + anchorRow - (krows-1)
-
-   int i,j,k;
-   int m,n;
-#pragma omp parallel for shared(out,img,kernel) private(i,j,k,m,n)
-   for( i = anchorRow; i < rows + anchorRow - krows + 1; ++i ) {
-      for( j = anchorCol; j < cols + anchorCol - kcols + 1; ++j ) {
-         for( k = 0; k < channels; ++k ) {
-            T& sum = out[i][j*channels + k];
-
-            //sum = 0;
-            // NOTE: is this the right place to apply the delta?
-            sum = delta;
-            for( m = 0; m < krows; ++m ) {
-               for( n = 0; n < kcols; ++n ) {
-                  sum += kernel[m][n*channels + k] * img[i+ m-anchorRow][(j+n-anchorCol)*channels + k];
+   int const rowBeg = anchorRow;
+   int const rowEnd = rows + anchorRow - krows + 1;
+   int const beg = anchorCol*channels;
+   int const end = (cols + anchorCol - kcols + 1)*channels;
+   if( rowEnd <= rowBeg || end <= beg )
+      return;
+
+   FilterBlock const block = filterBlock(krows, kcols, channels, sizeof(T), channels);
+   int const rowBlocks = (rowEnd - rowBeg + block.rows - 1) / block.rows;
+   int const colBlocks = (end - beg + block.cols - 1) / block.cols;
+
+   int b;
+#pragma omp parallel for shared(out,img,coef) private(b)
+   for( b = 0; b < rowBlocks*colBlocks; ++b ) {
+      int const i0 = rowBeg + (b / colBlocks)*block.rows;
+      int const i1 = std::min(i0 + block.rows, rowEnd);
+      int const s0 = beg + (b % colBlocks)*block.cols;
+      int const s1 = std::min(s0 + block.cols, end);
+
+      for( int i = i0; i < i1; ++i ) {
+         T* dst = out[i];
+         for( int s = s0; s < s1; s += channels ) {
+            for( int k = 0; k < channels; ++k ) {
+               // NOTE: is this the right place to apply the delta?
+               T sum = delta;
+               for( int m = 0; m < krows; ++m ) {
+                  T const* src = img[i + m - anchorRow] + s - anchorCol*channels + k;
+                  U const* c = &coef[m*kcols*channels + k];
+                  for( int n = 0; n < kcols; ++n )
+                     sum += c[n*channels] * src[n*channels];
                }
+               dst[s+k] = sum;
             }
          }
       }
@@ -142,51 +146,251 @@ void filter(
 
 /*!
  * \ingroup ImageProcessing
- * \brief Specialization for uint8_t images
+ * \brief Filter a float image with a kernel, using FFTs
+ *
+ * Gives the same result as filter(), up to float rounding, but the cost
+ * per pixel grows with the log of the kernel size rather than its area, so
+ * it wins for kernels beyond roughly 11x11. The image is processed in
+ * overlap-save tiles a few times the kernel size, so memory use does not
+ * grow with the image, and tiles run in parallel. FFT plans are kept per
+ * thread, so repeated calls with the same kernel size do not plan again.
+ *
+ * \param out The output of the filtering
+ * \param img Image to be filtered
+ * \param kernel Kernel to apply to the \c img, with one channel or as many
+ *        as \c img
+ * \param anchor see filter()
+ * \param delta see filter()
  */
-template<>
-void filter(
-   Image<uint8_t>& out,
-   Image<uint8_t> const& img,
-   Image<uint8_t> const& kernel,
+void filterFft(
+   ImageView<float> out,
+   ImageView<float> const& img,
+   ImageView<float> const& kernel,
+   Point const& anchor = Point(-1,-1),
+   float delta = 0.f
+);
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Vector instruction sets the uint8_t filters can use
+ *
+ * Ordered, so each level implies the ones before it.
+ */
+enum SimdLevel {
+   SIMD_NONE,
+   SIMD_SSE2,
+   SIMD_SSE41,
+   SIMD_AVX2
+};
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Instruction set the uint8_t filters currently use
+ *
+ * Starts out as the best one the CPU supports.
+ */
+SimdLevel simdLevel();
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Limit the instruction set the uint8_t filters use
+ *
+ * Mostly for testing and benchmarking the kernels against each other.
+ * Safe to call while filters run on other threads; each filter call uses
+ * the level in effect when it started.
+ *
+ * \param level the level to use, lowered to what the CPU supports
+ * \returns the level actually in use
+ */
+SimdLevel setSimdLevel(SimdLevel level);
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Non-template core of the uint8_t filters
+ *
+ * \param shift right shift applied to each sum, or -1 to divide by 255
+ * \see filter(), filterShift()
+ */
+void filterUint8(
+   ImageView<uint8_t> out,
+   ImageView<uint8_t> const& img,
+   ImageView<uint8_t> const& kernel,
    Point const& anchor,
-   float delta
+   int delta,
+   int shift
+);
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Version of filter() for uint8_t images
+ *
+ * A value of 255 in the kernel corresponds to 1.0. Kernels may have one
+ * channel or as many as the image, as in filter(). Sums are kept in 16 bits
+ * when the kernel is small enough and in 32 bits otherwise, using the best
+ * instruction set from simdLevel(); the result is identical either way.
+ */
+template<int C, int KC>
+void filter(
+   ImageView<uint8_t, C> out,
+   ImageView<uint8_t, C> const& img,
+   ImageView<uint8_t, KC> const& kernel,
+   Point const& anchor = Point(-1,-1),
+   float delta = 0.f
 ) {
-   int const kcols = kernel.cols();
-   int const krows = kernel.rows();
+   filterUint8(out, img, kernel, anchor, static_cast<int>(delta), -1);
+}
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief filter() for uint8_t kernels scaled by a power of two
+ *
+ * Each sum is shifted right by \c shift bits instead of divided by 255, so
+ * a value of 2^shift in the kernel corresponds to 1.0. Binomial kernels such
+ * as [1 2 1] with \c shift 2 are exact this way.
+ *
+ * \param out The output of the filtering
+ * \param img Image to be filtered
+ * \param kernel Kernel to apply to the \c img
+ * \param shift number of bits to shift each sum right, at most 30
+ * \param anchor see filter()
+ * \param delta value to add to each sum before shifting
+ */
+template<int C, int KC>
+void filterShift(
+   ImageView<uint8_t, C> out,
+   ImageView<uint8_t, C> const& img,
+   ImageView<uint8_t, KC> const& kernel,
+   int shift,
+   Point const& anchor = Point(-1,-1),
+   int delta = 0
+) {
+   filterUint8(out, img, kernel, anchor, delta, shift);
+}
+
+//! \brief Accumulator type and final scaling used by the filters
+template<class T, class U>
+struct FilterAccumulator {
+   typedef T Type;
+   static T store(Type sum) { return sum; }
+};
+
+//! \brief uint8_t filters sum in int, and 255 in the kernel means 1.0
+template<>
+struct FilterAccumulator<uint8_t, uint8_t> {
+   typedef int Type;
+   static uint8_t store(int sum) { return sum / 255; }
+};
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Filter an image with a separable kernel
+ *
+ * Equivalent to filtering with \c kx and then with \c ky, but without a
+ * full-size intermediate image. Each horizontally filtered row goes into a
+ * rolling buffer of \c ky.rows() rows, and every output row is emitted as
+ * soon as the rows it needs are in the buffer, so the intermediate stays in
+ * cache. Rows are processed in bands that run in parallel, each thread
+ * reusing one pooled rolling buffer for all of its bands.
+ *
+ * As with filter(), only pixels where the whole kernel fits inside \c img
+ * are written.
+ *
+ * \note This does not do convolution, but correlation
+ *
+ * \param out The output of the filtering
+ * \param img Image to be filtered
+ * \param kx 1xN horizontal kernel. Like \c ky, it either has one channel,
+ *        which is applied to every channel of \c img, or as many as \c img.
+ * \param ky Mx1 vertical kernel, with as many channels as \c kx
+ * \param anchor point within the NxM kernel considered to be the center. If
+ *        left at its default value, the anchor will be set to the center.
+ * \param delta value to add to the filtered value before storing in \c out
+ */
+template<class T, int C, class U, int KC>
+void filterSeparable(
+   ImageView<T, C> out,
+   ImageView<T, C> const& img,
+   ImageView<U, KC> const& kx,
+   ImageView<U, KC> const& ky,
+   Point const& anchor = Point(-1,-1),
+   float delta = 0.f
+) {
+   typedef FilterAccumulator<T, U> Acc;
+
+   int const kcols = kx.cols();
+   int const krows = ky.rows();
+   int const kchans = kx.channels();
 
    int const rows = out.rows();
    int const cols = out.cols();
    int const channels = out.channels();
 
+   if( (kchans != 1 && kchans != channels) || ky.channels() != kchans ) {
+      LOGE("Kernels have " << kchans << " and " << ky.channels() << " channels, image has " << channels);
+      return;
+   }
+
    int const anchorRow = (anchor==Point(-1,-1)) ? krows/2 : anchor.y;
    int const anchorCol = (anchor==Point(-1,-1)) ? kcols/2 : anchor.x;
 
-   // Indices must always be valid:
-   // img row: i + m - anchorRow
-   // img col: j + n - anchorCol
-   //
-   // i + m - anchorRow >= 0:   i >= anchorRow
-   // i + m - anchorRow < rows: i < rows + anchorRow - (krows-1)
-
-   int i,j,k;
-   int m,n;
-#pragma omp parallel for shared(out,img,kernel) private(i,j,k,m,n)
-   for( i = anchorRow; i < rows + anchorRow - krows + 1; ++i ) {
-      for( j = anchorCol; j < cols + anchorCol - kcols + 1; ++j ) {
-         for( k = 0; k < channels; ++k ) {
-            // NOTE: is this the right place to apply the delta?
-            int sum = delta;
-            for( m = 0; m < krows; ++m ) {
-               for( n = 0; n < kcols; ++n ) {
-                  int a = kernel[m][n*channels + k];
-                  // TODO: this line causes a lot of L1 misses
-                  int b = img[i+m-anchorRow][(j+n-anchorCol)*channels + k];
-                  sum += a*b;
+   // Valid output rows and columns, as in filter()
+   int const firstRow = anchorRow;
+   int const endRow = rows + anchorRow - krows + 1;
+   int const firstCol = anchorCol;
+   int const endCol = cols + anchorCol - kcols + 1;
+   if( firstRow >= endRow || firstCol >= endCol )
+      return;
+
+   int const rowLength = cols*channels;
+   int const bandRows = 64;
+   int const numBands = (endRow - firstRow + bandRows - 1) / bandRows;
+
+#pragma omp parallel shared(out,img,kx,ky)
+   {
+      // Per-thread scratch from the image pool, reused by every band the
+      // thread runs. Horizontally filtered input row r lives in ring[r % krows].
+      Image<T> ring(krows, rowLength, 1);
+      Image<typename Acc::Type> rowSum(1, rowLength, 1);
+      typename Acc::Type* sum = rowSum[0];
+
+#pragma omp for schedule(static)
+      for( int band = 0; band < numBands; ++band ) {
+         int const bandBeg = firstRow + band*bandRows;
+         int const bandEnd = std::min(bandBeg + bandRows, endRow);
+
+         // Next input row to filter horizontally
+         int next = bandBeg - anchorRow;
+
+         for( int i = bandBeg; i < bandEnd; ++i ) {
+            // Bring the input rows under the kernel into the buffer
+            for( ; next <= i - anchorRow + krows - 1; ++next ) {
+               T const* src = img[next];
+               T* dst = ring[next % krows];
+               for( int j = firstCol; j < endCol; ++j ) {
+                  for( int k = 0; k < channels; ++k ) {
+                     U const* c = kx[0] + (kchans == 1 ? 0 : k);
+                     typename Acc::Type s = 0;
+                     for( int n = 0; n < kcols; ++n )
+                        s += c[n*kchans] * src[(j+n-anchorCol)*channels + k];
+                     dst[j*channels + k] = Acc::store(s);
+                  }
                }
             }
-            // Assume that 255 in the kernel corresponds to 1.0
-            out[i][j*channels + k] = sum / 255;
+
+            // Vertical pass straight into the output row
+            for( int j = firstCol*channels; j < endCol*channels; ++j )
+               sum[j] = delta;
+            for( int m = 0; m < krows; ++m ) {
+               T const* src = ring[(i - anchorRow + m) % krows];
+               U const* k = ky[m];
+               for( int j = firstCol; j < endCol; ++j )
+                  for( int c = 0; c < channels; ++c )
+                     sum[j*channels + c] += k[kchans == 1 ? 0 : c] * src[j*channels + c];
+            }
+
+            T* dst = out[i];
+            for( int j = firstCol*channels; j < endCol*channels; ++j )
+               dst[j] = Acc::store(sum[j]);
          }
       }
    }
@@ -218,26 +422,107 @@ std::function<float(T,T,T,T,T,T,float)> gauss() {
 
 /*!
  * \ingroup ImageProcessing
- * \brief Image lowpass filtering
+ * \brief How lowpassFilter() computes its Gaussian
+ */
+enum LowpassMode {
+   //! Sampled Gaussian kernel of about 3*radius taps. Cost grows with the
+   //! radius, and pixels the kernel does not fit around are left alone.
+   LOWPASS_FIR,
+   //! Constant cost per pixel whatever the radius, and every pixel is
+   //! written, with edges replicated. Float images use a Young-van Vliet
+   //! recursive filter, uint8_t images three running box passes.
+   LOWPASS_RECURSIVE
+};
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Young-van Vliet recursive Gaussian
  *
- * \param[out] out output image
+ * Third-order causal and anti-causal passes along rows, then columns, in
+ * double precision. Constant cost per pixel for any \c sigma.
+ *
+ * \param[out] out output image, the shape of \c img. May be \c img.
  * \param[in] img input image
- * \param[in] radius spatial radius in pixels of the lowpass filter
+ * \param[in] sigma standard deviation in pixels. Below 0.5, \c img is copied.
  */
-template<class T>
-void lowpassFilter(
-   Image<T>& out,
-   Image<T> const& img,
-   int radius
+void recursiveGaussian(
+   ImageView<float> out,
+   ImageView<float> const& img,
+   float sigma
+);
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Gaussian approximated by three running box filters
+ *
+ * Box widths are chosen so the variance matches \c sigma. Sums are exact
+ * integers, rounded once after the rows and once after the columns.
+ *
+ * \param[out] out output image, the shape of \c img. May be \c img.
+ * \param[in] img input image
+ * \param[in] sigma standard deviation in pixels. Below 0.5, \c img is copied.
+ */
+void tripleBoxBlur(
+   ImageView<uint8_t> out,
+   ImageView<uint8_t> const& img,
+   float sigma
+);
+
+//! \brief LOWPASS_RECURSIVE for images that are not float: go through float
+template<class T, int C>
+void recursiveLowpass(
+   ImageView<T, C> out,
+   ImageView<T, C> const& img,
+   float sigma
+) {
+   Image<float> tmp(img.rows(), img.cols(), img.channels());
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols()*img.channels(); ++j )
+         tmp[i][j] = img[i][j];
+
+   recursiveGaussian(tmp, tmp, sigma);
+
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols()*img.channels(); ++j )
+         out[i][j] = static_cast<T>(tmp[i][j]);
+}
+
+//! \brief LOWPASS_RECURSIVE for float images
+template<int C>
+void recursiveLowpass(
+   ImageView<float, C> out,
+   ImageView<float, C> const& img,
+   float sigma
+) {
+   recursiveGaussian(out, img, sigma);
+}
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief The separable Gaussian kernels of the FIR lowpassFilter()
+ *
+ * Callers filtering many images of the same shape can build these once and
+ * call filterSeparable() themselves.
+ *
+ * \param[out] kernelX 1xN horizontal kernel, resized here
+ * \param[out] kernelY Nx1 vertical kernel, resized here
+ * \param[in] radius spatial radius in pixels, as for lowpassFilter()
+ * \param[in] chans channels to repeat the taps over
+ */
+template<class U, int C>
+void lowpassKernels(
+   Image<U, C>& kernelX,
+   Image<U, C>& kernelY,
+   int radius,
+   int chans
 ) {
    auto kFunc = gauss<int>();
    int const kSize = radius % 2 == 0 ? 3*radius+1 : 3*radius;
    int const kCenter = kSize/2;
    int const kStd = radius/2;
 
-   int const chans = img.channels();
-   Image<float> kernelX(1,kSize,img.channels());
-   Image<float> kernelY(kSize,1,img.channels());
+   kernelX.resize(1,kSize,chans);
+   kernelY.resize(kSize,1,chans);
    float sum = 0.f;
    float val;
    for(int i = 0; i < kSize; ++i) {
@@ -252,30 +537,65 @@ void lowpassFilter(
          kernelY[i][k] /= sum;
       }
    }
+}
 
-   Image<T> tmp(img.rows(), img.cols(), img.channels());
-   filter(tmp, img, kernelX);
-   filter(out, tmp, kernelY);
+/*!
+ * \ingroup ImageProcessing
+ * \brief Image lowpass filtering
+ *
+ * The Gaussian has a standard deviation of radius/2 (rounded down) in
+ * either mode. LOWPASS_RECURSIVE stays within about 1% of the full range of
+ * the FIR result (see ImageProcessingTest.lowpassRecursive).
+ *
+ * \param[out] out output image
+ * \param[in] img input image
+ * \param[in] radius spatial radius in pixels of the lowpass filter
+ * \param[in] mode FIR kernel or recursive approximation
+ */
+template<class T, int C>
+void lowpassFilter(
+   ImageView<T, C> out,
+   ImageView<T, C> const& img,
+   int radius,
+   LowpassMode mode = LOWPASS_FIR
+) {
+   if( mode == LOWPASS_RECURSIVE ) {
+      recursiveLowpass(out, img, static_cast<float>(radius/2));
+      return;
+   }
+
+   Image<float, C> kernelX;
+   Image<float, C> kernelY;
+   lowpassKernels(kernelX, kernelY, radius, img.channels());
+   filterSeparable(out, img, kernelX, kernelY);
 }
 
 /*!
  * \ingroup ImageProcessing
- * \brief Specialization for uint8_t images
+ * \brief Version of lowpassFilter() for uint8_t images
+ *
+ * LOWPASS_RECURSIVE uses tripleBoxBlur().
  */
-template<>
+template<int C>
 void lowpassFilter(
-   Image<uint8_t>& out,
-   Image<uint8_t> const& img,
-   int radius
+   ImageView<uint8_t, C> out,
+   ImageView<uint8_t, C> const& img,
+   int radius,
+   LowpassMode mode = LOWPASS_FIR
 ) {
+   if( mode == LOWPASS_RECURSIVE ) {
+      tripleBoxBlur(out, img, static_cast<float>(radius/2));
+      return;
+   }
+
    auto kFunc = gauss<int>();
    int const kSize = radius % 2 == 0 ? 3*radius+1 : 3*radius;
    int const kCenter = kSize/2;
    int const kStd = radius/2;
 
    int const chans = img.channels();
-   Image<uint8_t> kernelX(1,kSize,img.channels());
-   Image<uint8_t> kernelY(kSize,1,img.channels());
+   Image<uint8_t, C> kernelX(1,kSize,img.channels());
+   Image<uint8_t, C> kernelY(kSize,1,img.channels());
    float sum = 0;
    int val;
    for(int i = 0; i < kSize; ++i) {
@@ -292,162 +612,280 @@ void lowpassFilter(
       }
    }
 
-   Image<uint8_t> tmp(img.rows(), img.cols(), img.channels());
-   filter(tmp, img, kernelX);
-   filter(out, tmp, kernelY);
+   filterSeparable(out, img, kernelX, kernelY);
 }
 
 /*!
  * \ingroup ImageProcessing
- * \brief Get spatial gradients
+ * \brief Filter every plane of a planar image with the same kernel
+ *
+ * \param out The output of the filtering, already the shape of \c img
+ * \param img Image to be filtered
+ * \param kernel Single-channel kernel to apply to each plane of \c img
+ * \param anchor see filter()
+ * \param delta see filter()
  */
-template<class T>
-void gradient(
-   Image<float>& outDx,
-   Image<float>& outDy,
-   Image<T> const& img
+template<class T, class U, int KC>
+void filter(
+   PlanarImage<T>& out,
+   PlanarImage<T> const& img,
+   ImageView<U, KC> const& kernel,
+   Point const& anchor = Point(-1,-1),
+   float delta = 0.f
 ) {
+   for(int k = 0; k < img.channels(); ++k)
+      filter(out.plane(k), img.plane(k), kernel, anchor, delta);
+}
 
-   int const chans = img.channels();
-   Image<float> dx(1,3,img.channels());
-   Image<float> dy(3,1,img.channels());
-
-   dx[0][0*chans + 0] = -0.5f;
-   dx[0][2*chans + 0] = 0.5f;
-
-   dy[0][0] = -0.5f;
-   dy[2][0] = 0.5f;
-
-   for(int i = 1; i < chans; ++i) {
-      dx[0][0*chans + i] = dx[0][0*chans + 0];
-      dx[0][2*chans + i] = dx[0][2*chans + 0];
-      dy[0][chans] = dy[0][0];
-      dy[2][chans] = dy[2][0];
-   }
+/*!
+ * \ingroup ImageProcessing
+ * \brief Lowpass filter every plane of a planar image
+ *
+ * \param[out] out output image, already the shape of \c img
+ * \param[in] img input image
+ * \param[in] radius spatial radius in pixels of the lowpass filter
+ * \param[in] mode see LowpassMode
+ */
+template<class T>
+void lowpassFilter(
+   PlanarImage<T>& out,
+   PlanarImage<T> const& img,
+   int radius,
+   LowpassMode mode = LOWPASS_FIR
+) {
+   for(int k = 0; k < img.channels(); ++k)
+      lowpassFilter(out.plane(k), img.plane(k), radius, mode);
+}
 
-   filter(outDx, img, dx);
-   filter(outDy, img, dy);
+/*!
+ * \ingroup ImageProcessing
+ * \brief Get spatial gradients
+ *
+ * Central differences, computed for both directions in one pass over
+ * \c img with the CentralDiffX and CentralDiffY stencils. \c outDx is
+ * written everywhere but the first and last columns, \c outDy everywhere
+ * but the first and last rows.
+ */
+template<class T, int C>
+void gradient(
+   ImageView<float, C> outDx,
+   ImageView<float, C> outDy,
+   ImageView<T, C> const& img
+) {
+   applyStencils<CentralDiffX, CentralDiffY>(outDx, outDy, img);
 }
 
 /*!
  * \ingroup ImageProcessing
  * \brief Convert dense optical flow to an rgb image for display
  *
- * \param[out] rgb output rgb image
+ * \param[out] rgb output rgb image, the same size as \c flow with 3 channels
  * \param[in] flow flow image whose 2 channels are [vx, vy]
  * \param[in] maxFlow denominator used to scale flow values for display
  */
 void opticalFlowToRgb(
-   Image<uint8_t>& rgb,
-   Image<float>& flow,
+   ImageView<uint8_t> rgb,
+   ImageView<float> const& flow,
    float const maxFlow = 2.f
-){
-   int const rows = rgb.rows();
-   int const cols = rgb.cols();
-
-   Image<float> hsv(rows, cols, 3);
-   int i,j;
-   for( i = 0; i < rows; ++i ) {
-      for( j = 0; j < cols; ++j ) {
-         float dx = flow[i][j*2+0];
-         float dy = flow[i][j*2+1];
-         float angle = 180.f/M_PI * atan2(dy, dx);
-         float mag = sqrtf(dx*dx + dy*dy) / maxFlow;
-
-         if( angle < 0.f )
-            angle += 360.f;
-
-         hsv[i][j*3+0] = angle;
-         hsv[i][j*3+1] = std::min(1.f, mag);
-         hsv[i][j*3+2] = 1.f;
-      }
-   }
-
-   hsv2rgb(hsv);
-   rgb.convertFrom<float>(hsv, [](float x) -> uint8_t { return static_cast<uint8_t>(255.f*x); });
-}
+);
 
 /*!
  * \ingroup ImageProcessing
  * \brief Horn-Schunck optical flow
  *
+ * The normal equations of each window are read from integral images of the
+ * gradient products, so the cost per pixel does not grow with \c radius.
+ * For consecutive frames of a video, OpticalFlowStream gives the same flows
+ * while filtering each frame only once.
+ *
  * \param[out] flow output optical flow image, whose 2 channels are [vx, vy]
  * \param[in] img0 reference image frame
  * \param[in] img1 image frame coming temporally after \c img0
+ * \param[in] radius the flow at (i,j) fits the 2r x 2r window of pixels
+ *            [i-r, i+r) x [j-r, j+r); pixels within \c radius of the
+ *            edges are not written
  */
 void hsOpticalFlow(
-   Image<float>& flow,
-   Image<float> const& img0,
-   Image<float> const& img1
-) {
-   // Patch radius in pixels
-   int const radius = 3;
-   int const rows = img0.rows();
-   int const cols = img0.cols();
-   int const chans = img0.channels();
-   // Regularization parameter (bias flow towards 0)
-   float const gamma = 1e-2 * (2*radius+1)*(2*radius+1)*chans;
-   int i,j,k;
-   int m,n;
-   Image<float> x0(rows, cols, chans);
-   Image<float> x1(rows, cols, chans);
-   Image<float> dx(rows, cols, chans);
-   Image<float> dy(rows, cols, chans);
-   Image<float> dt(rows, cols, chans);
-
-   // LPF for noise
-   lowpassFilter(x0, img0, 2);
-   lowpassFilter(x1, img1, 2);
-
-   // Get dx,dy,dt
-   gradient(dx, dy, x0);
-   for(i = 0; i < rows; ++i)
-      for(j = 0; j < cols; ++j)
-         for(k = 0; k < chans; ++k)
-            dt[i][j*chans+k] = x0[i][j*chans+k] - x1[i][j*chans+k];
-
-   // | Ix[0]  Iy[0] | [dx;dy] = | It[0] |
-   // | Ix[1]  Iy[1] |           | It[1] |
-   //   ...
-   // | Ix[n]  Iy[n] |           | It[n] |
-   //
-   // A x = b
-   // x = (A^TA)^-1 A^Tb
-   // A^TA = [ \sum_{i=1}^n Ix[i]^2 & \sum{i=1}^n Ix[i]Iy[i] \\ \sum{i=1}^n Ix[i]Iy[i] & \sum{i=1}^n Iy[i]^2 ]
-   // A^Tb = [ \sum_{i=1}^n Ix[i]It[i] \\ \sum_{i=1}^n Iy[i]It[i] ]
-
-   Eigen::Matrix2f A;
-   Eigen::Vector2f b;
-   Eigen::Vector2f x;
-   for(i = radius; i < rows - radius; ++i) {
-      for(j = radius; j < cols - radius; ++j) {
-         A.setZero();
-         b.setZero();
-
-         // NOTE: optimize this aggregation later with integral images
-         for(m = i-radius; m < i+radius; ++m) {
-            for(n = j-radius; n < j+radius; ++n) {
-               for(k = 0; k < chans; ++k) {
-                  A(0,0) += dx[m][n*chans+k]*dx[m][n*chans+k];
-                  A(0,1) += dx[m][n*chans+k]*dy[m][n*chans+k];
-                  A(1,1) += dy[m][n*chans+k]*dy[m][n*chans+k];
-
-                  b(0) += dx[m][n*chans+k]*dt[m][n*chans+k];
-                  b(1) += dy[m][n*chans+k]*dt[m][n*chans+k];
-               }
-            }
-         }
-         // Make it symmetric
-         A(1,0) = A(0,1);
-         // Apply regularization
-         A(0,0) += gamma;
-         A(1,1) += gamma;
-
-         x = A.ldlt().solve(b);
-         flow[i][j*2+0] = x(0);
-         flow[i][j*2+1] = x(1);
-      }
-   }
+   ImageView<float> flow,
+   ImageView<float> const& img0,
+   ImageView<float> const& img1,
+   int radius = 3
+);
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Sample one channel at a subpixel position by bilinear interpolation
+ *
+ * Positions outside the image take the nearest edge sample.
+ *
+ * \param img the image
+ * \param y row coordinate, where row i is at y = i
+ * \param x column coordinate, where column j is at x = j
+ * \param k channel
+ */
+template<class T, int C>
+inline float sampleBilinear(ImageView<T, C> const& img, float y, float x, int k = 0) {
+   int const chans = img.channels();
+   y = std::min(std::max(y, 0.f), static_cast<float>(img.rows() - 1));
+   x = std::min(std::max(x, 0.f), static_cast<float>(img.cols() - 1));
+   int const i = std::min(static_cast<int>(y), std::max(img.rows() - 2, 0));
+   int const j = std::min(static_cast<int>(x), std::max(img.cols() - 2, 0));
+   int const i1 = std::min(i + 1, img.rows() - 1);
+   int const j1 = std::min(j + 1, img.cols() - 1);
+   float const fy = y - i;
+   float const fx = x - j;
+
+   float const top = (1.f - fx)*img[i][j*chans+k] + fx*img[i][j1*chans+k];
+   float const bottom = (1.f - fx)*img[i1][j*chans+k] + fx*img[i1][j1*chans+k];
+   return (1.f - fy)*top + fy*bottom;
 }
 
+/*!
+ * \ingroup ImageProcessing
+ * \brief Warp an image backwards along a flow field
+ *
+ * \c out(p) = \c img(p + \c flow(p)), sampled with sampleBilinear(). When
+ * \c flow is the optical flow from \c img0 to \c img, this pulls \c img back
+ * onto \c img0.
+ *
+ * \param[out] out warped image, the shape of \c img
+ * \param[in] img image to warp
+ * \param[in] flow 2-channel flow [vx, vy], the size of \c img
+ */
+void warp(
+   ImageView<float> out,
+   ImageView<float> const& img,
+   ImageView<float> const& flow
+);
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Blur and decimate by 2
+ *
+ * \param[out] out (rows+1)/2 x (cols+1)/2 image with the channels of \c img
+ * \param[in] img input image
+ */
+void pyramidDown(
+   ImageView<float> out,
+   ImageView<float> const& img
+);
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Build a Gaussian pyramid
+ *
+ * Level 0 is a copy of \c img and each level after it is pyramidDown() of
+ * the one before. Fewer than \c levels are built if a level would get
+ * narrower or shorter than 16 pixels.
+ *
+ * \param[out] pyramid the levels, finest first
+ * \param[in] img input image
+ * \param[in] levels number of levels wanted, at least 1
+ */
+void gaussianPyramid(
+   std::vector< Image<float> >& pyramid,
+   ImageView<float> const& img,
+   int levels
+);
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Coarse-to-fine optical flow over Gaussian pyramids
+ *
+ * The flow is estimated with hsOpticalFlow() at the coarsest level, then at
+ * each finer level it is doubled, \c img1 is warped by it, and
+ * hsOpticalFlow() measures what remains. Motions of about
+ * 2^(levels-1) times what one level tracks become cheap to find, since the
+ * coarse levels are small.
+ *
+ * \param[out] flow output optical flow image, whose 2 channels are [vx, vy],
+ *            the size of the finest level
+ * \param[in] pyramid0 gaussianPyramid() of the reference frame
+ * \param[in] pyramid1 gaussianPyramid() of the next frame, with as many
+ *            levels of the same shapes
+ * \param[in] radius window radius at every level, see hsOpticalFlow()
+ */
+void pyramidOpticalFlow(
+   ImageView<float> flow,
+   std::vector< Image<float> > const& pyramid0,
+   std::vector< Image<float> > const& pyramid1,
+   int radius = 3
+);
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Coarse-to-fine optical flow between two frames
+ *
+ * Builds both pyramids and calls pyramidOpticalFlow() on them.
+ *
+ * \param[out] flow output optical flow image, whose 2 channels are [vx, vy]
+ * \param[in] img0 reference image frame
+ * \param[in] img1 image frame coming temporally after \c img0
+ * \param[in] levels pyramid levels, see gaussianPyramid()
+ * \param[in] radius window radius at every level, see hsOpticalFlow()
+ */
+void pyramidOpticalFlow(
+   ImageView<float> flow,
+   ImageView<float> const& img0,
+   ImageView<float> const& img1,
+   int levels = 4,
+   int radius = 3
+);
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Track sparse points with pyramidal Lucas-Kanade
+ *
+ * Each point is tracked on its own, coarse to fine. At every level a
+ * (2r+1)x(2r+1) window around the point is sampled from \c pyramid0 with
+ * sampleBilinear(), its gradient is taken with gradient(), and the window's
+ * displacement in \c pyramid1 is refined by Gauss-Newton steps until a step
+ * is under 0.01 pixels or \c iterations run out. The work is proportional to
+ * the number of points, not to the image area; the pyramids can be kept and
+ * reused across calls.
+ *
+ * A point is lost when its window has too little texture to solve for both
+ * directions, or when its window in either frame does not fit inside the
+ * image, so points within \c radius of the edges are always lost. Texture
+ * is judged by the smaller eigenvalue of the window's structure tensor
+ * relative to its gradient energy, so images in [0,1] and in [0,255] track
+ * the same way.
+ *
+ * \param[out] next where each point moved to in the next frame
+ * \param[out] status 1 for each point tracked, 0 for each point lost
+ * \param[in] pyramid0 gaussianPyramid() of the reference frame
+ * \param[in] pyramid1 gaussianPyramid() of the next frame, as many levels
+ * \param[in] points points in the reference frame, in level 0 pixels
+ * \param[in] radius window radius in pixels, at every level
+ * \param[in] iterations most refinement steps per level
+ */
+void trackFeatures(
+   std::vector<Point2f>& next,
+   std::vector<uint8_t>& status,
+   std::vector< Image<float> > const& pyramid0,
+   std::vector< Image<float> > const& pyramid1,
+   std::vector<Point2f> const& points,
+   int radius = 7,
+   int iterations = 10
+);
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Track sparse points between two frames
+ *
+ * Builds both pyramids and calls trackFeatures() on them.
+ *
+ * \param levels pyramid levels, see gaussianPyramid()
+ */
+void trackFeatures(
+   std::vector<Point2f>& next,
+   std::vector<uint8_t>& status,
+   ImageView<float> const& img0,
+   ImageView<float> const& img1,
+   std::vector<Point2f> const& points,
+   int levels = 3,
+   int radius = 7,
+   int iterations = 10
+);
+
 #endif /*IMAGEPROCESSING_H*/
@@ -0,0 +1,203 @@
+/*
+ * ImageView.h is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#ifndef IMAGEVIEW_H
+#define IMAGEVIEW_H
+
+#include <assert.h>
+#include <stddef.h>
+#include <inttypes.h>
+#include <type_traits>
+
+//! \brief Channel count template argument meaning "decided at runtime"
+enum { DYNAMIC_CHANNELS = 0 };
+
+/*!
+ * \brief A non-owning window onto pixel memory
+ *
+ * A view is just a pointer, a shape and a row stride, so it is cheap to copy
+ * and pass by value. It never allocates or frees anything; whatever owns the
+ * memory (usually an Image) must outlive the view.
+ *
+ * Every Image is also an ImageView of itself, so functions written against
+ * ImageView accept both whole images and regions of interest.
+ *
+ * When \c C is fixed, channels() is a compile-time constant, so loops over
+ * \c img[i][j*img.channels()+k] unroll and vectorize. A fixed-channel view
+ * converts implicitly to a dynamic one, and a dynamic view converts
+ * explicitly to a fixed one.
+ *
+ * A const view cannot be copied into a writable one. Functions take their
+ * outputs as writable views by value and their inputs by const reference,
+ * so passing a const image as an output does not compile. A const view
+ * still converts to a read-only ImageView<T const, C>, which is what view()
+ * returns on a const view, and which binds back to const references for
+ * reading.
+ *
+ * \tparam T the type of an individual channel; const for a read-only view
+ * \tparam C the number of channels, or \c DYNAMIC_CHANNELS
+ */
+template<class T, int C = DYNAMIC_CHANNELS>
+class ImageView {
+public:
+
+   //! \brief The channel type without const
+   typedef typename std::remove_const<T>::type Sample;
+
+   //! \brief Empty view
+   ImageView() :
+      _data(0),
+      _rows(0),
+      _cols(0),
+      _channels(C),
+      _rowWidth(0)
+   {
+   }
+
+   /*!
+    * \brief View of existing memory
+    *
+    * \param data pointer to the first channel of the top-left pixel
+    * \param rows number of rows
+    * \param cols number of columns
+    * \param channels number of channels
+    * \param rowWidth number of bytes from the start of one row to the next
+    */
+   ImageView(T* data, int rows, int cols, int channels, int rowWidth) :
+      _data(reinterpret_cast<uint8_t*>(const_cast<Sample*>(data))),
+      _rows(rows),
+      _cols(cols),
+      _channels(channels),
+      _rowWidth(rowWidth)
+   {
+      assert( C == DYNAMIC_CHANNELS || channels == C );
+   }
+
+   //! \brief Copy of a writable view
+   ImageView(ImageView& other) = default;
+   //! \brief Copy of a temporary view
+   ImageView(ImageView&& other) = default;
+   //! \brief A const view must not become writable
+   ImageView(ImageView const& other) = delete;
+
+   //! \brief Assign a writable view
+   ImageView& operator=(ImageView& rhs) = default;
+   //! \brief Assign a temporary view
+   ImageView& operator=(ImageView&& rhs) = default;
+
+   //! \brief Fixed-channel view of a dynamic-channel view with \c C channels
+   template<int C2, typename std::enable_if<C != DYNAMIC_CHANNELS && C2 == DYNAMIC_CHANNELS, int>::type = 0>
+   explicit ImageView(ImageView<T, C2>& other) :
+      _data(other._data),
+      _rows(other._rows),
+      _cols(other._cols),
+      _channels(other._channels),
+      _rowWidth(other._rowWidth)
+   {
+      assert( other._channels == C );
+   }
+
+   //! \brief Read-only view of any view of the same samples
+   template<class U, int C2, typename std::enable_if<
+      std::is_const<T>::value && std::is_same<U const, T>::value &&
+      (C == C2 || C == DYNAMIC_CHANNELS), int>::type = 0>
+   ImageView(ImageView<U, C2> const& other) :
+      _data(other._data),
+      _rows(other._rows),
+      _cols(other._cols),
+      _channels(other._channels),
+      _rowWidth(other._rowWidth)
+   {
+   }
+
+   //! \brief Dynamic-channel view of a fixed-channel view
+   template<int C2 = C, typename std::enable_if<C2 != DYNAMIC_CHANNELS, int>::type = 0>
+   operator ImageView<T>() {
+      return ImageView<T>(reinterpret_cast<T*>(_data), _rows, _cols, _channels, _rowWidth);
+   }
+
+   /*!
+    * \brief Dynamic-channel view of a const fixed-channel view
+    *
+    * Lets a const fixed-channel view bind to a dynamic const& input. The
+    * result is const, so it cannot be copied into a writable view.
+    */
+   template<int C2 = C, typename std::enable_if<C2 != DYNAMIC_CHANNELS, int>::type = 0>
+   operator ImageView<T> const() const {
+      return ImageView<T>(reinterpret_cast<T*>(_data), _rows, _cols, _channels, _rowWidth);
+   }
+
+   /*!
+    * \brief Read-only view as a const writable one, for const& inputs
+    *
+    * The result is const, so it can be read through but not copied into a
+    * writable view.
+    */
+   template<class U = T, typename std::enable_if<std::is_const<U>::value, int>::type = 0>
+   operator ImageView<Sample, C> const() const {
+      return ImageView<Sample, C>(reinterpret_cast<Sample*>(_data), _rows, _cols, _channels, _rowWidth);
+   }
+
+   //! \brief Number of rows in the image
+   int rows() const { return _rows; }
+   //! \brief Number of columns in the image
+   int cols() const { return _cols; }
+   //! \brief Number of channels in the image
+   int channels() const { return C != DYNAMIC_CHANNELS ? C : _channels; }
+   //! \brief Number of bytes in a row of pixels
+   int rowWidth() const { return _rowWidth; }
+
+   //! \brief Pointer to the ith row of pixel data
+   T* operator[](size_t i) { return reinterpret_cast<T*>(_data + i*_rowWidth); }
+   //! \brief Pointer to the ith row of pixel data (const version)
+   T const* operator[](size_t i) const { return reinterpret_cast<T const*>(_data + i*_rowWidth); }
+
+   /*!
+    * \brief View a rectangular region without copying
+    *
+    * The result shares memory with this view. If the specified region is
+    * outside the image boundary, the output is an empty view.
+    *
+    * \param[in] left the left boundary
+    * \param[in] right the right boundary
+    * \param[in] top the upper boundary
+    * \param[in] bottom the lower boundary
+    */
+   ImageView<T, C> view(int left, int right, int top, int bottom) {
+      if( left > right ||
+         top > bottom ||
+         left < 0 ||
+         right >= _cols ||
+         top < 0 ||
+         bottom >= _rows ) {
+         return ImageView<T, C>();
+      }
+
+      return ImageView<T, C>(
+         (*this)[top] + left*channels(),
+         bottom-top+1,
+         right-left+1,
+         _channels,
+         _rowWidth
+      );
+   }
+
+   //! \brief View a rectangular region without copying (read-only version)
+   ImageView<T const, C> view(int left, int right, int top, int bottom) const {
+      return ImageView<T const, C>(const_cast<ImageView<T, C>*>(this)->view(left, right, top, bottom));
+   }
+
+protected:
+
+   template<class, int> friend class ImageView;
+
+   uint8_t* _data;
+   int _rows;
+   int _cols;
+   int _channels;
+   int _rowWidth;
+};
+
+#endif /*IMAGEVIEW_H*/
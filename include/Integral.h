@@ -0,0 +1,361 @@
+/*
+ * Integral.h is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#ifndef INTEGRAL_H
+#define INTEGRAL_H
+
+#include <pgvl.h>
+#include <Image.h>
+#include <ImageView.h>
+#include <Rect.h>
+#include <algorithm>
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+//! Bytes of each row one thread sweeps in integralColumnScan()
+#define INTEGRAL_COLUMN_BLOCK 4096
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Prefix scan the columns of an image in place
+ *
+ * Instead of walking down one column at a time, this sweeps down the image
+ * adding each whole row to the one below it, which reads memory in order
+ * and vectorizes. The columns are cut into blocks of
+ * INTEGRAL_COLUMN_BLOCK bytes, so threads sweep disjoint cache lines.
+ *
+ * \param[in,out] img the image to scan
+ * \param[in] firstRow the first row to add the row above to
+ */
+template<class T, int C>
+void integralColumnScan(ImageView<T, C> img, int firstRow = 1) {
+   int const samples = img.cols()*img.channels();
+   int const block = std::max<int>(INTEGRAL_COLUMN_BLOCK / sizeof(T), 1);
+   int const blocks = (samples + block - 1) / block;
+
+   int b;
+#pragma omp parallel for shared(img) private(b)
+   for( b = 0; b < blocks; ++b ) {
+      int const begin = b*block;
+      int const end = std::min(begin + block, samples);
+      for( int i = firstRow; i < img.rows(); ++i ) {
+         T* row = img[i];
+         T const* above = img[i-1];
+         for( int j = begin; j < end; ++j )
+            row[j] += above[j];
+      }
+   }
+}
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Create an integral image
+ *
+ * For now, purposefully ignores overflowing. To keep the sums, integrate
+ * into a wider type with integrate(out, img).
+ *
+ * \param[in,out] img the input image and output integral image
+ */
+template<class T, int C>
+void integrate(ImageView<T, C> img) {
+   int i,j;
+   int const channels = img.channels();
+   int const samples = img.cols()*channels;
+
+   // Prefix scan all the rows
+#pragma omp parallel for shared(img) private(i,j)
+   for( i = 0; i < img.rows(); ++i ) {
+      T* row = img[i];
+      for( j = channels; j < samples; ++j )
+         row[j] += row[j-channels];
+   }
+
+   integralColumnScan(img);
+}
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Create a squared integral image
+ *
+ * For now, purposefully ignores overflowing. To keep the sums, integrate
+ * into a wider type with integrateSquare(out, img).
+ *
+ * \param[in,out] img the input image and output squared integral image
+ */
+template<class T, int C>
+void integrateSquare(ImageView<T, C> img) {
+   int i,j;
+   int const channels = img.channels();
+   int const samples = img.cols()*channels;
+
+   // Square and prefix scan all the rows
+#pragma omp parallel for shared(img) private(i,j)
+   for( i = 0; i < img.rows(); ++i ) {
+      T* row = img[i];
+      for( j = 0; j < channels; ++j )
+         row[j] *= row[j];
+      for( j = channels; j < samples; ++j )
+         row[j] = (row[j]*row[j]) + row[j-channels];
+   }
+
+   // NOTE: we do not have to square any pixels here, because
+   // all pixels have been squared in the row scan above
+   integralColumnScan(img);
+}
+
+//! \brief integralScan() operation summing samples
+struct IntegralSamples {
+   static bool const enabled = true;
+   template<class Acc, class T>
+   static Acc map(T x) { return Acc(x); }
+};
+
+//! \brief integralScan() operation summing squared samples
+struct IntegralSquares {
+   static bool const enabled = true;
+   template<class Acc, class T>
+   static Acc map(T x) { return Acc(x)*Acc(x); }
+};
+
+//! \brief integralScan() operation for an output that is not wanted
+struct IntegralNone {
+   static bool const enabled = false;
+   template<class Acc, class T>
+   static Acc map(T) { return Acc(0); }
+};
+
+/*!
+ * \brief One row of a padded integral image
+ *
+ * The row is prefix summed into \c dst, after its zero column, and then the
+ * row above is added in one vectorizable sweep.
+ */
+template<class Op, class Acc, class T>
+inline void integralRow(Acc* dst, Acc const* above, T const* src, int samples, int channels) {
+   for( int k = 0; k < channels; ++k )
+      dst[k] = Acc(0);
+   for( int j = 0; j < samples; ++j )
+      dst[j+channels] = dst[j] + Op::template map<Acc>(src[j]);
+   for( int j = channels; j < samples + channels; ++j )
+      dst[j] += above[j];
+}
+
+/*!
+ * \brief Engine behind the widened integrate() and integrateSquare()
+ *
+ * Computes \c out1 with \c Op1 and, unless \c Op2 is IntegralNone, \c out2
+ * with \c Op2, from one pass over \c img.
+ *
+ * The rows are cut into one band per thread, and the column scan is done
+ * in two levels. First each band totals its columns, and the totals are
+ * prefix summed across bands, giving every band the row above it. Then
+ * each band sweeps down its rows, writing every output row once.
+ */
+template<class Op1, class Op2, class Acc1, int C1, class Acc2, int C2, class T, int C>
+void integralScan(
+   ImageView<Acc1, C1> out1,
+   ImageView<Acc2, C2> out2,
+   ImageView<T, C> const& img
+) {
+   int const rows = img.rows();
+   int const channels = img.channels();
+   int const samples = img.cols()*channels;
+   int const width = samples + channels;
+
+   std::fill(out1[0], out1[0] + width, Acc1(0));
+   if( Op2::enabled )
+      std::fill(out2[0], out2[0] + width, Acc2(0));
+   if( rows <= 0 )
+      return;
+
+   // Bands of at least 16 rows, so the totals pass stays cheap
+   int bands = 1;
+#ifdef _OPENMP
+   bands = std::max(1, std::min(omp_get_max_threads(), rows/16));
+#endif
+   int const bandRows = (rows + bands - 1) / bands;
+   bands = (rows + bandRows - 1) / bandRows;
+
+   // carry[b] is the integral row just above band b. Pooled and zeroed, so
+   // repeated calls on the same shape do not touch the heap.
+   Image<Acc1> carry1(bands, width, 1);
+   Image<Acc2> carry2(Op2::enabled ? bands : 0, width, 1);
+
+   int b;
+   if( bands > 1 ) {
+      // Column totals of band b-1 into carry[b]
+#pragma omp parallel for shared(img,carry1,carry2) private(b)
+      for( b = 1; b < bands; ++b ) {
+         Acc1* total1 = carry1[b] + channels;
+         Acc2* total2 = Op2::enabled ? carry2[b] + channels : 0;
+         for( int i = (b-1)*bandRows; i < b*bandRows; ++i ) {
+            T const* src = img[i];
+            for( int j = 0; j < samples; ++j )
+               total1[j] += Op1::template map<Acc1>(src[j]);
+            if( Op2::enabled ) {
+               for( int j = 0; j < samples; ++j )
+                  total2[j] += Op2::template map<Acc2>(src[j]);
+            }
+         }
+      }
+
+      // Prefix sum the totals along the row, then down the bands
+      for( b = 1; b < bands; ++b ) {
+         Acc1* c1 = carry1[b];
+         Acc2* c2 = Op2::enabled ? carry2[b] : 0;
+         for( int j = channels; j < width; ++j ) {
+            c1[j] += c1[j-channels];
+            if( Op2::enabled )
+               c2[j] += c2[j-channels];
+         }
+         if( b == 1 )
+            continue;
+         Acc1 const* prev1 = carry1[b-1];
+         Acc2 const* prev2 = Op2::enabled ? carry2[b-1] : 0;
+         for( int j = 0; j < width; ++j ) {
+            c1[j] += prev1[j];
+            if( Op2::enabled )
+               c2[j] += prev2[j];
+         }
+      }
+   }
+
+#pragma omp parallel for shared(out1,out2,img,carry1,carry2) private(b)
+   for( b = 0; b < bands; ++b ) {
+      Acc1 const* above1 = carry1[b];
+      Acc2 const* above2 = Op2::enabled ? carry2[b] : 0;
+      int const end = std::min((b+1)*bandRows, rows);
+      for( int i = b*bandRows; i < end; ++i ) {
+         integralRow<Op1>(out1[i+1], above1, img[i], samples, channels);
+         above1 = out1[i+1];
+         if( Op2::enabled ) {
+            integralRow<Op2>(out2[i+1], above2, img[i], samples, channels);
+            above2 = out2[i+1];
+         }
+      }
+   }
+}
+
+//! \brief Whether \c out can hold the padded integral image of \c img
+template<class Acc, int C, class T, int C2>
+bool integralShapeOk(ImageView<Acc, C> const& out, ImageView<T, C2> const& img) {
+   if( out.rows() != img.rows()+1 || out.cols() != img.cols()+1 || out.channels() != img.channels() ) {
+      LOGE("Integral image must be one row and one column larger than the image");
+      return false;
+   }
+   return true;
+}
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Create an integral image in a wider type
+ *
+ * \c out has a row and a column of zeros in front, so
+ * \c out[i][j*channels+k] is the sum of channel \c k over the \c i rows and
+ * \c j columns above and left of pixel (i,j), and boxSum() needs no special
+ * case at the edges. Pick \c Acc wide enough for the whole image: uint32_t
+ * holds the sum of up to 16.8 million uint8_t samples per channel.
+ *
+ * \param[out] out integral image, (rows+1) x (cols+1) with the channels of \c img
+ * \param[in] img input image
+ */
+template<class Acc, int C, class T, int C2>
+void integrate(ImageView<Acc, C> out, ImageView<T, C2> const& img) {
+   if( integralShapeOk(out, img) )
+      integralScan<IntegralSamples, IntegralNone>(out, out, img);
+}
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Create a squared integral image in a wider type
+ *
+ * Like integrate(out, img), but sums squared samples. Squares of uint8_t
+ * overflow uint32_t after about 66000 pixels, so use uint64_t or double.
+ *
+ * \param[out] out integral image, (rows+1) x (cols+1) with the channels of \c img
+ * \param[in] img input image
+ */
+template<class Acc, int C, class T, int C2>
+void integrateSquare(ImageView<Acc, C> out, ImageView<T, C2> const& img) {
+   if( integralShapeOk(out, img) )
+      integralScan<IntegralSquares, IntegralNone>(out, out, img);
+}
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Create the integral and squared integral images together
+ *
+ * Same results as integrate(out, img) and integrateSquare(outSquare, img),
+ * but \c img is read once for both.
+ *
+ * \param[out] out integral image, as for integrate(out, img)
+ * \param[out] outSquare squared integral image, as for integrateSquare(out, img)
+ * \param[in] img input image
+ */
+template<class Acc, int C, class AccSq, int C2, class T, int C3>
+void integrate(
+   ImageView<Acc, C> out,
+   ImageView<AccSq, C2> outSquare,
+   ImageView<T, C3> const& img
+) {
+   if( integralShapeOk(out, img) && integralShapeOk(outSquare, img) )
+      integralScan<IntegralSamples, IntegralSquares>(out, outSquare, img);
+}
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Sum over a rectangle, given the integral rows bounding it
+ *
+ * For loops sliding a window along a row, which can fetch the two rows once.
+ *
+ * \param above padded integral row \c r.top
+ * \param below padded integral row \c r.bottom+1
+ * \param left sample index of the rectangle's left edge, \c r.left*channels+k
+ * \param right sample index one past its right edge, \c (r.right+1)*channels+k
+ */
+template<class Acc>
+inline Acc boxSum(Acc const* above, Acc const* below, int left, int right) {
+   return (below[right] - below[left]) - (above[right] - above[left]);
+}
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Sum of one channel over a rectangle, in constant time
+ *
+ * \param integral padded integral image from integrate(out, img)
+ * \param r pixels of the original image to sum, inside it
+ * \param k channel
+ */
+template<class Acc, int C>
+inline Acc boxSum(ImageView<Acc, C> const& integral, Rect const& r, int k = 0) {
+   int const channels = integral.channels();
+   return boxSum(integral[r.top], integral[r.bottom + 1], r.left*channels + k, (r.right + 1)*channels + k);
+}
+
+/*!
+ * \ingroup ImageProcessing
+ * \brief Variance of one channel over a rectangle, in constant time
+ *
+ * \param integral padded integral image from integrate(out, img)
+ * \param integralSquare padded squared integral image from integrateSquare(out, img)
+ * \param r pixels of the original image, inside it
+ * \param k channel
+ * \returns the population variance, never negative
+ */
+template<class Acc, int C, class AccSq, int C2>
+inline double boxVariance(
+   ImageView<Acc, C> const& integral,
+   ImageView<AccSq, C2> const& integralSquare,
+   Rect const& r,
+   int k = 0
+) {
+   double const n = r.area();
+   double const mean = boxSum(integral, r, k) / n;
+   double const var = boxSum(integralSquare, r, k) / n - mean*mean;
+   return std::max(var, 0.0);
+}
+
+#endif /*INTEGRAL_H*/
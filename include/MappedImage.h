@@ -0,0 +1,81 @@
+/*
+ * MappedImage.h is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#ifndef MAPPEDIMAGE_H
+#define MAPPEDIMAGE_H
+
+#include <pgvl.h>
+#include <ImageView.h>
+#include <ppm.h>
+#include "config.h"
+#include <string>
+#include <string.h>
+
+/*!
+ * \brief A binary PGM or PPM file viewed in place
+ *
+ * The file is memory-mapped and the view points straight at its pixels, so
+ * nothing is copied or allocated. Rows are tightly packed, so unlike Image
+ * they are not aligned to \c CACHE_LINE_SIZE. Writes go to private
+ * copy-on-write pages and never reach the file.
+ *
+ * Copy into an Image if aligned rows are needed.
+ */
+class MappedImage : public ImageView<uint8_t> {
+public:
+
+   //! \brief Empty image
+   MappedImage() {
+      memset(&_map, 0, sizeof(_map));
+   }
+
+   /*!
+    * \brief Map a binary .pgm or .ppm file
+    *
+    * If the file cannot be mapped or has 16-bit samples, the result is empty.
+    */
+   MappedImage(std::string const& filename) {
+      if( pnmmap(filename.c_str(), &_map) != 0 ) {
+         LOGE("Cannot map " << filename);
+         return;
+      }
+      if( _map.sampleBytes != 1 ) {
+         LOGE(filename << " does not have 8-bit samples");
+         pnmunmap(&_map);
+         return;
+      }
+
+      _data = _map.data;
+      _rows = _map.h;
+      _cols = _map.w;
+      _channels = _map.channels;
+      _rowWidth = _map.w*_map.channels;
+   }
+
+   //! \brief Move constructor
+   MappedImage(MappedImage&& other) :
+      ImageView<uint8_t>(other),
+      _map(other._map)
+   {
+      memset(&other._map, 0, sizeof(other._map));
+      static_cast<ImageView<uint8_t>&>(other) = ImageView<uint8_t>();
+   }
+
+   ~MappedImage() {
+      pnmunmap(&_map);
+   }
+
+   //! \brief Maximum sample value from the file header
+   int maxval() const { return _map.maxval; }
+
+private:
+
+   MappedImage(MappedImage const&);
+   MappedImage& operator=(MappedImage const&);
+
+   PnmMap _map;
+};
+
+#endif /*MAPPEDIMAGE_H*/
@@ -0,0 +1,88 @@
+/*
+ * OpticalFlowStream.h is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#ifndef OPTICALFLOWSTREAM_H
+#define OPTICALFLOWSTREAM_H
+
+#include <Image.h>
+
+/*!
+ * \brief Horn-Schunck optical flow over a sequence of frames
+ *
+ * Calling hsOpticalFlow() on each consecutive pair of a video lowpass
+ * filters every frame twice, once as \c img1 and again as \c img0. A stream
+ * keeps the smoothed previous frame, so each pushed frame is filtered once
+ * and its gradient taken once. All buffers, including the lowpass kernels,
+ * live in the stream and are reused, and the filters take their scratch
+ * from the image pool, so once the frame shape settles a push makes no heap
+ * allocations with the default allocator.
+ *
+ * The flows are the same as hsOpticalFlow() gives for each pair.
+ *
+ * \code
+ * OpticalFlowStream stream;
+ * for( int t = 0; t < n; ++t ) {
+ *    if( stream.push(frame[t]) )
+ *       opticalFlowToRgb(rgb, stream.flow());
+ * }
+ * \endcode
+ */
+class OpticalFlowStream {
+public:
+
+   /*!
+    * \brief Start an empty stream
+    *
+    * \param radius window radius, see hsOpticalFlow()
+    */
+   OpticalFlowStream(int radius = 3);
+
+   /*!
+    * \brief Take the next frame
+    *
+    * A frame of a different shape from the last one restarts the stream.
+    *
+    * \param frame the new frame
+    * \returns true if flow() now holds the flow from the previous frame
+    *          to \c frame, or false for the first frame
+    */
+   bool push(ImageView<float> const& frame);
+
+   /*!
+    * \brief Flow from the second-to-last pushed frame to the last one
+    *
+    * Two channels [vx, vy]. Pixels within radius() of the edges are 0.
+    */
+   Image<float> const& flow() const { return _flow; }
+
+   //! \brief Window radius
+   int radius() const { return _radius; }
+
+   //! \brief Frames pushed since the stream started or was reset
+   int frames() const { return _frames; }
+
+   //! \brief Forget the previous frame, keeping the buffers
+   void reset() { _frames = 0; }
+
+private:
+   void reshape(ImageView<float> const& frame);
+   void solve();
+
+   int _radius;
+   int _frames;
+   // Smoothed previous and current frames
+   Image<float> _smoothed0;
+   Image<float> _smoothed1;
+   Image<float> _dx;
+   Image<float> _dy;
+   // [IxIx, IxIy, IyIy, IxIt, IyIt] and their integral
+   Image<float> _products;
+   Image<double> _sums;
+   Image<float> _flow;
+   Image<float> _kernelX;
+   Image<float> _kernelY;
+};
+
+#endif /*OPTICALFLOWSTREAM_H*/
@@ -0,0 +1,173 @@
+/*
+ * PlanarImage.h is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#ifndef PLANARIMAGE_H
+#define PLANARIMAGE_H
+
+#include <Image.h>
+
+/*!
+ * \brief An image stored one channel at a time
+ *
+ * Where Image interleaves channels (\c img[i][j*chans+k]), a PlanarImage keeps
+ * each channel in its own single-channel plane, so every row of a plane is a
+ * contiguous run of one channel. Each plane row is aligned to
+ * \c CACHE_LINE_SIZE, and all planes live in one allocation.
+ *
+ * \tparam T the type of an individual channel
+ */
+template<class T>
+class PlanarImage {
+public:
+
+   //! \brief Default constructor
+   PlanarImage(
+      int rows = 0,
+      int cols = 0,
+      int channels = 0,
+      ImageAllocator* allocator = 0
+   ) :
+      _planes(rows*channels, cols, 1, allocator),
+      _rows(rows),
+      _channels(channels)
+   {
+   }
+
+   //! \brief Number of rows in each plane
+   int rows() const { return _rows; }
+   //! \brief Number of columns in each plane
+   int cols() const { return _planes.cols(); }
+   //! \brief Number of planes
+   int channels() const { return _channels; }
+   //! \brief Number of bytes in a row of a plane
+   int rowWidth() const { return _planes.rowWidth(); }
+
+   /*!
+    * \brief Destructively resize the image
+    *
+    * \param nRows number of rows
+    * \param nCols number of columns
+    * \param nChans number of channels
+    */
+   void resize(int nRows, int nCols, int nChans) {
+      _planes.resize(nRows*nChans, nCols, 1);
+      _rows = nRows;
+      _channels = nChans;
+   }
+
+   //! \brief Single-channel view of the kth channel
+   ImageView<T, 1> plane(int k) {
+      return ImageView<T, 1>(_planes[k*_rows], _rows, _planes.cols(), 1, _planes.rowWidth());
+   }
+   //! \brief Single-channel view of the kth channel (const version)
+   ImageView<T, 1> const plane(int k) const {
+      return const_cast<PlanarImage<T>*>(this)->plane(k);
+   }
+
+private:
+
+   Image<T, 1> _planes;
+   int _rows;
+   int _channels;
+};
+
+//! \brief Row kernel for deinterleave() with a compile-time channel count
+template<int C, class T>
+void deinterleaveRows(PlanarImage<T>& out, ImageView<T> const& in, int chans) {
+   int const rows = in.rows();
+   int const cols = in.cols();
+   if( C != DYNAMIC_CHANNELS )
+      chans = C;
+
+#pragma omp parallel for shared(out, in)
+   for( int i = 0; i < rows; ++i ) {
+      T const* src = in[i];
+      for( int k = 0; k < chans; ++k ) {
+         T* dst = out.plane(k)[i];
+         for( int j = 0; j < cols; ++j )
+            dst[j] = src[j*chans + k];
+      }
+   }
+}
+
+//! \brief Row kernel for interleave() with a compile-time channel count
+template<int C, class T>
+void interleaveRows(ImageView<T> out, PlanarImage<T> const& in, int chans) {
+   int const rows = in.rows();
+   int const cols = in.cols();
+   if( C != DYNAMIC_CHANNELS )
+      chans = C;
+
+#pragma omp parallel for shared(out, in)
+   for( int i = 0; i < rows; ++i ) {
+      T* dst = out[i];
+      for( int k = 0; k < chans; ++k ) {
+         T const* src = in.plane(k)[i];
+         for( int j = 0; j < cols; ++j )
+            dst[j*chans + k] = src[j];
+      }
+   }
+}
+
+/*!
+ * \brief Split an interleaved image into planes
+ *
+ * \param[out] out planar image, resized to match \c in
+ * \param[in] in interleaved image
+ */
+template<class T, int C>
+void deinterleave(PlanarImage<T>& out, ImageView<T, C> const& in) {
+   ImageView<T> const& src = in;
+   out.resize(in.rows(), in.cols(), in.channels());
+
+   switch( in.channels() ) {
+   case 1: deinterleaveRows<1>(out, src, 1); break;
+   case 2: deinterleaveRows<2>(out, src, 2); break;
+   case 3: deinterleaveRows<3>(out, src, 3); break;
+   case 4: deinterleaveRows<4>(out, src, 4); break;
+   default: deinterleaveRows<DYNAMIC_CHANNELS>(out, src, in.channels()); break;
+   }
+}
+
+/*!
+ * \brief Merge planes into an interleaved image
+ *
+ * \param[out] out interleaved image, which must already have the shape of \c in
+ * \param[in] in planar image
+ */
+template<class T, int C>
+void interleave(ImageView<T, C> out, PlanarImage<T> const& in) {
+   ImageView<T> dst(out);
+
+   switch( in.channels() ) {
+   case 1: interleaveRows<1>(dst, in, 1); break;
+   case 2: interleaveRows<2>(dst, in, 2); break;
+   case 3: interleaveRows<3>(dst, in, 3); break;
+   case 4: interleaveRows<4>(dst, in, 4); break;
+   default: interleaveRows<DYNAMIC_CHANNELS>(dst, in, in.channels()); break;
+   }
+}
+
+/*!
+ * \ingroup Colorspaces
+ * \brief Convert from linear RGB to XYZ on planes
+ *
+ * Same as rgb2xyz(ImageView<float>), but each row is three contiguous plane
+ * rows, so the inner loop vectorizes across pixels.
+ *
+ * \param[in,out] img the image to convert
+ */
+void rgb2xyz(PlanarImage<float>& img);
+/*!
+ * \ingroup Colorspaces
+ * \brief Convert from XYZ to linear RGB on planes
+ *
+ * \sa rgb2xyz(PlanarImage<float>&)
+ *
+ * \param[in,out] img the image to convert
+ */
+void xyz2rgb(PlanarImage<float>& img);
+
+#endif /*PLANARIMAGE_H*/
@@ -39,4 +39,34 @@ public:
    }
 };
 
+/*!
+ * \brief 2D subpixel coordinate
+ */
+class Point2f {
+public:
+   //! \brief X (horizontal) coordinate
+   float x;
+   //! \brief Y (vertical) coordinate
+   float y;
+
+   //! \brief Default constructor
+   Point2f(float x = 0.f, float y = 0.f) :
+      x(x),
+      y(y)
+   {
+   }
+
+   //! \brief From integer coordinates
+   explicit Point2f(Point const& p) :
+      x(static_cast<float>(p.x)),
+      y(static_cast<float>(p.y))
+   {
+   }
+
+   //! \brief Equality operator
+   bool operator==(Point2f const& rhs) const {
+      return x == rhs.x && y == rhs.y;
+   }
+};
+
 #endif /*POINT_H*/
\ No newline at end of file
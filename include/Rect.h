@@ -0,0 +1,43 @@
+#ifndef RECT_H
+#define RECT_H
+
+/*!
+ * \brief Axis-aligned rectangle of pixels
+ *
+ * Bounds are inclusive and in the same order as ImageView::view(), so a
+ * Rect names exactly the pixels that view() would return.
+ */
+class Rect {
+public:
+   //! \brief Leftmost column
+   int left;
+   //! \brief Rightmost column
+   int right;
+   //! \brief Top row
+   int top;
+   //! \brief Bottom row
+   int bottom;
+
+   //! \brief Default constructor, an empty rectangle
+   Rect(int left = 0, int right = -1, int top = 0, int bottom = -1) :
+      left(left),
+      right(right),
+      top(top),
+      bottom(bottom)
+   {
+   }
+
+   //! \brief Number of columns
+   int width() const { return right - left + 1; }
+   //! \brief Number of rows
+   int height() const { return bottom - top + 1; }
+   //! \brief Number of pixels
+   int area() const { return width()*height(); }
+
+   //! \brief Equality operator
+   bool operator==(Rect const& rhs) const {
+      return left == rhs.left && right == rhs.right && top == rhs.top && bottom == rhs.bottom;
+   }
+};
+
+#endif /*RECT_H*/
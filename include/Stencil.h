@@ -0,0 +1,301 @@
+/*
+ * Stencil.h is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#ifndef STENCIL_H
+#define STENCIL_H
+
+#include <ImageView.h>
+#include <algorithm>
+#include <type_traits>
+
+/*!
+ * \defgroup Stencil Stencils
+ * \brief Small kernels with compile-time coefficients
+ *
+ * A stencil's size, taps and divisor are template arguments, so applying
+ * one compiles to straight-line code: the loops over taps are unrolled,
+ * taps of zero generate no instructions, taps of +-1 no multiplies, and the
+ * loop over pixels is free to vectorize. Use filter() when the kernel is
+ * only known at runtime.
+ */
+
+/*!
+ * \ingroup Stencil
+ * \brief Adds two partial sums, dropping either one known to be zero
+ *
+ * Skipping a zero operand, rather than adding 0, keeps the compiler from
+ * having to emit the addition for floating-point sums.
+ */
+template<bool ZeroA, bool ZeroB>
+struct StencilAdd {
+   template<class Acc>
+   static Acc add(Acc a, Acc b) { return a + b; }
+};
+
+template<bool ZeroB>
+struct StencilAdd<true, ZeroB> {
+   template<class Acc>
+   static Acc add(Acc, Acc b) { return b; }
+};
+
+template<>
+struct StencilAdd<false, true> {
+   template<class Acc>
+   static Acc add(Acc a, Acc) { return a; }
+};
+
+/*!
+ * \ingroup Stencil
+ * \brief One row of integer stencil taps, left to right
+ */
+template<int... K>
+struct StencilRow;
+
+template<>
+struct StencilRow<> {
+   static constexpr int size = 0;
+   static constexpr bool zero = true;
+
+   template<class Acc, class T>
+   static Acc sum(T const*, int) { return Acc(0); }
+};
+
+template<int K0, int... K>
+struct StencilRow<K0, K...> {
+   typedef StencilRow<K...> Rest;
+   static constexpr int size = 1 + Rest::size;
+   static constexpr bool zero = K0 == 0 && Rest::zero;
+
+   /*!
+    * \brief Weighted sum of \c size samples
+    *
+    * \param p first sample
+    * \param stride samples from one tap to the next
+    */
+   template<class Acc, class T>
+   static Acc sum(T const* p, int stride) {
+      return StencilAdd<K0 == 0, Rest::zero>::add(
+         Acc(K0) * Acc(p[0]),
+         Rest::template sum<Acc>(p + stride, stride)
+      );
+   }
+};
+
+//! \brief The rows of a Stencil, top to bottom
+template<class... Rows>
+struct StencilRows;
+
+template<>
+struct StencilRows<> {
+   static constexpr bool zero = true;
+
+   template<class Acc, class T, int C>
+   static Acc sum(ImageView<T, C> const&, int, int) { return Acc(0); }
+};
+
+template<class Row0, class... Rows>
+struct StencilRows<Row0, Rows...> {
+   typedef StencilRows<Rows...> Rest;
+   static constexpr bool zero = Row0::zero && Rest::zero;
+
+   template<class Acc, class T, int C>
+   static Acc sum(ImageView<T, C> const& img, int row, int s) {
+      return StencilAdd<Row0::zero, Rest::zero>::add(
+         Row0::template sum<Acc>(img[row] + s, img.channels()),
+         Rest::template sum<Acc>(img, row + 1, s)
+      );
+   }
+};
+
+/*!
+ * \ingroup Stencil
+ * \brief A 2D kernel of integer taps, all divided by \c Divisor
+ *
+ * The anchor is the center tap, as in filter(). Like filter(), this is
+ * correlation: the top-left tap weighs the top-left pixel.
+ *
+ * \tparam Divisor the taps are divided by this
+ * \tparam Row0 the first StencilRow; the others must be the same length
+ */
+template<int Divisor, class Row0, class... Rows>
+struct Stencil {
+   static constexpr int rows = 1 + sizeof...(Rows);
+   static constexpr int cols = Row0::size;
+   static constexpr int divisor = Divisor;
+   static constexpr int anchorRow = rows/2;
+   static constexpr int anchorCol = cols/2;
+
+   static_assert(Divisor != 0, "Stencil divisor must be nonzero");
+
+   /*!
+    * \brief Unscaled sum for one output sample
+    *
+    * \param img the input
+    * \param i output row
+    * \param s output sample index within the row, j*channels+k
+    */
+   template<class Acc, class T, int C>
+   static Acc sum(ImageView<T, C> const& img, int i, int s) {
+      return StencilRows<Row0, Rows...>::template sum<Acc>(
+         img, i - anchorRow, s - anchorCol*img.channels()
+      );
+   }
+};
+
+/*!
+ * \ingroup Stencil
+ * \brief Accumulator type and final scaling for stencils writing \c O
+ *
+ * Floating-point outputs sum in their own type. Integer outputs sum in int
+ * and divide with truncation, as the uint8_t filter() does.
+ */
+template<class O>
+struct StencilAccumulator {
+   typedef typename std::conditional<std::is_floating_point<O>::value, O, int>::type Type;
+
+   template<class S>
+   static O store(Type sum) { return static_cast<O>(S::divisor == 1 ? sum : sum / Type(S::divisor)); }
+};
+
+//! \brief Central difference along x, per pixel
+typedef Stencil<2, StencilRow<-1, 0, 1> > CentralDiffX;
+//! \brief Central difference along y, per pixel
+typedef Stencil<2, StencilRow<-1>, StencilRow<0>, StencilRow<1> > CentralDiffY;
+
+//! \brief Sobel x derivative, scaled to units per pixel
+typedef Stencil<8,
+   StencilRow<-1, 0, 1>,
+   StencilRow<-2, 0, 2>,
+   StencilRow<-1, 0, 1> > SobelX;
+//! \brief Sobel y derivative, scaled to units per pixel
+typedef Stencil<8,
+   StencilRow<-1, -2, -1>,
+   StencilRow< 0,  0,  0>,
+   StencilRow< 1,  2,  1> > SobelY;
+
+//! \brief Scharr x derivative, scaled to units per pixel
+typedef Stencil<32,
+   StencilRow< -3, 0,  3>,
+   StencilRow<-10, 0, 10>,
+   StencilRow< -3, 0,  3> > ScharrX;
+//! \brief Scharr y derivative, scaled to units per pixel
+typedef Stencil<32,
+   StencilRow<-3, -10, -3>,
+   StencilRow< 0,   0,  0>,
+   StencilRow< 3,  10,  3> > ScharrY;
+
+//! \brief 5-point Laplacian
+typedef Stencil<1,
+   StencilRow<0,  1, 0>,
+   StencilRow<1, -4, 1>,
+   StencilRow<0,  1, 0> > Laplacian;
+
+//! \brief 3x3 binomial blur, sigma about 0.7
+typedef Stencil<16,
+   StencilRow<1, 2, 1>,
+   StencilRow<2, 4, 2>,
+   StencilRow<1, 2, 1> > Binomial3;
+//! \brief 5x5 binomial blur, sigma 1
+typedef Stencil<256,
+   StencilRow<1,  4,  6,  4, 1>,
+   StencilRow<4, 16, 24, 16, 4>,
+   StencilRow<6, 24, 36, 24, 6>,
+   StencilRow<4, 16, 24, 16, 4>,
+   StencilRow<1,  4,  6,  4, 1> > Binomial5;
+
+/*!
+ * \ingroup Stencil
+ * \brief Apply stencil \c S to an image
+ *
+ * Only pixels where the whole stencil fits inside \c img are written, as in
+ * filter().
+ *
+ * \tparam S a Stencil
+ * \param[out] out output image, the shape of \c img
+ * \param[in] img input image
+ */
+template<class S, class O, class T, int C>
+void applyStencil(
+   ImageView<O, C> out,
+   ImageView<T, C> const& img
+) {
+   typedef StencilAccumulator<O> Acc;
+   int const chans = img.channels();
+   int const rowEnd = img.rows() - S::rows + 1 + S::anchorRow;
+   int const beg = S::anchorCol*chans;
+   int const end = (img.cols() - S::cols + 1 + S::anchorCol)*chans;
+
+   int i;
+#pragma omp parallel for shared(out,img) private(i)
+   for( i = S::anchorRow; i < rowEnd; ++i ) {
+      O* dst = out[i];
+      for( int s = beg; s < end; ++s )
+         dst[s] = Acc::template store<S>(S::template sum<typename Acc::Type>(img, i, s));
+   }
+}
+
+/*!
+ * \ingroup Stencil
+ * \brief Apply two stencils to an image in one pass
+ *
+ * Gives the same results as two calls to applyStencil(), but each input
+ * row is brought into cache once for both, and where both stencils fit the
+ * pixel loop computes both from the same loads.
+ *
+ * \tparam S1 the Stencil for \c out1
+ * \tparam S2 the Stencil for \c out2
+ */
+template<class S1, class S2, class O, class T, int C>
+void applyStencils(
+   ImageView<O, C> out1,
+   ImageView<O, C> out2,
+   ImageView<T, C> const& img
+) {
+   typedef StencilAccumulator<O> Acc;
+   typedef typename Acc::Type Sum;
+   int const chans = img.channels();
+   int const rows = img.rows();
+
+   // Valid rows and samples of each stencil, as in applyStencil()
+   int const rowBeg1 = S1::anchorRow, rowEnd1 = rows - S1::rows + 1 + S1::anchorRow;
+   int const rowBeg2 = S2::anchorRow, rowEnd2 = rows - S2::rows + 1 + S2::anchorRow;
+   int const beg1 = S1::anchorCol*chans, end1 = (img.cols() - S1::cols + 1 + S1::anchorCol)*chans;
+   int const beg2 = S2::anchorCol*chans, end2 = (img.cols() - S2::cols + 1 + S2::anchorCol)*chans;
+
+   int i;
+#pragma omp parallel for shared(out1,out2,img) private(i)
+   for( i = std::min(rowBeg1, rowBeg2); i < std::max(rowEnd1, rowEnd2); ++i ) {
+      bool const row1 = i >= rowBeg1 && i < rowEnd1;
+      bool const row2 = i >= rowBeg2 && i < rowEnd2;
+      O* dst1 = out1[i];
+      O* dst2 = out2[i];
+
+      int fusedBeg = 0, fusedEnd = 0;
+      if( row1 && row2 ) {
+         fusedBeg = std::max(beg1, beg2);
+         fusedEnd = std::max(fusedBeg, std::min(end1, end2));
+         for( int s = fusedBeg; s < fusedEnd; ++s ) {
+            dst1[s] = Acc::template store<S1>(S1::template sum<Sum>(img, i, s));
+            dst2[s] = Acc::template store<S2>(S2::template sum<Sum>(img, i, s));
+         }
+      }
+
+      // Whatever each stencil covers outside the fused span
+      if( row1 ) {
+         for( int s = beg1; s < std::min(end1, fusedBeg); ++s )
+            dst1[s] = Acc::template store<S1>(S1::template sum<Sum>(img, i, s));
+         for( int s = std::max(beg1, fusedEnd); s < end1; ++s )
+            dst1[s] = Acc::template store<S1>(S1::template sum<Sum>(img, i, s));
+      }
+      if( row2 ) {
+         for( int s = beg2; s < std::min(end2, fusedBeg); ++s )
+            dst2[s] = Acc::template store<S2>(S2::template sum<Sum>(img, i, s));
+         for( int s = std::max(beg2, fusedEnd); s < end2; ++s )
+            dst2[s] = Acc::template store<S2>(S2::template sum<Sum>(img, i, s));
+      }
+   }
+}
+
+#endif /*STENCIL_H*/
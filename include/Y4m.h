@@ -0,0 +1,212 @@
+/*
+ * Y4m.h is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#ifndef Y4M_H
+#define Y4M_H
+
+#include <Image.h>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+/*!
+ * \defgroup Y4m YUV4MPEG2 video
+ * \brief Streaming uncompressed video through one file or pipe
+ *
+ * A [Y4M](https://wiki.multimedia.cx/index.php/YUV4MPEG2) stream is a
+ * one-line header followed by frames, each a \c FRAME line and then the Y,
+ * U and V planes. Decoders such as ffmpeg write it to a pipe with
+ * \c "-f yuv4mpegpipe", so pgvl can process video without a file per frame.
+ */
+
+//! \ingroup Y4m
+//! \brief Chroma subsampling of a Y4M stream
+enum Y4mChroma {
+   //! \brief Luma only
+   Y4M_MONO,
+   //! \brief Chroma halved in both directions
+   Y4M_420,
+   //! \brief Chroma halved horizontally
+   Y4M_422,
+   //! \brief Full-resolution chroma
+   Y4M_444
+};
+
+/*!
+ * \ingroup Y4m
+ * \brief Reads frames one after another from a Y4M stream
+ *
+ * Each read decodes straight into the caller's Image, which is only
+ * reallocated if it is too small, so one buffer can be reused for the
+ * whole stream.
+ *
+ * \code
+ * Y4mReader video("-");
+ * Image<uint8_t> prev, cur;
+ * video.readGray(prev);
+ * while( video.readGray(cur) ) {
+ *    ...
+ *    std::swap(prev, cur);
+ * }
+ * \endcode
+ */
+class Y4mReader {
+public:
+
+   /*!
+    * \brief Open a stream and read its header
+    *
+    * \param filename the file to read, or "-" for stdin
+    */
+   Y4mReader(std::string const& filename);
+   /*!
+    * \brief Read from an already open stream
+    *
+    * The stream is not closed by the reader.
+    */
+   Y4mReader(FILE* file);
+   ~Y4mReader();
+
+   //! \brief True if the header was valid and no read has failed
+   bool good() const { return _file != 0; }
+   //! \brief Frame width
+   int width() const { return _width; }
+   //! \brief Frame height
+   int height() const { return _height; }
+   //! \brief Chroma subsampling
+   Y4mChroma chroma() const { return _chroma; }
+   //! \brief Frame rate numerator
+   int fpsNum() const { return _fpsNum; }
+   //! \brief Frame rate denominator
+   int fpsDen() const { return _fpsDen; }
+
+   /*!
+    * \brief Read the next frame's luma only
+    *
+    * The chroma planes are skipped without being decoded, so this is the
+    * fast path for grayscale algorithms.
+    *
+    * \param[out] y single-channel image, resized to the frame
+    * \returns false at the end of the stream or on error
+    */
+   bool readGray(Image<uint8_t>& y);
+   /*!
+    * \brief Read the next frame as 3-channel YUV
+    *
+    * Subsampled chroma is replicated up to full resolution.
+    *
+    * \param[out] yuv 3-channel image, resized to the frame
+    * \returns false at the end of the stream or on error
+    */
+   bool readYuv(Image<uint8_t>& yuv);
+   /*!
+    * \brief Read the next frame as 3-channel RGB
+    *
+    * Converts with BT.601, using the full range when the header says
+    * \c XCOLORRANGE=FULL and the limited (16-235) range otherwise.
+    *
+    * \param[out] rgb 3-channel image, resized to the frame
+    * \returns false at the end of the stream or on error
+    */
+   bool readRgb(Image<uint8_t>& rgb);
+
+private:
+
+   Y4mReader(Y4mReader const&);
+   Y4mReader& operator=(Y4mReader const&);
+
+   void open();
+   bool readHeader();
+   // Read the FRAME line and the luma plane into y
+   bool readLuma(Image<uint8_t>& y);
+   // Read both chroma planes into _u and _v
+   bool readChroma();
+   void fail(char const* msg);
+
+   FILE* _file;
+   bool _ownsFile;
+   bool _seekable;
+   int _width;
+   int _height;
+   int _chromaWidth;
+   int _chromaHeight;
+   Y4mChroma _chroma;
+   int _fpsNum;
+   int _fpsDen;
+   bool _fullRange;
+   Image<uint8_t> _luma;
+   std::vector<uint8_t> _u;
+   std::vector<uint8_t> _v;
+};
+
+/*!
+ * \ingroup Y4m
+ * \brief Writes frames one after another to a Y4M stream
+ */
+class Y4mWriter {
+public:
+
+   /*!
+    * \brief Open a stream and write its header
+    *
+    * \param filename the file to write, or "-" for stdout
+    * \param width frame width
+    * \param height frame height
+    * \param chroma chroma subsampling to write
+    * \param fpsNum frame rate numerator
+    * \param fpsDen frame rate denominator
+    */
+   Y4mWriter(
+      std::string const& filename,
+      int width, int height,
+      Y4mChroma chroma = Y4M_420,
+      int fpsNum = 30, int fpsDen = 1
+   );
+   ~Y4mWriter();
+
+   //! \brief True if the stream is open and no write has failed
+   bool good() const { return _file != 0; }
+
+   /*!
+    * \brief Write a grayscale frame
+    *
+    * Unless the stream is \c Y4M_MONO, the chroma planes are neutral gray.
+    */
+   bool writeGray(ImageView<uint8_t> const& y);
+   /*!
+    * \brief Write a 3-channel YUV frame
+    *
+    * Chroma is averaged down to the stream's subsampling.
+    */
+   bool writeYuv(ImageView<uint8_t> const& yuv);
+   /*!
+    * \brief Write a 3-channel RGB frame
+    *
+    * Converts with limited-range BT.601, the Y4M default.
+    */
+   bool writeRgb(ImageView<uint8_t> const& rgb);
+
+private:
+
+   Y4mWriter(Y4mWriter const&);
+   Y4mWriter& operator=(Y4mWriter const&);
+
+   bool checkShape(ImageView<uint8_t> const& img, int channels);
+   // Write FRAME and the planes from a 3-channel YUV image
+   bool writeFrame(ImageView<uint8_t> const& yuv);
+   bool writeBytes(void const* data, size_t n);
+
+   FILE* _file;
+   bool _ownsFile;
+   int _width;
+   int _height;
+   int _chromaWidth;
+   int _chromaHeight;
+   Y4mChroma _chroma;
+   Image<uint8_t> _yuv;
+   std::vector<uint8_t> _row;
+};
+
+#endif /*Y4M_H*/
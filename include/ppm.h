@@ -4,6 +4,8 @@
 #ifndef PGVLPPM_H
 #define PGVLPPM_H
 
+#include <stddef.h>
+
 /*!
  * \brief Reads a binary or ascii PGM (grayscale image) file.
  * 
@@ -45,6 +47,23 @@ unsigned char* ppmread(const char* filename, int* w, int* h, int* maxval);
  */
 float* ppmread_float(const char* filename, int* w, int* h );
 
+/*!
+ * \brief Reads an ascii (P2 or P3) PGM or PPM file of any depth.
+ *
+ * Unlike pgmread() and ppmread(), samples up to a maxval of 65535 are kept.
+ * They come back packed like the raster of a binary file: one byte each
+ * when \c maxval is at most 255, otherwise two big-endian bytes.
+ *
+ * \param filename The file to read
+ * \param w Output width
+ * \param h Output height
+ * \param channels Output channel count, 1 for a PGM or 3 for a PPM
+ * \param maxval Output maximum value from the header
+ * \returns the samples in row-major order, which the caller must delete[],
+ *          or NULL if the file is not a valid ascii PGM or PPM.
+ */
+unsigned char* pnmreadAscii(const char* filename, int* w, int* h, int* channels, int* maxval);
+
 /*!
  * \brief Write a PGM image.
  * 
@@ -89,20 +108,75 @@ int pgmwrite_float(
 /*!
  * \brief Write a PPM image.
  *
- * Writes binary format "P6".
- *
  * \param filename The file to write to.
  * \param w image width
  * \param h image height
  * \param pitch number of bytes in one row of data
  * \param data row-major image data
  * \param comment_string comments (NULL if none)
+ * \param binsave true for binary ("P6") writing, false for text ("P3") writing
  */
 int ppmwrite(
    const char* filename,
    int w, int h, int pitch,
    unsigned char const* data,
-   const char* comment_string = 0
+   const char* comment_string = 0,
+   bool binsave = true
 );
 
+/*!
+ * \brief Identify a PGM or PPM file from its magic number
+ *
+ * Only the first two bytes are read, so this is much cheaper than
+ * parsing the header or matching the filename.
+ *
+ * \param filename The file to check
+ * \returns 1 for a PGM, 3 for a PPM (ASCII or binary), or 0 if the file is
+ *          neither or cannot be read
+ */
+int pnmchannels(const char* filename);
+
+/*!
+ * \brief A binary PGM or PPM file mapped into memory
+ *
+ * \sa pnmmap()
+ */
+struct PnmMap {
+   //! \brief Start of the mapping
+   void* base;
+   //! \brief Length of the mapping in bytes
+   size_t length;
+   //! \brief First byte of pixel data, in packed row-major order
+   unsigned char* data;
+   //! \brief Image width
+   int w;
+   //! \brief Image height
+   int h;
+   //! \brief 1 for PGM, 3 for PPM
+   int channels;
+   //! \brief Maximum sample value from the header
+   int maxval;
+   //! \brief 1, or 2 for big-endian samples when \c maxval is above 255
+   int sampleBytes;
+};
+
+/*!
+ * \brief Map a binary (P5 or P6) PGM or PPM file into memory
+ *
+ * Only the header is parsed; the pixels are read straight from the page
+ * cache as they are touched. The mapping is private and copy-on-write, so
+ * writing to \c map->data never changes the file.
+ *
+ * \param filename The file to map
+ * \param map Output mapping. Release it with pnmunmap().
+ * \returns 0 on success, or -1 if the file cannot be mapped or is not a
+ *          binary PGM/PPM
+ */
+int pnmmap(const char* filename, PnmMap* map);
+
+/*!
+ * \brief Release a mapping made by pnmmap()
+ */
+void pnmunmap(PnmMap* map);
+
 #endif /*PGVLPPM_H*/
\ No newline at end of file
@@ -0,0 +1,130 @@
+/*
+ * AsyncImageSaver.cpp is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#include <AsyncImageSaver.h>
+#include <utility>
+
+AsyncImageSaver::AsyncImageSaver(size_t maxQueuedBytes) :
+   _maxQueuedBytes(maxQueuedBytes),
+   _queuedBytes(0),
+   _writing(0),
+   _imagesWritten(0),
+   _stop(false)
+{
+   _thread = std::thread(&AsyncImageSaver::run, this);
+}
+
+AsyncImageSaver::~AsyncImageSaver() {
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      _stop = true;
+   }
+   _work.notify_all();
+   _thread.join();
+}
+
+void AsyncImageSaver::save(Image<uint8_t>&& img, std::string const& basename) {
+   size_t const bytes = bytesOf(img);
+   enqueue(std::make_shared< Image<uint8_t> >(std::move(img)), basename, bytes, true);
+}
+
+void AsyncImageSaver::save(ImagePtr const& img, std::string const& basename) {
+   enqueue(img, basename, bytesOf(*img), true);
+}
+
+bool AsyncImageSaver::trySave(Image<uint8_t>&& img, std::string const& basename) {
+   size_t const bytes = bytesOf(img);
+
+   // Only give up the image once there is room for it
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if( _queuedBytes > 0 && _queuedBytes + bytes > _maxQueuedBytes )
+         return false;
+   }
+
+   // Another producer may take the room in the meantime, in which case the
+   // image is handed back.
+   ImagePtr ptr = std::make_shared< Image<uint8_t> >(std::move(img));
+   if( enqueue(ptr, basename, bytes, false) )
+      return true;
+
+   img = std::move(*std::const_pointer_cast< Image<uint8_t> >(ptr));
+   return false;
+}
+
+void AsyncImageSaver::flush() {
+   std::unique_lock<std::mutex> lock(_mutex);
+   _room.wait(lock, [this]{ return _queue.empty() && _writing == 0; });
+}
+
+size_t AsyncImageSaver::queuedBytes() const {
+   std::lock_guard<std::mutex> lock(_mutex);
+   return _queuedBytes;
+}
+
+size_t AsyncImageSaver::imagesWritten() const {
+   std::lock_guard<std::mutex> lock(_mutex);
+   return _imagesWritten;
+}
+
+size_t AsyncImageSaver::bytesOf(Image<uint8_t> const& img) {
+   return static_cast<size_t>(img.rowWidth())*img.rows();
+}
+
+bool AsyncImageSaver::enqueue(ImagePtr const& img, std::string const& basename, size_t bytes, bool wait) {
+   std::unique_lock<std::mutex> lock(_mutex);
+
+   // An empty queue always has room, so oversized images cannot deadlock
+   auto hasRoom = [this, bytes]{ return _queuedBytes == 0 || _queuedBytes + bytes <= _maxQueuedBytes; };
+   if( wait )
+      _room.wait(lock, hasRoom);
+   else if( !hasRoom() )
+      return false;
+
+   Job job;
+   job.image = img;
+   job.basename = basename;
+   job.bytes = bytes;
+   _queue.push_back(std::move(job));
+   _queuedBytes += bytes;
+
+   lock.unlock();
+   _work.notify_one();
+   return true;
+}
+
+void AsyncImageSaver::run() {
+   std::deque<Job> batch;
+
+   for(;;) {
+      {
+         std::unique_lock<std::mutex> lock(_mutex);
+         _work.wait(lock, [this]{ return _stop || !_queue.empty(); });
+         if( _queue.empty() )
+            return;
+
+         // Take everything queued so far in one go
+         batch.swap(_queue);
+         _writing = batch.size();
+      }
+
+      while( !batch.empty() ) {
+         Job& job = batch.front();
+         job.image->save(job.basename);
+
+         size_t const bytes = job.bytes;
+         // Drop the reference before announcing the room
+         batch.pop_front();
+
+         {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _queuedBytes -= bytes;
+            --_writing;
+            ++_imagesWritten;
+         }
+         _room.notify_all();
+      }
+   }
+}
@@ -0,0 +1,179 @@
+/*
+ * FilterFft.cpp is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#include <ImageProcessing.h>
+#include <unsupported/Eigen/FFT>
+#include <complex>
+
+typedef std::complex<float> Complex;
+
+static int nextPow2(int n) {
+   int p = 1;
+   while( p < n )
+      p <<= 1;
+   return p;
+}
+
+/*
+ * Tile edge for a kernel of size k along an image edge of length len. At
+ * four times the kernel, three quarters of every tile is useful output.
+ */
+static int fftTileSize(int k, int len) {
+   int const n = std::min(std::max(nextPow2(4*k), 64), nextPow2(len));
+   return std::max(n, nextPow2(k));
+}
+
+/*
+ * The FFT object keeps twiddles and plans for every size it has seen, so
+ * each thread holds on to one and later calls with the same tile size do
+ * not plan again.
+ */
+static Eigen::FFT<float>& threadFft() {
+   static thread_local Eigen::FFT<float> fft(Eigen::FFT<float>::impl_type(), Eigen::FFT<float>::HalfSpectrum);
+   return fft;
+}
+
+/*
+ * 2D FFTs of real rows x cols tiles. Spectra keep cols/2+1 columns, the
+ * rest being conjugates.
+ */
+class FftTile {
+public:
+   FftTile(int rows, int cols) :
+      _rows(rows),
+      _cols(cols),
+      _half(cols/2 + 1),
+      _column(rows),
+      _columnOut(rows)
+   {}
+
+   int spectrumSize() const { return _rows*_half; }
+
+   //! Spectrum of a row-major rows x cols tile
+   void forward(Complex* spec, float const* tile) {
+      Eigen::FFT<float>& fft = threadFft();
+      for( int r = 0; r < _rows; ++r )
+         fft.fwd(spec + r*_half, tile + r*_cols, _cols);
+      for( int c = 0; c < _half; ++c ) {
+         for( int r = 0; r < _rows; ++r )
+            _column[r] = spec[r*_half + c];
+         fft.fwd(&_columnOut[0], &_column[0], _rows);
+         for( int r = 0; r < _rows; ++r )
+            spec[r*_half + c] = _columnOut[r];
+      }
+   }
+
+   //! Tile from its spectrum, which is overwritten
+   void inverse(float* tile, Complex* spec) {
+      Eigen::FFT<float>& fft = threadFft();
+      for( int c = 0; c < _half; ++c ) {
+         for( int r = 0; r < _rows; ++r )
+            _column[r] = spec[r*_half + c];
+         fft.inv(&_columnOut[0], &_column[0], _rows);
+         for( int r = 0; r < _rows; ++r )
+            spec[r*_half + c] = _columnOut[r];
+      }
+      for( int r = 0; r < _rows; ++r )
+         fft.inv(tile + r*_cols, spec + r*_half, _cols);
+   }
+
+private:
+   int _rows;
+   int _cols;
+   int _half;
+   std::vector<Complex> _column;
+   std::vector<Complex> _columnOut;
+};
+
+void filterFft(
+   ImageView<float> out,
+   ImageView<float> const& img,
+   ImageView<float> const& kernel,
+   Point const& anchor,
+   float delta
+) {
+   int const krows = kernel.rows();
+   int const kcols = kernel.cols();
+   int const kchans = kernel.channels();
+   int const rows = out.rows();
+   int const cols = out.cols();
+   int const channels = out.channels();
+
+   if( kchans != 1 && kchans != channels ) {
+      LOGE("Kernel has " << kchans << " channels, image has " << channels);
+      return;
+   }
+
+   int const anchorRow = (anchor==Point(-1,-1)) ? krows/2 : anchor.y;
+   int const anchorCol = (anchor==Point(-1,-1)) ? kcols/2 : anchor.x;
+
+   // Same valid region as filter(): pixels whose whole kernel is inside img
+   int const validRows = rows - krows + 1;
+   int const validCols = cols - kcols + 1;
+   if( krows <= 0 || kcols <= 0 || validRows <= 0 || validCols <= 0 )
+      return;
+
+   // Overlap-save: a tile at (r0,c0) yields the outputs whose kernels start
+   // at img[r0..r0+stepRows)[c0..c0+stepCols), free of wrap-around
+   int const tileRows = fftTileSize(krows, rows);
+   int const tileCols = fftTileSize(kcols, cols);
+   int const stepRows = tileRows - krows + 1;
+   int const stepCols = tileCols - kcols + 1;
+   int const rowTiles = (validRows + stepRows - 1) / stepRows;
+   int const colTiles = (validCols + stepCols - 1) / stepCols;
+
+   // Conjugated kernel spectra turn the product into a correlation
+   int const spectra = kchans;
+   FftTile kernelFft(tileRows, tileCols);
+   std::vector<float> padded(tileRows*tileCols);
+   std::vector<Complex> kernelSpec(spectra * kernelFft.spectrumSize());
+   for( int k = 0; k < spectra; ++k ) {
+      std::fill(padded.begin(), padded.end(), 0.f);
+      for( int m = 0; m < krows; ++m )
+         for( int n = 0; n < kcols; ++n )
+            padded[m*tileCols + n] = kernel[m][n*kchans + k];
+
+      Complex* spec = &kernelSpec[k * kernelFft.spectrumSize()];
+      kernelFft.forward(spec, &padded[0]);
+      for( int s = 0; s < kernelFft.spectrumSize(); ++s )
+         spec[s] = std::conj(spec[s]);
+   }
+
+   int t;
+#pragma omp parallel for shared(out,img,kernelSpec) private(t)
+   for( t = 0; t < rowTiles*colTiles; ++t ) {
+      int const r0 = (t / colTiles)*stepRows;
+      int const c0 = (t % colTiles)*stepCols;
+      int const inRows = std::min(tileRows, rows - r0);
+      int const inCols = std::min(tileCols, cols - c0);
+      int const outRows = std::min(stepRows, validRows - r0);
+      int const outCols = std::min(stepCols, validCols - c0);
+
+      FftTile fft(tileRows, tileCols);
+      std::vector<float> tile(tileRows*tileCols);
+      std::vector<Complex> spec(fft.spectrumSize());
+
+      for( int k = 0; k < channels; ++k ) {
+         std::fill(tile.begin(), tile.end(), 0.f);
+         for( int p = 0; p < inRows; ++p ) {
+            float const* src = img[r0 + p] + c0*channels + k;
+            for( int q = 0; q < inCols; ++q )
+               tile[p*tileCols + q] = src[q*channels];
+         }
+
+         fft.forward(&spec[0], &tile[0]);
+         Complex const* kspec = &kernelSpec[(kchans == 1 ? 0 : k) * fft.spectrumSize()];
+         for( int s = 0; s < fft.spectrumSize(); ++s )
+            spec[s] *= kspec[s];
+         fft.inverse(&tile[0], &spec[0]);
+
+         for( int p = 0; p < outRows; ++p ) {
+            float* dst = out[r0 + p + anchorRow] + (c0 + anchorCol)*channels + k;
+            for( int q = 0; q < outCols; ++q )
+               dst[q*channels] = tile[p*tileCols + q] + delta;
+         }
+      }
+   }
+}
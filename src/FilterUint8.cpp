@@ -0,0 +1,175 @@
+/*
+ * FilterUint8.cpp is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#include <ImageProcessing.h>
+#include "FilterUint8.h"
+#include <atomic>
+#include <climits>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define PGVL_X86 1
+#endif
+
+int filterUint8RowScalar(FilterUint8Job const& job, int i, int beg, int end) {
+   int const ch = job.channels;
+   int const colOffset = job.anchorCol*ch;
+   uint8_t* dst = job.out[i];
+
+   for( int s = beg; s < end; ++s ) {
+      int const k = s % ch;
+      int sum = job.delta;
+      for( int m = 0; m < job.krows; ++m ) {
+         uint8_t const* src = job.img[i + m - job.anchorRow] + s - colOffset;
+         uint16_t const* coef = &job.coef[m*job.kcols*ch + k];
+         for( int n = 0; n < job.kcols; ++n )
+            sum += coef[n*ch] * src[n*ch];
+      }
+      dst[s] = (job.shift < 0) ? sum / 255 : sum >> job.shift;
+   }
+
+   return end;
+}
+
+static SimdLevel detectSimdLevel() {
+#ifdef PGVL_X86
+   __builtin_cpu_init();
+   if( __builtin_cpu_supports("avx2") )
+      return SIMD_AVX2;
+   if( __builtin_cpu_supports("sse4.1") )
+      return SIMD_SSE41;
+   if( __builtin_cpu_supports("sse2") )
+      return SIMD_SSE2;
+#endif
+   return SIMD_NONE;
+}
+
+static SimdLevel const supportedSimd = detectSimdLevel();
+// Filters on other threads read this while it may be set
+static std::atomic<int> currentSimd(supportedSimd);
+
+SimdLevel simdLevel() {
+   return static_cast<SimdLevel>(currentSimd.load());
+}
+
+SimdLevel setSimdLevel(SimdLevel level) {
+   SimdLevel const used = std::min(level, supportedSimd);
+   currentSimd.store(used);
+   return used;
+}
+
+static FilterUint8Row rowKernel(SimdLevel level) {
+#ifdef PGVL_X86
+   switch( level ) {
+      case SIMD_AVX2:
+         return filterUint8RowAvx2;
+      case SIMD_SSE41:
+         return filterUint8RowSse41;
+      case SIMD_SSE2:
+         return filterUint8RowSse2;
+      default:
+         break;
+   }
+#endif
+   return 0;
+}
+
+void filterUint8(
+   ImageView<uint8_t> out,
+   ImageView<uint8_t> const& img,
+   ImageView<uint8_t> const& kernel,
+   Point const& anchor,
+   int delta,
+   int shift
+) {
+   if( shift > 30 ) {
+      LOGE("Cannot shift sums right by " << shift << " bits");
+      return;
+   }
+
+   if( kernel.rows() <= 0 || kernel.cols() <= 0 || out.channels() <= 0 )
+      return;
+
+   int const kchans = kernel.channels();
+   if( kchans != 1 && kchans != out.channels() ) {
+      LOGE("Kernel has " << kchans << " channels, image has " << out.channels());
+      return;
+   }
+
+   FilterUint8Job job;
+   job.out = out;
+   job.img = img;
+   job.krows = kernel.rows();
+   job.kcols = kernel.cols();
+   job.channels = out.channels();
+   job.anchorRow = (anchor==Point(-1,-1)) ? job.krows/2 : anchor.y;
+   job.anchorCol = (anchor==Point(-1,-1)) ? job.kcols/2 : anchor.x;
+   job.delta = delta;
+   job.shift = shift;
+
+   int const ch = job.channels;
+   int const taps = job.krows*job.kcols;
+
+   job.coef.resize(static_cast<size_t>(taps)*ch);
+   std::vector<long> channelSum(ch, 0);
+   for( int m = 0; m < job.krows; ++m ) {
+      for( int n = 0; n < job.kcols; ++n ) {
+         for( int k = 0; k < ch; ++k ) {
+            uint8_t const c = kernel[m][n*kchans + (kchans == 1 ? 0 : k)];
+            job.coef[(m*job.kcols + n)*ch + k] = c;
+            channelSum[k] += c;
+         }
+      }
+   }
+
+   // The largest sum any output sample can reach
+   long const maxSum = 255L * *std::max_element(channelSum.begin(), channelSum.end()) + delta;
+   job.wide = maxSum > 65535;
+
+   // The vector kernels divide unsigned sums, so negative ones stay scalar.
+   // The level is read once, so every row of this call uses the same kernel.
+   FilterUint8Row vectorRow = 0;
+   if( delta >= 0 && maxSum <= INT_MAX )
+      vectorRow = rowKernel(simdLevel());
+
+   if( vectorRow ) {
+      job.pattern.resize(static_cast<size_t>(taps)*ch*FILTER_UINT8_LANES);
+      for( int t = 0; t < taps; ++t ) {
+         for( int p = 0; p < ch; ++p ) {
+            uint16_t* lanes = &job.pattern[(static_cast<size_t>(t)*ch + p)*FILTER_UINT8_LANES];
+            for( int l = 0; l < FILTER_UINT8_LANES; ++l )
+               lanes[l] = job.coef[t*ch + (p + l) % ch];
+         }
+      }
+   }
+
+   // Output samples where the whole kernel fits inside img, as in filter()
+   int const rowBeg = job.anchorRow;
+   int const rowEnd = out.rows() + job.anchorRow - job.krows + 1;
+   int const beg = job.anchorCol*ch;
+   int const end = (out.cols() + job.anchorCol - job.kcols + 1)*ch;
+   if( rowEnd <= rowBeg || end <= beg )
+      return;
+
+   // Whole vectors per block, so only the last block has a scalar tail
+   FilterBlock const block = filterBlock(job.krows, job.kcols, ch, 1, FILTER_UINT8_LANES);
+   int const rowBlocks = (rowEnd - rowBeg + block.rows - 1) / block.rows;
+   int const colBlocks = (end - beg + block.cols - 1) / block.cols;
+
+   int b;
+#pragma omp parallel for shared(job) private(b)
+   for( b = 0; b < rowBlocks*colBlocks; ++b ) {
+      int const i0 = rowBeg + (b / colBlocks)*block.rows;
+      int const i1 = std::min(i0 + block.rows, rowEnd);
+      int const s0 = beg + (b % colBlocks)*block.cols;
+      int const s1 = std::min(s0 + block.cols, end);
+
+      for( int i = i0; i < i1; ++i ) {
+         int s = s0;
+         if( vectorRow )
+            s = vectorRow(job, i, s0, s1);
+         filterUint8RowScalar(job, i, s, s1);
+      }
+   }
+}
@@ -0,0 +1,51 @@
+/*
+ * FilterUint8.h is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#ifndef FILTERUINT8_H
+#define FILTERUINT8_H
+
+#include <ImageView.h>
+#include <vector>
+
+/*
+ * Internal to the uint8_t filters: everything a row kernel needs, prepared
+ * once per call by filterUint8().
+ */
+struct FilterUint8Job {
+   // Rows write through the shared job
+   mutable ImageView<uint8_t> out;
+   ImageView<uint8_t const> img;
+   int anchorRow;
+   int anchorCol;
+   int krows;
+   int kcols;
+   int channels;
+   int delta;
+   // Right shift for filterShift(), or -1 to divide by 255
+   int shift;
+   // Sums need 32 bits rather than 16
+   bool wide;
+   // Coefficient of tap t = m*kcols+n for channel k at coef[t*channels+k]
+   std::vector<uint16_t> coef;
+   // Coefficients laid out for FILTER_UINT8_LANES consecutive samples
+   // starting at channel p, at pattern[(t*channels+p)*FILTER_UINT8_LANES]
+   std::vector<uint16_t> pattern;
+};
+
+//! Samples per pattern entry; the widest vector kernel processes this many
+#define FILTER_UINT8_LANES 32
+
+/*
+ * A row kernel filters output samples [beg, end) of row i, and returns the
+ * first sample it did not get to. The scalar kernel always finishes.
+ */
+typedef int (*FilterUint8Row)(FilterUint8Job const& job, int i, int beg, int end);
+
+int filterUint8RowScalar(FilterUint8Job const& job, int i, int beg, int end);
+int filterUint8RowSse2(FilterUint8Job const& job, int i, int beg, int end);
+int filterUint8RowSse41(FilterUint8Job const& job, int i, int beg, int end);
+int filterUint8RowAvx2(FilterUint8Job const& job, int i, int beg, int end);
+
+#endif /*FILTERUINT8_H*/
@@ -0,0 +1,209 @@
+/*
+ * FilterUint8Kernel.h is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+/*
+ * Vector row kernel for the uint8_t filters. Each FilterUint8*.cpp defines
+ * FILTER_UINT8_ROW and includes this file once; the instruction set comes
+ * from the flags that file is compiled with (see src/CMakeLists.txt), so the
+ * same source becomes the SSE2, SSE4.1 and AVX2 kernels.
+ *
+ * Every kernel computes exactly what filterUint8RowScalar() does:
+ * - pixels and coefficients are at most 255, so each product fits in 16 bits
+ * - sums stay in 16-bit lanes when job.wide is false, else 32-bit lanes
+ * - x/255 is (x*0x8081)>>23 for 16-bit x and (x*0x80808081)>>39 for 32-bit
+ *   x, both exact
+ * - the low byte of the quotient is stored, as the scalar conversion does
+ */
+
+#include "FilterUint8.h"
+#include <immintrin.h>
+
+#ifndef FILTER_UINT8_ROW
+#error "Define FILTER_UINT8_ROW before including FilterUint8Kernel.h"
+#endif
+
+#if defined(__AVX2__)
+
+typedef __m256i Vec;
+#define VEC_BYTES 32
+#define VEC_LANES16 16
+
+static inline Vec loadBytes(uint8_t const* p) { return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p)); }
+static inline Vec loadCoef(uint16_t const* p) { return _mm256_loadu_si256(reinterpret_cast<__m256i const*>(p)); }
+static inline Vec set16(int x) { return _mm256_set1_epi16(static_cast<short>(x)); }
+static inline Vec set32(int x) { return _mm256_set1_epi32(x); }
+static inline Vec add16(Vec a, Vec b) { return _mm256_add_epi16(a, b); }
+static inline Vec add32(Vec a, Vec b) { return _mm256_add_epi32(a, b); }
+static inline Vec mul16(Vec a, Vec b) { return _mm256_mullo_epi16(a, b); }
+static inline Vec shr16(Vec a, __m128i n) { return _mm256_srl_epi16(a, n); }
+static inline Vec shr32(Vec a, __m128i n) { return _mm256_srl_epi32(a, n); }
+
+static inline void widen8(Vec x, Vec* lo, Vec* hi) {
+   *lo = _mm256_cvtepu8_epi16(_mm256_castsi256_si128(x));
+   *hi = _mm256_cvtepu8_epi16(_mm256_extracti128_si256(x, 1));
+}
+static inline void widen16(Vec x, Vec* lo, Vec* hi) {
+   *lo = _mm256_cvtepu16_epi32(_mm256_castsi256_si128(x));
+   *hi = _mm256_cvtepu16_epi32(_mm256_extracti128_si256(x, 1));
+}
+static inline Vec div255x16(Vec x) {
+   return _mm256_srli_epi16(_mm256_mulhi_epu16(x, set16(0x8081)), 7);
+}
+static inline Vec div255x32(Vec x) {
+   Vec const m = set32(static_cast<int>(0x80808081));
+   Vec const even = _mm256_srli_epi64(_mm256_mul_epu32(x, m), 39);
+   Vec const odd = _mm256_srli_epi64(_mm256_mul_epu32(_mm256_srli_epi64(x, 32), m), 39);
+   return _mm256_or_si256(even, _mm256_slli_epi64(odd, 32));
+}
+// Low byte of each 16-bit lane of a, then b. The packs work within 128-bit
+// halves, so the permute puts the halves back in order.
+static inline Vec pack16(Vec a, Vec b) {
+   Vec const mask = set16(0xFF);
+   Vec const packed = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+   return _mm256_permute4x64_epi64(packed, 0xD8);
+}
+// Low byte of each 32-bit lane, as 16-bit lanes
+static inline Vec pack32(Vec a, Vec b) {
+   Vec const mask = set32(0xFF);
+   Vec const packed = _mm256_packus_epi32(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+   return _mm256_permute4x64_epi64(packed, 0xD8);
+}
+static inline void storeBytes(uint8_t* p, Vec x) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), x); }
+
+#else
+
+typedef __m128i Vec;
+#define VEC_BYTES 16
+#define VEC_LANES16 8
+
+static inline Vec loadBytes(uint8_t const* p) { return _mm_loadu_si128(reinterpret_cast<__m128i const*>(p)); }
+static inline Vec loadCoef(uint16_t const* p) { return _mm_loadu_si128(reinterpret_cast<__m128i const*>(p)); }
+static inline Vec set16(int x) { return _mm_set1_epi16(static_cast<short>(x)); }
+static inline Vec set32(int x) { return _mm_set1_epi32(x); }
+static inline Vec add16(Vec a, Vec b) { return _mm_add_epi16(a, b); }
+static inline Vec add32(Vec a, Vec b) { return _mm_add_epi32(a, b); }
+static inline Vec mul16(Vec a, Vec b) { return _mm_mullo_epi16(a, b); }
+static inline Vec shr16(Vec a, __m128i n) { return _mm_srl_epi16(a, n); }
+static inline Vec shr32(Vec a, __m128i n) { return _mm_srl_epi32(a, n); }
+
+static inline void widen8(Vec x, Vec* lo, Vec* hi) {
+#if defined(__SSE4_1__)
+   *lo = _mm_cvtepu8_epi16(x);
+   *hi = _mm_cvtepu8_epi16(_mm_srli_si128(x, 8));
+#else
+   *lo = _mm_unpacklo_epi8(x, _mm_setzero_si128());
+   *hi = _mm_unpackhi_epi8(x, _mm_setzero_si128());
+#endif
+}
+static inline void widen16(Vec x, Vec* lo, Vec* hi) {
+#if defined(__SSE4_1__)
+   *lo = _mm_cvtepu16_epi32(x);
+   *hi = _mm_cvtepu16_epi32(_mm_srli_si128(x, 8));
+#else
+   *lo = _mm_unpacklo_epi16(x, _mm_setzero_si128());
+   *hi = _mm_unpackhi_epi16(x, _mm_setzero_si128());
+#endif
+}
+static inline Vec div255x16(Vec x) {
+   return _mm_srli_epi16(_mm_mulhi_epu16(x, set16(0x8081)), 7);
+}
+static inline Vec div255x32(Vec x) {
+   Vec const m = set32(static_cast<int>(0x80808081));
+   Vec const even = _mm_srli_epi64(_mm_mul_epu32(x, m), 39);
+   Vec const odd = _mm_srli_epi64(_mm_mul_epu32(_mm_srli_epi64(x, 32), m), 39);
+   return _mm_or_si128(even, _mm_slli_epi64(odd, 32));
+}
+static inline Vec pack16(Vec a, Vec b) {
+   Vec const mask = set16(0xFF);
+   return _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+}
+static inline Vec pack32(Vec a, Vec b) {
+   Vec const mask = set32(0xFF);
+#if defined(__SSE4_1__)
+   return _mm_packus_epi32(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+#else
+   // Values are at most 255, so signed saturation never kicks in
+   return _mm_packs_epi32(_mm_and_si128(a, mask), _mm_and_si128(b, mask));
+#endif
+}
+static inline void storeBytes(uint8_t* p, Vec x) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), x); }
+
+#endif
+
+int FILTER_UINT8_ROW(FilterUint8Job const& job, int i, int beg, int end) {
+   int const ch = job.channels;
+   int const kcols = job.kcols;
+   int const krows = job.krows;
+   int const colOffset = job.anchorCol*ch;
+   size_t const tapStride = static_cast<size_t>(ch)*FILTER_UINT8_LANES;
+   __m128i const shift = _mm_cvtsi32_si128(job.shift);
+   uint8_t* dst = job.out[i];
+
+   int s = beg;
+   for( ; s + VEC_BYTES <= end; s += VEC_BYTES ) {
+      int const phase = s % ch;
+
+      if( !job.wide ) {
+         Vec acc0 = set16(job.delta);
+         Vec acc1 = acc0;
+         for( int m = 0; m < krows; ++m ) {
+            uint8_t const* src = job.img[i + m - job.anchorRow] + s - colOffset;
+            uint16_t const* pat = &job.pattern[(static_cast<size_t>(m)*kcols*ch + phase)*FILTER_UINT8_LANES];
+            for( int n = 0; n < kcols; ++n, src += ch, pat += tapStride ) {
+               Vec lo, hi;
+               widen8(loadBytes(src), &lo, &hi);
+               acc0 = add16(acc0, mul16(lo, loadCoef(pat)));
+               acc1 = add16(acc1, mul16(hi, loadCoef(pat + VEC_LANES16)));
+            }
+         }
+
+         if( job.shift < 0 ) {
+            acc0 = div255x16(acc0);
+            acc1 = div255x16(acc1);
+         }
+         else {
+            acc0 = shr16(acc0, shift);
+            acc1 = shr16(acc1, shift);
+         }
+         storeBytes(dst + s, pack16(acc0, acc1));
+      }
+      else {
+         Vec acc0 = set32(job.delta);
+         Vec acc1 = acc0;
+         Vec acc2 = acc0;
+         Vec acc3 = acc0;
+         for( int m = 0; m < krows; ++m ) {
+            uint8_t const* src = job.img[i + m - job.anchorRow] + s - colOffset;
+            uint16_t const* pat = &job.pattern[(static_cast<size_t>(m)*kcols*ch + phase)*FILTER_UINT8_LANES];
+            for( int n = 0; n < kcols; ++n, src += ch, pat += tapStride ) {
+               Vec lo, hi, p0, p1;
+               widen8(loadBytes(src), &lo, &hi);
+               widen16(mul16(lo, loadCoef(pat)), &p0, &p1);
+               acc0 = add32(acc0, p0);
+               acc1 = add32(acc1, p1);
+               widen16(mul16(hi, loadCoef(pat + VEC_LANES16)), &p0, &p1);
+               acc2 = add32(acc2, p0);
+               acc3 = add32(acc3, p1);
+            }
+         }
+
+         if( job.shift < 0 ) {
+            acc0 = div255x32(acc0);
+            acc1 = div255x32(acc1);
+            acc2 = div255x32(acc2);
+            acc3 = div255x32(acc3);
+         }
+         else {
+            acc0 = shr32(acc0, shift);
+            acc1 = shr32(acc1, shift);
+            acc2 = shr32(acc2, shift);
+            acc3 = shr32(acc3, shift);
+         }
+         storeBytes(dst + s, pack16(pack32(acc0, acc1), pack32(acc2, acc3)));
+      }
+   }
+
+   return s;
+}
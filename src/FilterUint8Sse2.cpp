@@ -0,0 +1,8 @@
+/*
+ * FilterUint8Sse2.cpp is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+// SSE2 row kernel; src/CMakeLists.txt compiles this file with -msse2
+#define FILTER_UINT8_ROW filterUint8RowSse2
+#include "FilterUint8Kernel.h"
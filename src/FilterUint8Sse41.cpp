@@ -0,0 +1,8 @@
+/*
+ * FilterUint8Sse41.cpp is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+// SSE4.1 row kernel; src/CMakeLists.txt compiles this file with -msse4.1
+#define FILTER_UINT8_ROW filterUint8RowSse41
+#include "FilterUint8Kernel.h"
@@ -0,0 +1,204 @@
+/*
+ * FrameArchive.cpp is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#include <FrameArchive.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+static char const FRAME_ARCHIVE_MAGIC[8] = {'P', 'G', 'V', 'L', 'F', 'R', 'M', '1'};
+
+// Bytes per channel of a FrameType, or 0 if the type is unknown
+static int frameTypeSize(int type) {
+   switch( type ) {
+   case FRAME_UINT8:
+      return sizeof(uint8_t);
+   case FRAME_UINT16:
+      return sizeof(uint16_t);
+   case FRAME_FLOAT:
+      return sizeof(float);
+   default:
+      return 0;
+   }
+}
+
+//==============FrameArchiveWriter===============
+
+FrameArchiveWriter::FrameArchiveWriter(std::string const& filename) :
+   _file(fopen(filename.c_str(), "wb")),
+   _offset(0)
+{
+   if( !_file ) {
+      LOGE("Cannot open " << filename);
+      return;
+   }
+
+   // Placeholder until close() knows the frame count and index offset
+   FrameArchiveHeader header;
+   memset(&header, 0, sizeof(header));
+   if( fwrite(&header, sizeof(header), 1, _file) != 1 )
+      fail();
+   _offset = sizeof(header);
+}
+
+FrameArchiveWriter::~FrameArchiveWriter() {
+   close();
+}
+
+bool FrameArchiveWriter::appendRows(
+   uint8_t const* data,
+   int rows, int cols, int channels, int channelWidth, int srcRowWidth,
+   int type
+) {
+   if( !_file || !pad() )
+      return false;
+
+   FrameInfo fi;
+   memset(&fi, 0, sizeof(fi));
+   fi.offset = _offset;
+   fi.rows = rows;
+   fi.cols = cols;
+   fi.channels = channels;
+   fi.type = type;
+
+   // Same row padding as Image::resize()
+   int const packed = cols*channels*channelWidth;
+   fi.rowWidth = packed;
+   if( fi.rowWidth % CACHE_LINE_SIZE )
+      fi.rowWidth += CACHE_LINE_SIZE - (fi.rowWidth % CACHE_LINE_SIZE);
+
+   std::vector<uint8_t> row(fi.rowWidth, 0);
+   for( int i = 0; i < rows; ++i ) {
+      memcpy(&row[0], data + static_cast<size_t>(i)*srcRowWidth, packed);
+      if( fwrite(&row[0], 1, fi.rowWidth, _file) != static_cast<size_t>(fi.rowWidth) ) {
+         fail();
+         return false;
+      }
+   }
+
+   _offset += static_cast<uint64_t>(fi.rowWidth)*rows;
+   _index.push_back(fi);
+   return true;
+}
+
+bool FrameArchiveWriter::close() {
+   if( !_file )
+      return false;
+
+   FrameArchiveHeader header;
+   memset(&header, 0, sizeof(header));
+   memcpy(header.magic, FRAME_ARCHIVE_MAGIC, sizeof(header.magic));
+   header.alignment = CACHE_LINE_SIZE;
+   header.frameCount = _index.size();
+
+   bool ok = pad();
+   header.indexOffset = _offset;
+   if( ok && !_index.empty() )
+      ok = fwrite(&_index[0], sizeof(FrameInfo), _index.size(), _file) == _index.size();
+
+   // Only now that everything else is down does the file become valid
+   ok = ok &&
+      fseek(_file, 0, SEEK_SET) == 0 &&
+      fwrite(&header, sizeof(header), 1, _file) == 1;
+
+   ok = (fclose(_file) == 0) && ok;
+   _file = 0;
+   return ok;
+}
+
+bool FrameArchiveWriter::pad() {
+   static uint8_t const zeros[CACHE_LINE_SIZE] = {0};
+   size_t const n = (CACHE_LINE_SIZE - _offset % CACHE_LINE_SIZE) % CACHE_LINE_SIZE;
+
+   if( n && fwrite(zeros, 1, n, _file) != n ) {
+      fail();
+      return false;
+   }
+
+   _offset += n;
+   return true;
+}
+
+void FrameArchiveWriter::fail() {
+   LOGE("Write failed");
+   fclose(_file);
+   _file = 0;
+}
+
+//==============FrameArchiveReader===============
+
+FrameArchiveReader::FrameArchiveReader(std::string const& filename) :
+   _base(0),
+   _length(0),
+   _index(0),
+   _count(0)
+{
+   struct stat st;
+   int fd;
+
+   if( (fd = open(filename.c_str(), O_RDONLY)) < 0 ) {
+      LOGE("Cannot open " << filename);
+      return;
+   }
+   if( fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(FrameArchiveHeader) ) {
+      LOGE(filename << " is not a frame archive");
+      close(fd);
+      return;
+   }
+
+   _length = st.st_size;
+   void* base = mmap(0, _length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+   close(fd);
+   if( base == MAP_FAILED ) {
+      LOGE("Cannot map " << filename);
+      _length = 0;
+      return;
+   }
+   _base = static_cast<uint8_t*>(base);
+
+   FrameArchiveHeader const* header = reinterpret_cast<FrameArchiveHeader const*>(_base);
+   if( memcmp(header->magic, FRAME_ARCHIVE_MAGIC, sizeof(header->magic)) != 0 ||
+      header->indexOffset % sizeof(uint64_t) != 0 ||
+      header->indexOffset > _length ||
+      header->frameCount > (_length - header->indexOffset)/sizeof(FrameInfo) ) {
+      LOGE(filename << " is not a frame archive");
+      unmap();
+      return;
+   }
+
+   _index = reinterpret_cast<FrameInfo const*>(_base + header->indexOffset);
+   _count = header->frameCount;
+
+   // Check every frame has a known type, rows wide enough for its pixels,
+   // and lies inside the file, so frame() need not
+   for( size_t k = 0; k < _count; ++k ) {
+      FrameInfo const& fi = _index[k];
+      int const sampleSize = frameTypeSize(fi.type);
+      if( fi.rows < 0 || fi.cols < 0 || fi.channels < 0 || fi.rowWidth < 0 ||
+         sampleSize == 0 ||
+         static_cast<uint64_t>(fi.cols)*fi.channels*sampleSize > static_cast<uint64_t>(fi.rowWidth) ||
+         fi.offset > _length ||
+         static_cast<uint64_t>(fi.rows)*fi.rowWidth > _length - fi.offset ) {
+         LOGE(filename << ": frame " << k << " is corrupt");
+         unmap();
+         return;
+      }
+   }
+}
+
+FrameArchiveReader::~FrameArchiveReader() {
+   unmap();
+}
+
+void FrameArchiveReader::unmap() {
+   if( _base )
+      munmap(_base, _length);
+   _base = 0;
+   _length = 0;
+   _index = 0;
+   _count = 0;
+}
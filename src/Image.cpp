@@ -267,7 +267,7 @@ static SDL_Color grayscaleColors[] = {
    {.r = 0xFF, .g = 0xFF, .b = 0xFF, .a = 0xFF},
 };
 
-SDL_Surface* toSurface(Image<uint8_t>& img) {
+SDL_Surface* toSurface(ImageView<uint8_t> img) {
 
    SDL_Surface* ret;
 
@@ -300,11 +300,55 @@ SDL_Surface* toSurface(Image<uint8_t>& img) {
    return ret;
 }
 
-void srgb2rgb(Image<float>& img) {
+/*
+ * Call f(px) on every pixel of img, where px points at the pixel's first
+ * channel. The pixel stride is a compile-time constant when C is fixed, so
+ * the loop body unrolls.
+ */
+template<int C, class F>
+static void forEachPixelFixed(ImageView<float> img, F const& f) {
    int const rows = img.rows();
    int const cols = img.cols();
-   int const chans = img.channels();
+   int const chans = C != DYNAMIC_CHANNELS ? C : img.channels();
+
+#pragma omp parallel for shared(img, f)
+   for(int i = 0; i < rows; ++i) {
+      float* row = img[i];
+      for(int j = 0; j < cols; ++j) {
+         f(row + j*chans);
+      }
+   }
+}
+
+//! Dispatch forEachPixelFixed() on the common channel counts
+template<class F>
+static void forEachPixel(ImageView<float> img, F const& f) {
+   switch( img.channels() ) {
+   case 3: forEachPixelFixed<3>(img, f); break;
+   case 4: forEachPixelFixed<4>(img, f); break;
+   default: forEachPixelFixed<DYNAMIC_CHANNELS>(img, f); break;
+   }
+}
+
+/*
+ * Call f(c) on every channel of every pixel. Rows are contiguous runs of
+ * channels, so there is no pixel stride at all.
+ */
+template<class F>
+static void forEachChannel(ImageView<float> img, F const& f) {
+   int const rows = img.rows();
+   int const width = img.cols()*img.channels();
+
+#pragma omp parallel for shared(img, f)
+   for(int i = 0; i < rows; ++i) {
+      float* row = img[i];
+      for(int j = 0; j < width; ++j) {
+         f(row[j]);
+      }
+   }
+}
 
+void srgb2rgb(ImageView<float> img) {
    auto convert = [](float& c) -> void {
       if( c <= 0.04045f )
          c /= 12.92f;
@@ -312,20 +356,10 @@ void srgb2rgb(Image<float>& img) {
          c = powf((c+0.055f)/(1.f+0.055f), 2.4f);
    };
 
-   for(int i = 0; i < rows; ++i) {
-      for(int j = 0; j < cols; ++j) {
-         for(int k = 0; k < chans; ++k) {
-            convert(img[i][j*chans+k]);
-         }
-      }
-   }
+   forEachChannel(img, convert);
 }
 
-void rgb2srgb(Image<float>& img) {
-   int const rows = img.rows();
-   int const cols = img.cols();
-   int const chans = img.channels();
-
+void rgb2srgb(ImageView<float> img) {
    auto convert = [](float& c) -> void {
       if( c <= 0.0031308f )
          c *= 12.92f;
@@ -333,46 +367,23 @@ void rgb2srgb(Image<float>& img) {
          c = (1.f+0.055f)*powf(c, 1.f/2.4f) - 0.055f;
    };
 
-   for(int i = 0; i < rows; ++i) {
-      for(int j = 0; j < cols; ++j) {
-         for(int k = 0; k < chans; ++k) {
-            convert(img[i][j*chans+k]);
-         }
-      }
-   }
+   forEachChannel(img, convert);
 }
 
-void rgb2xyz(Image<float>& img) {
-   int const rows = img.rows();
-   int const cols = img.cols();
-   int const chans = img.channels();
-   Eigen::Vector3f rgb;
-   Eigen::Vector3f xyz;
+void rgb2xyz(ImageView<float> img) {
    Eigen::Matrix3f A;
 
    A << 0.49f, 0.31f, 0.20f, 0.17697f, 0.81240f, 0.01063f, 0.00f, 0.01f, 0.99f;
    A /= A(1,0);
 
-   for(int i = 0; i < rows; ++i) {
-      for(int j = 0; j < cols; ++j) {
-         rgb(0) = img[i][j*chans+0];
-         rgb(1) = img[i][j*chans+1];
-         rgb(2) = img[i][j*chans+2];
-
-         xyz = A*rgb;
-         img[i][j*chans+0] = xyz(0);
-         img[i][j*chans+1] = xyz(1);
-         img[i][j*chans+2] = xyz(2);
-      }
-   }
+   forEachPixel(img, [&A](float* px) -> void {
+      Eigen::Map<Eigen::Vector3f> xyz(px);
+      Eigen::Vector3f const rgb(px[0], px[1], px[2]);
+      xyz = A*rgb;
+   });
 }
 
-void xyz2rgb(Image<float>& img) {
-   int const rows = img.rows();
-   int const cols = img.cols();
-   int const chans = img.channels();
-   Eigen::Vector3f rgb;
-   Eigen::Vector3f xyz;
+void xyz2rgb(ImageView<float> img) {
    Eigen::Matrix3f A;
 
    // This is the rgb->xyz matrix. Need its inverse.
@@ -381,192 +392,161 @@ void xyz2rgb(Image<float>& img) {
 
    A = A.inverse();
 
-   for(int i = 0; i < rows; ++i) {
-      for(int j = 0; j < cols; ++j) {
-         xyz(0) = img[i][j*chans+0];
-         xyz(1) = img[i][j*chans+1];
-         xyz(2) = img[i][j*chans+2];
-
-         rgb = A*xyz;
-         img[i][j*chans+0] = rgb(0);
-         img[i][j*chans+1] = rgb(1);
-         img[i][j*chans+2] = rgb(2);
-      }
-   }
+   forEachPixel(img, [&A](float* px) -> void {
+      Eigen::Map<Eigen::Vector3f> rgb(px);
+      Eigen::Vector3f const xyz(px[0], px[1], px[2]);
+      rgb = A*xyz;
+   });
 }
 
-void rgb2hsl(Image<float>& img) {
-   float r,g,b;
-   float vmax, vmin;
-   float h,s,l;
+void rgb2hsl(ImageView<float> img) {
+   forEachPixel(img, [](float* px) -> void {
+      float r,g,b;
+      float vmax, vmin;
+      float h,s,l;
 
-   int const rows = img.rows();
-   int const cols = img.cols();
-   int const chans = img.channels();
+      r = px[0];
+      g = px[1];
+      b = px[2];
 
-   for(int i = 0; i < rows; ++i) {
-      for(int j = 0; j < cols; ++j) {
-         r = img[i][j*chans+0];
-         g = img[i][j*chans+1];
-         b = img[i][j*chans+2];
-
-         vmax = std::max(r,std::max(g,b));
-         vmin = std::min(r,std::min(g,b));
-         l = (vmax+vmin)/2.f;
-
-         if( l < 0.5 )
-            s = (vmax-vmin)/(vmax+vmin);
-         else
-            s = (vmax-vmin)/(2.f-(vmax+vmin));
-
-         if( vmax == r ) {
-            h = 60.f*(g-b)/s;
-         } else if( vmax == g ) {
-            h = 120.f+60.f*(b-r)/s;
-         } else {
-            h = 240.f+60.f*(r-g)/s;
-         }
-
-         if( h < 0.f )
-            h += 360.f;
-
-         img[i][j*chans+0] = h;
-         img[i][j*chans+1] = s;
-         img[i][j*chans+2] = l;
+      vmax = std::max(r,std::max(g,b));
+      vmin = std::min(r,std::min(g,b));
+      l = (vmax+vmin)/2.f;
+
+      if( l < 0.5 )
+         s = (vmax-vmin)/(vmax+vmin);
+      else
+         s = (vmax-vmin)/(2.f-(vmax+vmin));
+
+      if( vmax == r ) {
+         h = 60.f*(g-b)/s;
+      } else if( vmax == g ) {
+         h = 120.f+60.f*(b-r)/s;
+      } else {
+         h = 240.f+60.f*(r-g)/s;
       }
-   }
-}
 
-void hsl2rgb(Image<float>& img) {
-   float r,g,b;
-   float h,s,l;
-   float c, x, m;
+      if( h < 0.f )
+         h += 360.f;
 
-   int const rows = img.rows();
-   int const cols = img.cols();
-   int const chans = img.channels();
+      px[0] = h;
+      px[1] = s;
+      px[2] = l;
+   });
+}
 
-   for(int i = 0; i < rows; ++i) {
-      for(int j = 0; j < cols; ++j) {
-         h = img[i][j*chans+0];
-         s = img[i][j*chans+1];
-         l = img[i][j*chans+2];
-
-         c = (1.f - std::abs(2*l-1))*s;
-         x = (1.f - std::abs(fmod(h/60.f,2.f) - 1.f))*c;
-         m = l - c/2.f;
-
-         r = g = b = m;
-
-         if( h < 60.f ) {
-            r += c;
-            g += x;
-         } else if( h < 120.f ) {
-            r += x;
-            g += c;
-         } else if( h < 180.f ) {
-            g += c;
-            b += x;
-         } else if( h < 240.f ) {
-            g += x;
-            b += c;
-         } else if( h < 300.f ) {
-            r += x;
-            b += c;
-         } else {
-            r += c;
-            b += x;
-         }
-
-         img[i][j*chans+0] = r;
-         img[i][j*chans+1] = g;
-         img[i][j*chans+2] = b;
+void hsl2rgb(ImageView<float> img) {
+   forEachPixel(img, [](float* px) -> void {
+      float r,g,b;
+      float h,s,l;
+      float c, x, m;
+
+      h = px[0];
+      s = px[1];
+      l = px[2];
+
+      c = (1.f - std::abs(2*l-1))*s;
+      x = (1.f - std::abs(fmod(h/60.f,2.f) - 1.f))*c;
+      m = l - c/2.f;
+
+      r = g = b = m;
+
+      if( h < 60.f ) {
+         r += c;
+         g += x;
+      } else if( h < 120.f ) {
+         r += x;
+         g += c;
+      } else if( h < 180.f ) {
+         g += c;
+         b += x;
+      } else if( h < 240.f ) {
+         g += x;
+         b += c;
+      } else if( h < 300.f ) {
+         r += x;
+         b += c;
+      } else {
+         r += c;
+         b += x;
       }
-   }
+
+      px[0] = r;
+      px[1] = g;
+      px[2] = b;
+   });
 }
 
-void rgb2hsv(Image<float>& img) {
-   float r,g,b;
-   float h,s,v;
+void rgb2hsv(ImageView<float> img) {
+   forEachPixel(img, [](float* px) -> void {
+      float r,g,b;
+      float h,s,v;
 
-   int const rows = img.rows();
-   int const cols = img.cols();
-   int const chans = img.channels();
+      r = px[0];
+      g = px[1];
+      b = px[2];
 
-   for(int i = 0; i < rows; ++i) {
-      for(int j = 0; j < cols; ++j) {
-         r = img[i][j*chans+0];
-         g = img[i][j*chans+1];
-         b = img[i][j*chans+2];
-
-         v = std::max(r,std::max(g,b));
-         if( v < 1e-5 )
-            s = 0;
-         else
-            s = (v - std::min(r,std::min(g,b))) / v;
-
-         if( v == r ) {
-            h = 60.f*(g-b)/(v - std::min(r,std::min(g,b)));
-         } else if( v == g ) {
-            h = 120.f+60.f*(b-r)/(v - std::min(r,std::min(g,b)));
-         } else {
-            h = 240.f+60.f*(r-g)/(v - std::min(r,std::min(g,b)));
-         }
-
-         if( h < 0.f )
-            h += 360.f;
-
-         img[i][j*chans+0] = h;
-         img[i][j*chans+1] = s;
-         img[i][j*chans+2] = v;
+      v = std::max(r,std::max(g,b));
+      if( v < 1e-5 )
+         s = 0;
+      else
+         s = (v - std::min(r,std::min(g,b))) / v;
+
+      if( v == r ) {
+         h = 60.f*(g-b)/(v - std::min(r,std::min(g,b)));
+      } else if( v == g ) {
+         h = 120.f+60.f*(b-r)/(v - std::min(r,std::min(g,b)));
+      } else {
+         h = 240.f+60.f*(r-g)/(v - std::min(r,std::min(g,b)));
       }
-   }
-}
 
-void hsv2rgb(Image<float>& img) {
-   float r,g,b;
-   float h,s,v;
-   float c, x, m;
+      if( h < 0.f )
+         h += 360.f;
 
-   int const rows = img.rows();
-   int const cols = img.cols();
-   int const chans = img.channels();
+      px[0] = h;
+      px[1] = s;
+      px[2] = v;
+   });
+}
 
-   for(int i = 0; i < rows; ++i) {
-      for(int j = 0; j < cols; ++j) {
-         h = img[i][j*chans+0];
-         s = img[i][j*chans+1];
-         v = img[i][j*chans+2];
-
-         c = v*s;
-         x = (1.f - std::abs(fmod(h/60.f,2.f) - 1.f))*c;
-         m = v-c;
-
-         r = g = b = m;
-
-         if( h < 60.f ) {
-            r += c;
-            g += x;
-         } else if( h < 120.f ) {
-            r += x;
-            g += c;
-         } else if( h < 180.f ) {
-            g += c;
-            b += x;
-         } else if( h < 240.f ) {
-            g += x;
-            b += c;
-         } else if( h < 300.f ) {
-            r += x;
-            b += c;
-         } else {
-            r += c;
-            b += x;
-         }
-
-         img[i][j*chans+0] = r;
-         img[i][j*chans+1] = g;
-         img[i][j*chans+2] = b;
+void hsv2rgb(ImageView<float> img) {
+   forEachPixel(img, [](float* px) -> void {
+      float r,g,b;
+      float h,s,v;
+      float c, x, m;
+
+      h = px[0];
+      s = px[1];
+      v = px[2];
+
+      c = v*s;
+      x = (1.f - std::abs(fmod(h/60.f,2.f) - 1.f))*c;
+      m = v-c;
+
+      r = g = b = m;
+
+      if( h < 60.f ) {
+         r += c;
+         g += x;
+      } else if( h < 120.f ) {
+         r += x;
+         g += c;
+      } else if( h < 180.f ) {
+         g += c;
+         b += x;
+      } else if( h < 240.f ) {
+         g += x;
+         b += c;
+      } else if( h < 300.f ) {
+         r += x;
+         b += c;
+      } else {
+         r += c;
+         b += x;
       }
-   }
+
+      px[0] = r;
+      px[1] = g;
+      px[2] = b;
+   });
 }
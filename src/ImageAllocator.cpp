@@ -0,0 +1,165 @@
+/*
+ * ImageAllocator.cpp is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#include <ImageAllocator.h>
+#include <stdlib.h>
+#include <atomic>
+
+// Round x up to a multiple of the power of two p
+static size_t roundUp(size_t x, size_t p) {
+   return (x + p - 1) & ~(p - 1);
+}
+
+// Largest power of two <= x, for x > 0
+static size_t floorPow2(size_t x) {
+   return size_t(1) << (8*sizeof(unsigned long long) - 1 - __builtin_clzll(x));
+}
+
+//================ImageAllocator=================
+
+static std::atomic<ImageAllocator*> userDefaultAllocator(0);
+
+ImageAllocator* ImageAllocator::defaultAllocator() {
+   static PoolAllocator pool;
+
+   ImageAllocator* ret = userDefaultAllocator.load();
+   return ret ? ret : &pool;
+}
+
+void ImageAllocator::setDefaultAllocator(ImageAllocator* allocator) {
+   userDefaultAllocator.store(allocator);
+}
+
+//================HeapAllocator==================
+
+uint8_t* HeapAllocator::allocate(size_t bytes, size_t* capacity) {
+   void* ret = 0;
+
+   *capacity = roundUp(bytes, CACHE_LINE_SIZE);
+   if( *capacity == 0 )
+      return 0;
+
+   if( posix_memalign(&ret, CACHE_LINE_SIZE, *capacity) ) {
+      *capacity = 0;
+      return 0;
+   }
+
+   return static_cast<uint8_t*>(ret);
+}
+
+void HeapAllocator::deallocate(uint8_t* block, size_t /*capacity*/) {
+   free(block);
+}
+
+//================PoolAllocator==================
+
+PoolAllocator::PoolAllocator(size_t maxCachedBytes) :
+   _maxCachedBytes(maxCachedBytes),
+   _cachedBytes(0),
+   _hits(0),
+   _misses(0)
+{
+}
+
+PoolAllocator::~PoolAllocator() {
+   release();
+}
+
+size_t PoolAllocator::classSize(size_t bytes) {
+   size_t const c = roundUp(bytes, CACHE_LINE_SIZE);
+
+   // The first 4 classes are just multiples of the cache line
+   if( c <= 4*CACHE_LINE_SIZE )
+      return c;
+
+   // Afterwards, there are 4 evenly-spaced classes in each (p, 2p]
+   size_t const p = floorPow2(c-1);
+   return roundUp(c, p/4);
+}
+
+int PoolAllocator::classIndex(size_t capacity) {
+   if( capacity <= 4*CACHE_LINE_SIZE )
+      return capacity/CACHE_LINE_SIZE - 1;
+
+   size_t const p = floorPow2(capacity-1);
+   int const octave = __builtin_ctzll(p) - __builtin_ctzll(4*CACHE_LINE_SIZE);
+   int const quarter = (capacity - p)/(p/4);
+
+   return 4 + 4*octave + (quarter-1);
+}
+
+uint8_t* PoolAllocator::allocate(size_t bytes, size_t* capacity) {
+   *capacity = classSize(bytes);
+   if( *capacity == 0 )
+      return 0;
+
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      std::vector<uint8_t*>& freeList = _free[classIndex(*capacity)];
+
+      if( !freeList.empty() ) {
+         uint8_t* ret = freeList.back();
+         freeList.pop_back();
+         _cachedBytes -= *capacity;
+         ++_hits;
+         return ret;
+      }
+
+      ++_misses;
+   }
+
+   // Do the slow heap allocation outside the lock
+   size_t heapCapacity;
+   uint8_t* ret = _heap.allocate(*capacity, &heapCapacity);
+   if( !ret )
+      *capacity = 0;
+   return ret;
+}
+
+void PoolAllocator::deallocate(uint8_t* block, size_t capacity) {
+   if( !block )
+      return;
+
+   {
+      std::lock_guard<std::mutex> lock(_mutex);
+      if( _cachedBytes + capacity <= _maxCachedBytes ) {
+         _free[classIndex(capacity)].push_back(block);
+         _cachedBytes += capacity;
+         return;
+      }
+   }
+
+   _heap.deallocate(block, capacity);
+}
+
+size_t PoolAllocator::hits() const {
+   std::lock_guard<std::mutex> lock(_mutex);
+   return _hits;
+}
+
+size_t PoolAllocator::misses() const {
+   std::lock_guard<std::mutex> lock(_mutex);
+   return _misses;
+}
+
+size_t PoolAllocator::cachedBytes() const {
+   std::lock_guard<std::mutex> lock(_mutex);
+   return _cachedBytes;
+}
+
+void PoolAllocator::resetStats() {
+   std::lock_guard<std::mutex> lock(_mutex);
+   _hits = _misses = 0;
+}
+
+void PoolAllocator::release() {
+   std::lock_guard<std::mutex> lock(_mutex);
+   for( int i = 0; i < NUM_CLASSES; ++i ) {
+      for( size_t j = 0; j < _free[i].size(); ++j )
+         _heap.deallocate(_free[i][j], 0);
+      _free[i].clear();
+   }
+   _cachedBytes = 0;
+}
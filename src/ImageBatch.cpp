@@ -0,0 +1,42 @@
+/*
+ * ImageBatch.cpp is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#include <ImageBatch.h>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+
+std::vector<std::string> listDirectory(std::string const& dir) {
+   std::vector<std::string> ret;
+   DIR* d = opendir(dir.c_str());
+
+   if( !d ) {
+      LOGE("Cannot open directory " << dir);
+      return ret;
+   }
+
+   std::string prefix(dir);
+   if( prefix.empty() || prefix[prefix.size()-1] != '/' )
+      prefix += '/';
+
+   while( struct dirent* entry = readdir(d) ) {
+      std::string const path = prefix + entry->d_name;
+
+      // Some filesystems do not fill in d_type
+      bool regular = entry->d_type == DT_REG;
+      if( entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK ) {
+         struct stat st;
+         regular = stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode);
+      }
+
+      if( regular )
+         ret.push_back(path);
+   }
+   closedir(d);
+
+   // readdir() order depends on the filesystem
+   std::sort(ret.begin(), ret.end());
+   return ret;
+}
@@ -4,3 +4,81 @@
  */
 
 #include <ImageProcessing.h>
+#include <OpticalFlowStream.h>
+
+FilterBlock filterBlock(int krows, int kcols, int channels, int sampleBytes, int align) {
+   // Half of a typical 32 KiB L1, leaving room for the kernel and the stack
+   int const budget = (16 << 10) / sampleBytes;
+   int const halo = (kcols - 1)*channels;
+
+   FilterBlock block;
+   block.rows = 64;
+   block.cols = budget/(krows + 1) - halo;
+   // Very large kernels overflow L1 anyway; keep rows long enough to stream
+   block.cols = std::max(block.cols, 256/sampleBytes);
+   block.cols = std::max(block.cols / align, 1) * align;
+   return block;
+}
+
+void opticalFlowToRgb(
+   ImageView<uint8_t> rgb,
+   ImageView<float> const& flow,
+   float const maxFlow
+){
+   int const rows = flow.rows();
+   int const cols = flow.cols();
+
+   if( flow.channels() != 2 ) {
+      LOGE("Flow has " << flow.channels() << " channels, expected 2");
+      return;
+   }
+   if( rgb.rows() != rows || rgb.cols() != cols || rgb.channels() != 3 ) {
+      LOGE("Output is " << rgb.rows() << "x" << rgb.cols() << "x" << rgb.channels()
+         << ", expected " << rows << "x" << cols << "x3");
+      return;
+   }
+
+   Image<float> hsv(rows, cols, 3);
+   int i,j;
+   for( i = 0; i < rows; ++i ) {
+      for( j = 0; j < cols; ++j ) {
+         float dx = flow[i][j*2+0];
+         float dy = flow[i][j*2+1];
+         float angle = 180.f/M_PI * atan2(dy, dx);
+         float mag = sqrtf(dx*dx + dy*dy) / maxFlow;
+
+         if( angle < 0.f )
+            angle += 360.f;
+
+         hsv[i][j*3+0] = angle;
+         hsv[i][j*3+1] = std::min(1.f, mag);
+         hsv[i][j*3+2] = 1.f;
+      }
+   }
+
+   hsv2rgb(hsv);
+   for( i = 0; i < rows; ++i )
+      for( j = 0; j < cols*3; ++j )
+         rgb[i][j] = static_cast<uint8_t>(255.f*hsv[i][j]);
+}
+
+void hsOpticalFlow(
+   ImageView<float> flow,
+   ImageView<float> const& img0,
+   ImageView<float> const& img1,
+   int radius
+) {
+   if( radius < 1 ) {
+      LOGE("Optical flow radius must be at least 1, not " << radius);
+      return;
+   }
+
+   OpticalFlowStream stream(radius);
+   stream.push(img0);
+   stream.push(img1);
+
+   // Only the pixels the solve writes; the border of flow is left alone
+   Image<float> const& result = stream.flow();
+   for(int i = radius; i < result.rows() - radius; ++i)
+      std::copy(result[i] + radius*2, result[i] + (result.cols() - radius)*2, flow[i] + radius*2);
+}
@@ -0,0 +1,207 @@
+/*
+ * Lowpass.cpp is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#include <ImageProcessing.h>
+
+// Sample columns processed together by the vertical passes, so each row
+// is read in one contiguous run
+#define LOWPASS_COLUMN_BLOCK 64
+
+/*
+ * Run lineFilter over every channel of every row, then over every column,
+ * replicating edge samples. LineFilter::operator()(Line* x, int n, Line* tmp)
+ * filters a contiguous line in place, and may use the n samples at tmp as
+ * scratch. Each pass goes through lines of type Line, and Store converts a
+ * finished line back to T.
+ */
+template<class T, class Line, class LineFilter, class Store>
+static void separableLines(
+   ImageView<T> out,
+   ImageView<T> const& img,
+   LineFilter const& lineFilter,
+   Store const& store
+) {
+   int const rows = img.rows();
+   int const cols = img.cols();
+   int const chans = img.channels();
+   int const samples = cols*chans;
+
+#pragma omp parallel shared(out,img,lineFilter,store)
+   {
+      std::vector<Line> line(cols);
+      std::vector<Line> tmp(cols);
+
+#pragma omp for
+      for( int i = 0; i < rows; ++i ) {
+         T const* src = img[i];
+         T* dst = out[i];
+         for( int k = 0; k < chans; ++k ) {
+            for( int j = 0; j < cols; ++j )
+               line[j] = src[j*chans + k];
+            lineFilter(&line[0], cols, &tmp[0]);
+            for( int j = 0; j < cols; ++j )
+               dst[j*chans + k] = store(line[j]);
+         }
+      }
+   }
+
+   int const blocks = (samples + LOWPASS_COLUMN_BLOCK - 1) / LOWPASS_COLUMN_BLOCK;
+#pragma omp parallel shared(out,lineFilter,store)
+   {
+      std::vector<Line> column(static_cast<size_t>(rows)*LOWPASS_COLUMN_BLOCK);
+      std::vector<Line> tmp(rows);
+
+#pragma omp for
+      for( int b = 0; b < blocks; ++b ) {
+         int const j0 = b*LOWPASS_COLUMN_BLOCK;
+         int const width = std::min(LOWPASS_COLUMN_BLOCK, samples - j0);
+
+         for( int i = 0; i < rows; ++i ) {
+            T const* src = out[i] + j0;
+            for( int j = 0; j < width; ++j )
+               column[j*rows + i] = src[j];
+         }
+         for( int j = 0; j < width; ++j )
+            lineFilter(&column[j*rows], rows, &tmp[0]);
+         for( int i = 0; i < rows; ++i ) {
+            T* dst = out[i] + j0;
+            for( int j = 0; j < width; ++j )
+               dst[j] = store(column[j*rows + i]);
+         }
+      }
+   }
+}
+
+/*
+ * Young and van Vliet, "Recursive implementation of the Gaussian filter",
+ * Signal Processing 44 (1995): a causal and an anti-causal third-order pass.
+ */
+class YoungVanVliet {
+public:
+   explicit YoungVanVliet(float sigma) {
+      double const q = (sigma >= 2.5f) ?
+         0.98711*sigma - 0.96330 :
+         3.97156 - 4.14554*std::sqrt(1.0 - 0.26891*sigma);
+      double const q2 = q*q;
+      double const q3 = q2*q;
+      double const b0 = 1.57825 + 2.44413*q + 1.4281*q2 + 0.422205*q3;
+      _a1 = (2.44413*q + 2.85619*q2 + 1.26661*q3) / b0;
+      _a2 = -(1.4281*q2 + 1.26661*q3) / b0;
+      _a3 = 0.422205*q3 / b0;
+      _gain = 1.0 - (_a1 + _a2 + _a3);
+   }
+
+   void operator()(double* x, int n, double* /*tmp*/) const {
+      // Start each pass in the steady state for a constant edge
+      double w1 = x[0], w2 = x[0], w3 = x[0];
+      for( int i = 0; i < n; ++i ) {
+         double const w = _gain*x[i] + _a1*w1 + _a2*w2 + _a3*w3;
+         w3 = w2; w2 = w1; w1 = w;
+         x[i] = w;
+      }
+      w1 = w2 = w3 = x[n-1];
+      for( int i = n-1; i >= 0; --i ) {
+         double const w = _gain*x[i] + _a1*w1 + _a2*w2 + _a3*w3;
+         w3 = w2; w2 = w1; w1 = w;
+         x[i] = w;
+      }
+   }
+
+private:
+   double _gain;
+   double _a1;
+   double _a2;
+   double _a3;
+};
+
+struct StoreFloat {
+   float operator()(double x) const { return static_cast<float>(x); }
+};
+
+void recursiveGaussian(
+   ImageView<float> out,
+   ImageView<float> const& img,
+   float sigma
+) {
+   if( sigma < 0.5f ) {
+      for( int i = 0; i < img.rows(); ++i )
+         std::copy(img[i], img[i] + img.cols()*img.channels(), out[i]);
+      return;
+   }
+
+   separableLines<float, double>(out, img, YoungVanVliet(sigma), StoreFloat());
+}
+
+/*
+ * Three box passes with replicated edges, left unnormalized so no rounding
+ * happens until the line is done. The widths follow Kovesi, "Fast almost-
+ * Gaussian filtering" (DICTA 2010): m passes of the odd width just below
+ * the ideal and the rest 2 wider, so the variance matches sigma closely.
+ */
+class TripleBox {
+public:
+   explicit TripleBox(float sigma) {
+      int const passes = 3;
+      double const ideal = std::sqrt(12.0*sigma*sigma/passes + 1.0);
+      int lower = static_cast<int>(ideal);
+      if( lower % 2 == 0 )
+         --lower;
+      int const m = static_cast<int>(std::floor(
+         (12.0*sigma*sigma - passes*lower*lower - 4.0*passes*lower - 3.0*passes) / (-4.0*lower - 4.0) + 0.5
+      ));
+
+      _weight = 1;
+      for( int p = 0; p < passes; ++p ) {
+         _radius[p] = (p < m ? lower : lower + 2) / 2;
+         _weight *= 2*_radius[p] + 1;
+      }
+   }
+
+   //! Product of the box widths, which the passes scale each sample by
+   int64_t weight() const { return _weight; }
+
+   void operator()(int64_t* x, int n, int64_t* tmp) const {
+      int64_t* src = x;
+      int64_t* dst = tmp;
+      for( int p = 0; p < 3; ++p ) {
+         int const r = _radius[p];
+         int64_t sum = 0;
+         for( int k = -r; k <= r; ++k )
+            sum += src[std::min(std::max(k, 0), n-1)];
+         for( int i = 0; i < n; ++i ) {
+            dst[i] = sum;
+            sum += src[std::min(i + r + 1, n-1)] - src[std::max(i - r, 0)];
+         }
+         std::swap(src, dst);
+      }
+      // Three swaps leave the result in tmp
+      std::copy(src, src + n, x);
+   }
+
+private:
+   int _radius[3];
+   int64_t _weight;
+};
+
+struct StoreUint8 {
+   explicit StoreUint8(int64_t weight) : weight(weight) {}
+   uint8_t operator()(int64_t x) const { return static_cast<uint8_t>((x + weight/2) / weight); }
+   int64_t weight;
+};
+
+void tripleBoxBlur(
+   ImageView<uint8_t> out,
+   ImageView<uint8_t> const& img,
+   float sigma
+) {
+   if( sigma < 0.5f ) {
+      for( int i = 0; i < img.rows(); ++i )
+         std::copy(img[i], img[i] + img.cols()*img.channels(), out[i]);
+      return;
+   }
+
+   TripleBox const box(sigma);
+   separableLines<uint8_t, int64_t>(out, img, box, StoreUint8(box.weight()));
+}
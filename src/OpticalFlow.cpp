@@ -0,0 +1,313 @@
+/*
+ * OpticalFlow.cpp is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#include <ImageProcessing.h>
+
+// Levels stop shrinking at this many rows or columns
+#define PYRAMID_MIN_SIZE 16
+
+void warp(
+   ImageView<float> out,
+   ImageView<float> const& img,
+   ImageView<float> const& flow
+) {
+   int const rows = img.rows();
+   int const cols = img.cols();
+   int const chans = img.channels();
+
+   int i;
+#pragma omp parallel for shared(out,img,flow) private(i)
+   for( i = 0; i < rows; ++i ) {
+      float* dst = out[i];
+      float const* f = flow[i];
+      for( int j = 0; j < cols; ++j ) {
+         float const y = i + f[j*2+1];
+         float const x = j + f[j*2+0];
+         for( int k = 0; k < chans; ++k )
+            dst[j*chans+k] = sampleBilinear(img, y, x, k);
+      }
+   }
+}
+
+void pyramidDown(
+   ImageView<float> out,
+   ImageView<float> const& img
+) {
+   int const chans = img.channels();
+   // The recursive lowpass replicates edges, so the border stays valid
+   Image<float> blurred(img.rows(), img.cols(), chans);
+   lowpassFilter(blurred, img, 2, LOWPASS_RECURSIVE);
+
+   int i;
+#pragma omp parallel for shared(out,blurred) private(i)
+   for( i = 0; i < out.rows(); ++i ) {
+      float const* src = blurred[2*i];
+      float* dst = out[i];
+      for( int j = 0; j < out.cols(); ++j )
+         for( int k = 0; k < chans; ++k )
+            dst[j*chans+k] = src[2*j*chans+k];
+   }
+}
+
+void gaussianPyramid(
+   std::vector< Image<float> >& pyramid,
+   ImageView<float> const& img,
+   int levels
+) {
+   if( levels < 1 ) {
+      LOGE("A pyramid needs at least 1 level, not " << levels);
+      return;
+   }
+
+   int const chans = img.channels();
+   pyramid.resize(1);
+   pyramid[0].resize(img.rows(), img.cols(), chans);
+   for( int i = 0; i < img.rows(); ++i )
+      std::copy(img[i], img[i] + img.cols()*chans, pyramid[0][i]);
+
+   for( int l = 1; l < levels; ++l ) {
+      Image<float> const& fine = pyramid[l-1];
+      int const rows = (fine.rows() + 1)/2;
+      int const cols = (fine.cols() + 1)/2;
+      if( rows < PYRAMID_MIN_SIZE || cols < PYRAMID_MIN_SIZE )
+         break;
+
+      Image<float> coarse(rows, cols, chans);
+      pyramidDown(coarse, fine);
+      pyramid.push_back(std::move(coarse));
+   }
+}
+
+void pyramidOpticalFlow(
+   ImageView<float> flow,
+   std::vector< Image<float> > const& pyramid0,
+   std::vector< Image<float> > const& pyramid1,
+   int radius
+) {
+   if( pyramid0.empty() || pyramid0.size() != pyramid1.size() ) {
+      LOGE("Pyramids have " << pyramid0.size() << " and " << pyramid1.size() << " levels");
+      return;
+   }
+
+   int const levels = static_cast<int>(pyramid0.size());
+   for( int l = 0; l < levels; ++l ) {
+      Image<float> const& x0 = pyramid0[l];
+      Image<float> const& x1 = pyramid1[l];
+      if( x0.rows() != x1.rows() || x0.cols() != x1.cols() || x0.channels() != x1.channels() ) {
+         LOGE("Pyramid level " << l << " is " << x0.rows() << "x" << x0.cols() << "x" << x0.channels()
+            << " in one frame and " << x1.rows() << "x" << x1.cols() << "x" << x1.channels() << " in the other");
+         return;
+      }
+   }
+   if( flow.rows() != pyramid0[0].rows() || flow.cols() != pyramid0[0].cols() || flow.channels() != 2 ) {
+      LOGE("Flow is " << flow.rows() << "x" << flow.cols() << "x" << flow.channels()
+         << ", expected " << pyramid0[0].rows() << "x" << pyramid0[0].cols() << "x2");
+      return;
+   }
+
+   Image<float> coarse;
+   for( int l = levels-1; l >= 0; --l ) {
+      Image<float> const& x0 = pyramid0[l];
+      Image<float> const& x1 = pyramid1[l];
+      int const rows = x0.rows();
+      int const cols = x0.cols();
+
+      // Flow from the level above, in this level's pixels
+      Image<float> guess(rows, cols, 2);
+      if( l < levels-1 ) {
+         int i;
+#pragma omp parallel for shared(guess,coarse) private(i)
+         for( i = 0; i < rows; ++i ) {
+            for( int j = 0; j < cols; ++j ) {
+               guess[i][j*2+0] = 2.f*sampleBilinear(coarse, 0.5f*i, 0.5f*j, 0);
+               guess[i][j*2+1] = 2.f*sampleBilinear(coarse, 0.5f*i, 0.5f*j, 1);
+            }
+         }
+      }
+
+      // What the guess leaves, between x0 and x1 pulled back onto it
+      Image<float> warped(rows, cols, x1.channels());
+      Image<float> residual(rows, cols, 2);
+      warp(warped, x1, guess);
+      hsOpticalFlow(residual, x0, warped, radius);
+
+      for( int i = 0; i < rows; ++i )
+         for( int j = 0; j < cols*2; ++j )
+            guess[i][j] += residual[i][j];
+      coarse = std::move(guess);
+   }
+
+   for( int i = 0; i < flow.rows(); ++i )
+      std::copy(coarse[i], coarse[i] + coarse.cols()*2, flow[i]);
+}
+
+void pyramidOpticalFlow(
+   ImageView<float> flow,
+   ImageView<float> const& img0,
+   ImageView<float> const& img1,
+   int levels,
+   int radius
+) {
+   std::vector< Image<float> > pyramid0;
+   std::vector< Image<float> > pyramid1;
+   gaussianPyramid(pyramid0, img0, levels);
+   gaussianPyramid(pyramid1, img1, levels);
+   pyramidOpticalFlow(flow, pyramid0, pyramid1, radius);
+}
+
+// Smallest eigenvalue of a trackable structure tensor, as a fraction of its
+// trace. The trace is the window's gradient energy, so this does not depend
+// on the image's value range; an edge or a flat window has a ratio near 0,
+// and a corner with equal gradients both ways has 0.5.
+#define KLT_MIN_EIGENVALUE_RATIO 0.01
+// Refinement stops once a step is this short, in pixels
+#define KLT_EPSILON 0.01f
+
+/*
+ * Lucas-Kanade on one point at one level. The window of x0 around p and its
+ * gradient are fixed; d, the displacement into x1, is refined in place.
+ * Returns false if the window cannot be solved for both directions.
+ */
+static bool trackLevel(
+   Point2f& d,
+   Image<float>& patch,
+   Image<float>& dx,
+   Image<float>& dy,
+   ImageView<float> const& x0,
+   ImageView<float> const& x1,
+   Point2f const& p,
+   int radius,
+   int iterations
+) {
+   int const chans = x0.channels();
+   // One extra sample all around, so the window interior has a gradient
+   int const size = 2*radius + 3;
+
+   patch.resize(size, size, chans);
+   dx.resize(size, size, chans);
+   dy.resize(size, size, chans);
+   for( int m = 0; m < size; ++m )
+      for( int n = 0; n < size; ++n )
+         for( int k = 0; k < chans; ++k )
+            patch[m][n*chans+k] = sampleBilinear(x0, p.y + m - radius - 1, p.x + n - radius - 1, k);
+   gradient(dx, dy, patch);
+
+   double gxx = 0.0, gxy = 0.0, gyy = 0.0;
+   for( int m = 1; m < size-1; ++m ) {
+      for( int s = chans; s < (size-1)*chans; ++s ) {
+         gxx += dx[m][s]*dx[m][s];
+         gxy += dx[m][s]*dy[m][s];
+         gyy += dy[m][s]*dy[m][s];
+      }
+   }
+
+   double const half = 0.5*(gxx + gyy);
+   double const minEig = half - std::sqrt(0.25*(gxx - gyy)*(gxx - gyy) + gxy*gxy);
+   if( !(minEig > KLT_MIN_EIGENVALUE_RATIO*(gxx + gyy)) )
+      return false;
+   double const invDet = 1.0 / (gxx*gyy - gxy*gxy);
+
+   for( int it = 0; it < iterations; ++it ) {
+      double bx = 0.0, by = 0.0;
+      for( int m = 1; m < size-1; ++m ) {
+         float const y = p.y + d.y + m - radius - 1;
+         for( int n = 1; n < size-1; ++n ) {
+            float const x = p.x + d.x + n - radius - 1;
+            for( int k = 0; k < chans; ++k ) {
+               float const e = patch[m][n*chans+k] - sampleBilinear(x1, y, x, k);
+               bx += dx[m][n*chans+k]*e;
+               by += dy[m][n*chans+k]*e;
+            }
+         }
+      }
+
+      float const stepX = static_cast<float>((gyy*bx - gxy*by)*invDet);
+      float const stepY = static_cast<float>((gxx*by - gxy*bx)*invDet);
+      d.x += stepX;
+      d.y += stepY;
+      if( stepX*stepX + stepY*stepY < KLT_EPSILON*KLT_EPSILON )
+         break;
+   }
+   return true;
+}
+
+static bool windowInside(ImageView<float> const& img, Point2f const& p, int radius) {
+   return p.x - radius >= 0.f && p.x + radius <= img.cols() - 1 &&
+          p.y - radius >= 0.f && p.y + radius <= img.rows() - 1;
+}
+
+void trackFeatures(
+   std::vector<Point2f>& next,
+   std::vector<uint8_t>& status,
+   std::vector< Image<float> > const& pyramid0,
+   std::vector< Image<float> > const& pyramid1,
+   std::vector<Point2f> const& points,
+   int radius,
+   int iterations
+) {
+   if( pyramid0.empty() || pyramid0.size() != pyramid1.size() ) {
+      LOGE("Pyramids have " << pyramid0.size() << " and " << pyramid1.size() << " levels");
+      return;
+   }
+   if( radius < 1 ) {
+      LOGE("Tracking window radius must be at least 1, not " << radius);
+      return;
+   }
+
+   int const levels = static_cast<int>(pyramid0.size());
+   int const count = static_cast<int>(points.size());
+   next.resize(count);
+   status.resize(count);
+
+#pragma omp parallel shared(next,status,pyramid0,pyramid1,points)
+   {
+      // Window buffers, reused for every point this thread tracks
+      Image<float> patch;
+      Image<float> dx;
+      Image<float> dy;
+
+#pragma omp for
+      for( int q = 0; q < count; ++q ) {
+         // A coarse level without texture just passes its guess on; only
+         // the finest level decides whether the point is lost
+         Point2f guess;
+         bool tracked = false;
+         for( int l = levels-1; l >= 0; --l ) {
+            float const scale = 1.f / (1 << l);
+            Point2f const p(points[q].x*scale, points[q].y*scale);
+            tracked = trackLevel(guess, patch, dx, dy, pyramid0[l], pyramid1[l], p, radius, iterations);
+            if( l > 0 ) {
+               guess.x *= 2.f;
+               guess.y *= 2.f;
+            }
+         }
+
+         // Windows past the edge only see replicated samples, so their
+         // result cannot be trusted
+         next[q] = Point2f(points[q].x + guess.x, points[q].y + guess.y);
+         tracked = tracked &&
+            windowInside(pyramid0[0], points[q], radius) &&
+            windowInside(pyramid1[0], next[q], radius);
+         status[q] = tracked ? 1 : 0;
+      }
+   }
+}
+
+void trackFeatures(
+   std::vector<Point2f>& next,
+   std::vector<uint8_t>& status,
+   ImageView<float> const& img0,
+   ImageView<float> const& img1,
+   std::vector<Point2f> const& points,
+   int levels,
+   int radius,
+   int iterations
+) {
+   std::vector< Image<float> > pyramid0;
+   std::vector< Image<float> > pyramid1;
+   gaussianPyramid(pyramid0, img0, levels);
+   gaussianPyramid(pyramid1, img1, levels);
+   trackFeatures(next, status, pyramid0, pyramid1, points, radius, iterations);
+}
@@ -0,0 +1,135 @@
+/*
+ * OpticalFlowStream.cpp is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#include <OpticalFlowStream.h>
+#include <ImageProcessing.h>
+
+// Spatial radius of the noise lowpass on each frame
+#define FLOW_LOWPASS_RADIUS 2
+
+OpticalFlowStream::OpticalFlowStream(int radius) :
+   _radius(radius),
+   _frames(0)
+{
+   if( _radius < 1 ) {
+      LOGE("Optical flow radius must be at least 1, not " << _radius);
+      _radius = 1;
+   }
+}
+
+// Zero-filled, as a new Image is, so the border the FIR lowpass and the
+// solve leave unwritten is the same as in hsOpticalFlow()
+static void reshapeZeroed(Image<float>& img, int rows, int cols, int chans) {
+   img.resize(rows, cols, chans);
+   for( int i = 0; i < rows; ++i )
+      std::fill(img[i], img[i] + cols*chans, 0.f);
+}
+
+void OpticalFlowStream::reshape(ImageView<float> const& frame) {
+   int const rows = frame.rows();
+   int const cols = frame.cols();
+   int const chans = frame.channels();
+
+   reshapeZeroed(_smoothed0, rows, cols, chans);
+   reshapeZeroed(_smoothed1, rows, cols, chans);
+   reshapeZeroed(_dx, rows, cols, chans);
+   reshapeZeroed(_dy, rows, cols, chans);
+   reshapeZeroed(_flow, rows, cols, 2);
+   _products.resize(rows, cols, 5);
+   _sums.resize(rows+1, cols+1, 5);
+   lowpassKernels(_kernelX, _kernelY, FLOW_LOWPASS_RADIUS, chans);
+   _frames = 0;
+}
+
+bool OpticalFlowStream::push(ImageView<float> const& frame) {
+   if( frame.rows() != _smoothed1.rows() || frame.cols() != _smoothed1.cols() || frame.channels() != _smoothed1.channels() )
+      reshape(frame);
+
+   // The last frame becomes the previous one; its gradient is still to do
+   std::swap(_smoothed0, _smoothed1);
+   filterSeparable(_smoothed1, frame, _kernelX, _kernelY);
+   ++_frames;
+   if( _frames < 2 )
+      return false;
+
+   gradient(_dx, _dy, _smoothed0);
+   solve();
+   return true;
+}
+
+void OpticalFlowStream::solve() {
+   Image<float> const& x0 = _smoothed0;
+   Image<float> const& x1 = _smoothed1;
+   Image<float> const& dx = _dx;
+   Image<float> const& dy = _dy;
+   Image<float>& products = _products;
+   Image<double>& sums = _sums;
+   Image<float>& flow = _flow;
+   int const radius = _radius;
+   int const rows = _smoothed0.rows();
+   int const cols = _smoothed0.cols();
+   int const chans = _smoothed0.channels();
+   // Regularization parameter (bias flow towards 0)
+   float const gamma = 1e-2 * (2*radius+1)*(2*radius+1)*chans;
+   int i,j,k;
+
+   // | Ix[0]  Iy[0] | [dx;dy] = | It[0] |
+   // | Ix[1]  Iy[1] |           | It[1] |
+   //   ...
+   // | Ix[n]  Iy[n] |           | It[n] |
+   //
+   // A x = b
+   // x = (A^TA)^-1 A^Tb
+   // A^TA = [ \sum_{i=1}^n Ix[i]^2 & \sum{i=1}^n Ix[i]Iy[i] \\ \sum{i=1}^n Ix[i]Iy[i] & \sum{i=1}^n Iy[i]^2 ]
+   // A^Tb = [ \sum_{i=1}^n Ix[i]It[i] \\ \sum_{i=1}^n Iy[i]It[i] ]
+
+   // The five products, summed over channels, as one 5-channel image
+#pragma omp parallel for shared(products,dx,dy,x0,x1) private(i,j,k)
+   for(i = 0; i < rows; ++i) {
+      for(j = 0; j < cols; ++j) {
+         float* p = &products[i][j*5];
+         std::fill(p, p+5, 0.f);
+         for(k = 0; k < chans; ++k) {
+            float const ix = dx[i][j*chans+k];
+            float const iy = dy[i][j*chans+k];
+            float const it = x0[i][j*chans+k] - x1[i][j*chans+k];
+            p[0] += ix*ix;
+            p[1] += ix*iy;
+            p[2] += iy*iy;
+            p[3] += ix*it;
+            p[4] += iy*it;
+         }
+      }
+   }
+
+   // Window sums in constant time, whatever the radius. Doubles keep the
+   // differences of large integral values accurate.
+   integrate(sums, products);
+
+   // Row bands in parallel; each row is one pass over two integral rows
+   int const lastRow = rows - radius;
+   int const lastCol = cols - radius;
+#pragma omp parallel for schedule(static) shared(flow,sums) private(i,j,k)
+   for(i = radius; i < lastRow; ++i) {
+      // The window is [i-radius, i+radius) x [j-radius, j+radius)
+      double const* above = sums[i-radius];
+      double const* below = sums[i+radius];
+      float* out = flow[i];
+      for(j = radius; j < lastCol; ++j) {
+         int const left = (j-radius)*5;
+         int const right = (j+radius)*5;
+         double s[5];
+         for(k = 0; k < 5; ++k)
+            s[k] = boxSum(above, below, left+k, right+k);
+
+         // Closed-form inverse of the regularized, symmetric A
+         double const a = s[0] + gamma;
+         double const c = s[2] + gamma;
+         double const invDet = 1.0 / (a*c - s[1]*s[1]);
+         out[j*2+0] = static_cast<float>((c*s[3] - s[1]*s[4]) * invDet);
+         out[j*2+1] = static_cast<float>((a*s[4] - s[1]*s[3]) * invDet);
+      }
+   }
+}
@@ -0,0 +1,55 @@
+/*
+ * PlanarImage.cpp is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#include <PlanarImage.h>
+#include <Eigen/Dense>
+
+// Apply a 3x3 color matrix to the first three planes of img
+static void transformPlanes(PlanarImage<float>& img, Eigen::Matrix3f const& A) {
+   int const rows = img.rows();
+   int const cols = img.cols();
+   ImageView<float> p0 = img.plane(0);
+   ImageView<float> p1 = img.plane(1);
+   ImageView<float> p2 = img.plane(2);
+
+   float const a00 = A(0,0), a01 = A(0,1), a02 = A(0,2);
+   float const a10 = A(1,0), a11 = A(1,1), a12 = A(1,2);
+   float const a20 = A(2,0), a21 = A(2,1), a22 = A(2,2);
+
+#pragma omp parallel for shared(p0, p1, p2)
+   for(int i = 0; i < rows; ++i) {
+      float* __restrict__ c0 = p0[i];
+      float* __restrict__ c1 = p1[i];
+      float* __restrict__ c2 = p2[i];
+      for(int j = 0; j < cols; ++j) {
+         float const x = c0[j];
+         float const y = c1[j];
+         float const z = c2[j];
+
+         c0[j] = a00*x + a01*y + a02*z;
+         c1[j] = a10*x + a11*y + a12*z;
+         c2[j] = a20*x + a21*y + a22*z;
+      }
+   }
+}
+
+void rgb2xyz(PlanarImage<float>& img) {
+   Eigen::Matrix3f A;
+
+   A << 0.49f, 0.31f, 0.20f, 0.17697f, 0.81240f, 0.01063f, 0.00f, 0.01f, 0.99f;
+   A /= A(1,0);
+
+   transformPlanes(img, A);
+}
+
+void xyz2rgb(PlanarImage<float>& img) {
+   Eigen::Matrix3f A;
+
+   // This is the rgb->xyz matrix. Need its inverse.
+   A << 0.49f, 0.31f, 0.20f, 0.17697f, 0.81240f, 0.01063f, 0.00f, 0.01f, 0.99f;
+   A /= A(1,0);
+
+   transformPlanes(img, A.inverse());
+}
@@ -0,0 +1,414 @@
+/*
+ * Y4m.cpp is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#include <Y4m.h>
+#include <algorithm>
+#include <sstream>
+#include <string.h>
+
+// Longest header or FRAME line we accept
+#define Y4M_MAX_LINE 4096
+
+// Chroma plane shape for a subsampling
+static void chromaShape(Y4mChroma chroma, int width, int height, int* cw, int* ch) {
+   switch( chroma ) {
+   case Y4M_MONO: *cw = 0; *ch = 0; break;
+   case Y4M_420: *cw = (width+1)/2; *ch = (height+1)/2; break;
+   case Y4M_422: *cw = (width+1)/2; *ch = height; break;
+   default: *cw = width; *ch = height; break;
+   }
+}
+
+// log2 of the horizontal and vertical chroma subsampling
+static int chromaShiftX(Y4mChroma chroma) {
+   return (chroma == Y4M_420 || chroma == Y4M_422) ? 1 : 0;
+}
+static int chromaShiftY(Y4mChroma chroma) {
+   return chroma == Y4M_420 ? 1 : 0;
+}
+
+static uint8_t clampByte(int x) {
+   return static_cast<uint8_t>(x < 0 ? 0 : (x > 255 ? 255 : x));
+}
+
+//===================Y4mReader===================
+
+Y4mReader::Y4mReader(std::string const& filename) :
+   _file(filename == "-" ? stdin : fopen(filename.c_str(), "rb")),
+   _ownsFile(filename != "-")
+{
+   if( !_file ) {
+      LOGE("Cannot open " << filename);
+      return;
+   }
+   open();
+}
+
+Y4mReader::Y4mReader(FILE* file) :
+   _file(file),
+   _ownsFile(false)
+{
+   open();
+}
+
+Y4mReader::~Y4mReader() {
+   if( _file && _ownsFile )
+      fclose(_file);
+}
+
+void Y4mReader::open() {
+   _width = _height = 0;
+   _chroma = Y4M_420;
+   _fpsNum = _fpsDen = 0;
+   _fullRange = false;
+
+   // Pipes cannot skip chroma with fseek()
+   _seekable = fseek(_file, 0, SEEK_CUR) == 0;
+
+   if( !readHeader() )
+      return;
+
+   chromaShape(_chroma, _width, _height, &_chromaWidth, &_chromaHeight);
+   _u.resize(static_cast<size_t>(_chromaWidth)*_chromaHeight);
+   _v.resize(_u.size());
+}
+
+bool Y4mReader::readHeader() {
+   char line[Y4M_MAX_LINE];
+
+   if( !fgets(line, sizeof(line), _file) || !strchr(line, '\n') ) {
+      fail("Bad Y4M header");
+      return false;
+   }
+
+   std::istringstream tokens(line);
+   std::string token;
+   tokens >> token;
+   if( token != "YUV4MPEG2" ) {
+      fail("Not a Y4M stream");
+      return false;
+   }
+
+   while( tokens >> token ) {
+      std::string const value = token.substr(1);
+      switch( token[0] ) {
+      case 'W':
+         _width = atoi(value.c_str());
+         break;
+      case 'H':
+         _height = atoi(value.c_str());
+         break;
+      case 'F':
+         sscanf(value.c_str(), "%d:%d", &_fpsNum, &_fpsDen);
+         break;
+      case 'C':
+         // 8-bit 4:2:0 with any chroma siting; 420p10 and friends are deeper
+         if( value == "420" || value == "420jpeg" || value == "420paldv" || value == "420mpeg2" )
+            _chroma = Y4M_420;
+         else if( value == "422" )
+            _chroma = Y4M_422;
+         else if( value == "444" )
+            _chroma = Y4M_444;
+         else if( value == "mono" )
+            _chroma = Y4M_MONO;
+         else {
+            fail(("Unsupported Y4M chroma subsampling C" + value).c_str());
+            return false;
+         }
+         break;
+      case 'X':
+         if( value == "COLORRANGE=FULL" )
+            _fullRange = true;
+         break;
+      default:
+         // Interlacing, aspect ratio and comments do not affect decoding
+         break;
+      }
+   }
+
+   if( _width <= 0 || _height <= 0 ) {
+      fail("Bad Y4M frame size");
+      return false;
+   }
+
+   return true;
+}
+
+bool Y4mReader::readLuma(Image<uint8_t>& y) {
+   char line[Y4M_MAX_LINE];
+
+   if( !_file )
+      return false;
+
+   // The end of the stream is not an error
+   if( !fgets(line, sizeof(line), _file) )
+      return false;
+   if( strncmp(line, "FRAME", 5) != 0 || !strchr(line, '\n') ) {
+      fail("Bad Y4M frame header");
+      return false;
+   }
+
+   y.resize(_height, _width, 1);
+   for( int i = 0; i < _height; ++i ) {
+      if( fread(y[i], 1, _width, _file) != static_cast<size_t>(_width) ) {
+         fail("Truncated Y4M frame");
+         return false;
+      }
+   }
+
+   return true;
+}
+
+bool Y4mReader::readChroma() {
+   if( _u.empty() )
+      return true;
+
+   if( fread(&_u[0], 1, _u.size(), _file) != _u.size() ||
+      fread(&_v[0], 1, _v.size(), _file) != _v.size() ) {
+      fail("Truncated Y4M frame");
+      return false;
+   }
+
+   return true;
+}
+
+bool Y4mReader::readGray(Image<uint8_t>& y) {
+   if( !readLuma(y) )
+      return false;
+   if( _u.empty() )
+      return true;
+
+   if( _seekable ) {
+      if( fseek(_file, 2*static_cast<long>(_u.size()), SEEK_CUR) != 0 ) {
+         fail("Truncated Y4M frame");
+         return false;
+      }
+      return true;
+   }
+
+   return readChroma();
+}
+
+bool Y4mReader::readYuv(Image<uint8_t>& yuv) {
+   if( !readLuma(_luma) || !readChroma() )
+      return false;
+
+   int const rows = _height;
+   int const cols = _width;
+   int const cw = _chromaWidth;
+   int const sx = chromaShiftX(_chroma);
+   int const sy = chromaShiftY(_chroma);
+   bool const mono = _u.empty();
+   Image<uint8_t> const& luma = _luma;
+   std::vector<uint8_t> const& u = _u;
+   std::vector<uint8_t> const& v = _v;
+
+   yuv.resize(rows, cols, 3);
+#pragma omp parallel for shared(yuv, luma, u, v)
+   for( int i = 0; i < rows; ++i ) {
+      uint8_t const* y = luma[i];
+      uint8_t* out = yuv[i];
+      size_t const crow = static_cast<size_t>(i >> sy)*cw;
+
+      for( int j = 0; j < cols; ++j ) {
+         out[3*j+0] = y[j];
+         out[3*j+1] = mono ? 128 : u[crow + (j >> sx)];
+         out[3*j+2] = mono ? 128 : v[crow + (j >> sx)];
+      }
+   }
+
+   return true;
+}
+
+bool Y4mReader::readRgb(Image<uint8_t>& rgb) {
+   if( !readYuv(rgb) )
+      return false;
+
+   // BT.601 in 16.16 fixed point
+   int const yOff = _fullRange ? 0 : 16;
+   int const yMul = _fullRange ? 65536 : 76309;
+   int const vr = _fullRange ? 91881 : 104597;
+   int const ug = _fullRange ? 22553 : 25675;
+   int const vg = _fullRange ? 46802 : 53279;
+   int const ub = _fullRange ? 116130 : 132201;
+   int const rows = rgb.rows();
+   int const cols = rgb.cols();
+
+#pragma omp parallel for shared(rgb)
+   for( int i = 0; i < rows; ++i ) {
+      uint8_t* px = rgb[i];
+      for( int j = 0; j < cols; ++j, px += 3 ) {
+         int const y = yMul*(px[0] - yOff) + 32768;
+         int const u = px[1] - 128;
+         int const v = px[2] - 128;
+
+         px[0] = clampByte((y + vr*v) >> 16);
+         px[1] = clampByte((y - ug*u - vg*v) >> 16);
+         px[2] = clampByte((y + ub*u) >> 16);
+      }
+   }
+
+   return true;
+}
+
+void Y4mReader::fail(char const* msg) {
+   LOGE(msg);
+   if( _file && _ownsFile )
+      fclose(_file);
+   _file = 0;
+}
+
+//===================Y4mWriter===================
+
+Y4mWriter::Y4mWriter(
+   std::string const& filename,
+   int width, int height,
+   Y4mChroma chroma,
+   int fpsNum, int fpsDen
+) :
+   _file(filename == "-" ? stdout : fopen(filename.c_str(), "wb")),
+   _ownsFile(filename != "-"),
+   _width(width),
+   _height(height),
+   _chroma(chroma)
+{
+   static char const* const chromaNames[] = {"mono", "420jpeg", "422", "444"};
+
+   chromaShape(_chroma, _width, _height, &_chromaWidth, &_chromaHeight);
+   _row.resize(std::max(_width, _chromaWidth));
+
+   if( !_file ) {
+      LOGE("Cannot open " << filename);
+      return;
+   }
+
+   if( fprintf(_file, "YUV4MPEG2 W%d H%d F%d:%d Ip A1:1 C%s\n", width, height, fpsNum, fpsDen, chromaNames[chroma]) < 0 ) {
+      LOGE("Write failed");
+      if( _ownsFile )
+         fclose(_file);
+      _file = 0;
+   }
+}
+
+Y4mWriter::~Y4mWriter() {
+   if( !_file )
+      return;
+
+   if( _ownsFile )
+      fclose(_file);
+   else
+      fflush(_file);
+}
+
+bool Y4mWriter::writeGray(ImageView<uint8_t> const& y) {
+   if( !checkShape(y, 1) || !writeBytes("FRAME\n", 6) )
+      return false;
+
+   for( int i = 0; i < _height; ++i )
+      if( !writeBytes(y[i], _width) )
+         return false;
+
+   // Neutral chroma
+   std::fill(_row.begin(), _row.end(), 128);
+   for( int i = 0; i < 2*_chromaHeight; ++i )
+      if( !writeBytes(&_row[0], _chromaWidth) )
+         return false;
+
+   return true;
+}
+
+bool Y4mWriter::writeYuv(ImageView<uint8_t> const& yuv) {
+   return checkShape(yuv, 3) && writeFrame(yuv);
+}
+
+bool Y4mWriter::writeRgb(ImageView<uint8_t> const& rgb) {
+   if( !checkShape(rgb, 3) )
+      return false;
+
+   Image<uint8_t>& yuv = _yuv;
+   int const rows = _height;
+   int const cols = _width;
+
+   // Limited-range BT.601 in 16.16 fixed point
+   yuv.resize(rows, cols, 3);
+#pragma omp parallel for shared(yuv, rgb)
+   for( int i = 0; i < rows; ++i ) {
+      uint8_t const* px = rgb[i];
+      uint8_t* out = yuv[i];
+      for( int j = 0; j < cols; ++j, px += 3, out += 3 ) {
+         int const r = px[0];
+         int const g = px[1];
+         int const b = px[2];
+
+         out[0] = clampByte(16 + ((16829*r + 33039*g + 6416*b + 32768) >> 16));
+         out[1] = clampByte(128 + ((-9714*r - 19070*g + 28784*b + 32768) >> 16));
+         out[2] = clampByte(128 + ((28784*r - 24103*g - 4681*b + 32768) >> 16));
+      }
+   }
+
+   return writeFrame(yuv);
+}
+
+bool Y4mWriter::checkShape(ImageView<uint8_t> const& img, int channels) {
+   if( !_file )
+      return false;
+
+   if( img.rows() != _height || img.cols() != _width || img.channels() != channels ) {
+      LOGE("Frame is " << img.rows() << "x" << img.cols() << "x" << img.channels()
+         << ", expected " << _height << "x" << _width << "x" << channels);
+      return false;
+   }
+
+   return true;
+}
+
+bool Y4mWriter::writeFrame(ImageView<uint8_t> const& yuv) {
+   int const sx = chromaShiftX(_chroma);
+   int const sy = chromaShiftY(_chroma);
+
+   if( !writeBytes("FRAME\n", 6) )
+      return false;
+
+   for( int i = 0; i < _height; ++i ) {
+      uint8_t const* px = yuv[i];
+      for( int j = 0; j < _width; ++j )
+         _row[j] = px[3*j];
+      if( !writeBytes(&_row[0], _width) )
+         return false;
+   }
+
+   // Average each chroma sample's block of full-resolution pixels
+   for( int k = 1; k <= 2 && _chromaWidth > 0; ++k ) {
+      for( int ci = 0; ci < _chromaHeight; ++ci ) {
+         int const i0 = ci << sy;
+         int const i1 = std::min(i0 + (1 << sy), _height);
+         for( int cj = 0; cj < _chromaWidth; ++cj ) {
+            int const j0 = cj << sx;
+            int const j1 = std::min(j0 + (1 << sx), _width);
+            int sum = 0;
+            for( int i = i0; i < i1; ++i )
+               for( int j = j0; j < j1; ++j )
+                  sum += yuv[i][3*j+k];
+            int const n = (i1-i0)*(j1-j0);
+            _row[cj] = static_cast<uint8_t>((sum + n/2)/n);
+         }
+         if( !writeBytes(&_row[0], _chromaWidth) )
+            return false;
+      }
+   }
+
+   return true;
+}
+
+bool Y4mWriter::writeBytes(void const* data, size_t n) {
+   if( fwrite(data, 1, n, _file) == n )
+      return true;
+
+   LOGE("Write failed");
+   if( _ownsFile )
+      fclose(_file);
+   _file = 0;
+   return false;
+}
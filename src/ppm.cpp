@@ -2,9 +2,282 @@
  * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
  */
 
+#include <ppm.h>
 #include <string.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <stdint.h>
+
+//! Size of the block buffers used for ASCII reading and writing
+#define ASCII_BLOCK_SIZE 65536
+
+/*
+ * Buffered tokenizer for the ASCII raster of a P2/P3 file. Reads the file in
+ * large blocks and parses integers straight out of the buffer instead of
+ * going through fscanf() for every sample.
+ */
+struct AsciiReader
+{
+   FILE* file;
+   unsigned char buf[ASCII_BLOCK_SIZE + 8];
+   size_t pos;
+   size_t len;
+   bool eof;
+};
+
+// Move unread bytes to the front of the buffer and fill the rest
+static void asciiRefill(AsciiReader* r)
+{
+   size_t nread;
+
+   memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+   r->len -= r->pos;
+   r->pos = 0;
+
+   if( !r->eof )
+   {
+      nread = fread(r->buf + r->len, 1, ASCII_BLOCK_SIZE - r->len, r->file);
+      if( nread == 0 )
+         r->eof = true;
+      r->len += nread;
+   }
+
+   // Pad with non-digits so 8-byte loads never see stale data
+   memset(r->buf + r->len, ' ', 8);
+}
+
+/*
+ * Number of leading decimal digits in the 8 bytes at p, and their value.
+ * The bytes are handled as one 64-bit word: a byte is a digit iff its high
+ * nibble is 3 and adding 6 keeps it that way.
+ */
+static int swarDigits(const unsigned char* p, unsigned int* value)
+{
+   uint64_t chunk;
+   uint64_t nonDigit;
+   uint64_t v;
+   int n;
+
+   memcpy(&chunk, p, 8);
+   nonDigit = ((chunk & 0xF0F0F0F0F0F0F0F0ull) ^ 0x3030303030303030ull) |
+              (((chunk + 0x0606060606060606ull) & 0xF0F0F0F0F0F0F0F0ull) ^ 0x3030303030303030ull);
+   n = nonDigit ? __builtin_ctzll(nonDigit)/8 : 8;
+   if( n == 0 )
+      return 0;
+
+   // Line the digits up at the top so the low bytes act as leading zeros,
+   // then combine pairs, quads and octets of digits.
+   v = (chunk & 0x0F0F0F0F0F0F0F0Full) << (8*(8-n));
+   v = ((v * 10) + (v >> 8)) & 0x00FF00FF00FF00FFull;
+   v = ((v * 100) + (v >> 16)) & 0x0000FFFF0000FFFFull;
+   v = ((v * 10000) + (v >> 32)) & 0x00000000FFFFFFFFull;
+   *value = static_cast<unsigned int>(v);
+   return n;
+}
+
+/*
+ * Read the next non-negative integer, skipping whitespace and comments.
+ * Returns false at end of file or on a malformed token.
+ */
+static bool asciiNext(AsciiReader* r, unsigned int* value)
+{
+   unsigned int v;
+   int n;
+
+   for(;;)
+   {
+      if( r->pos + 8 > r->len && !r->eof )
+         asciiRefill(r);
+      if( r->pos >= r->len )
+         return false;
+
+      if( isspace(r->buf[r->pos]) )
+         ++r->pos;
+      else if( r->buf[r->pos] == '#' )
+      {
+         while( r->buf[r->pos] != '\n' )
+         {
+            if( ++r->pos >= r->len )
+            {
+               asciiRefill(r);
+               if( r->pos >= r->len )
+                  return false;
+            }
+         }
+      }
+      else
+         break;
+   }
+
+   // Fast path: the whole token is in the next 8 bytes
+   n = swarDigits(r->buf + r->pos, &v);
+   if( n == 0 )
+      return false;
+   r->pos += n;
+
+   // Long tokens and tokens split across a block boundary
+   for(;;)
+   {
+      if( r->pos >= r->len && !r->eof )
+         asciiRefill(r);
+      if( r->pos >= r->len || !isdigit(r->buf[r->pos]) )
+         break;
+      v = 10*v + (r->buf[r->pos++] - '0');
+   }
+
+   *value = v;
+   return true;
+}
+
+// Read n ASCII samples into data. Returns false if the file runs out.
+static bool readAsciiSamples(FILE* file, unsigned char* data, int n)
+{
+   AsciiReader* r = new AsciiReader;
+   unsigned int v = 0;
+   int i;
+   bool ok = true;
+
+   r->file = file;
+   r->pos = r->len = 0;
+   r->eof = false;
+   asciiRefill(r);
+
+   for( i = 0; i < n && ok; ++i )
+   {
+      ok = asciiNext(r, &v);
+      data[i] = static_cast<unsigned char>(v);
+   }
+
+   delete r;
+   return ok;
+}
+
+unsigned char* pnmreadAscii(
+   const char* filename,
+   int* w, int* h, int* channels, int* maxval
+)
+{
+   FILE* file;
+   AsciiReader* r;
+   unsigned char* data = NULL;
+   char magic[2];
+   unsigned int vals[3];
+   unsigned int v;
+   size_t n, i;
+   bool ok;
+
+   *w = *h = *channels = *maxval = 0;
+   if( (file = fopen(filename, "rb")) == NULL )
+      return NULL;
+   if( fread(magic, 1, 2, file) != 2 || magic[0] != 'P' || (magic[1] != '2' && magic[1] != '3') )
+   {
+      fclose(file);
+      return NULL;
+   }
+
+   r = new AsciiReader;
+   r->file = file;
+   r->pos = r->len = 0;
+   r->eof = false;
+   asciiRefill(r);
+
+   // The header fields are whitespace-separated integers like the samples
+   ok = asciiNext(r, &vals[0]) && asciiNext(r, &vals[1]) && asciiNext(r, &vals[2]) &&
+      vals[0] <= (1u<<24) && vals[1] <= (1u<<24) &&
+      vals[2] >= 1 && vals[2] <= 65535;
+
+   if( ok )
+   {
+      *channels = magic[1] == '2' ? 1 : 3;
+      n = static_cast<size_t>(vals[0])*vals[1]*(*channels);
+      data = new unsigned char[vals[2] > 255 ? 2*n : n];
+
+      // Samples above 255 take two big-endian bytes, as in binary files
+      for( i = 0; i < n && ok; ++i )
+      {
+         ok = asciiNext(r, &v) && v <= vals[2];
+         if( vals[2] > 255 )
+         {
+            data[2*i] = static_cast<unsigned char>(v >> 8);
+            data[2*i+1] = static_cast<unsigned char>(v & 0xff);
+         }
+         else
+            data[i] = static_cast<unsigned char>(v);
+      }
+   }
+
+   delete r;
+   fclose(file);
+
+   if( !ok )
+   {
+      fprintf(stderr, "ERROR: %s is not a valid ASCII PGM or PPM file.\n", filename);
+      delete[] data;
+      *w = *h = *channels = *maxval = 0;
+      return NULL;
+   }
+
+   *w = vals[0];
+   *h = vals[1];
+   *maxval = vals[2];
+   return data;
+}
+
+/*
+ * Write h rows of rowSamples ASCII samples each, keeping lines under the 70
+ * characters the format allows. Everything is formatted into memory first and
+ * written with a single fwrite().
+ */
+static bool writeAsciiSamples(
+   FILE* file,
+   const unsigned char* data,
+   int rowSamples, int h, int pitch
+)
+{
+   // At most 3 digits plus a separator per sample, and a newline per row
+   size_t const size = static_cast<size_t>(rowSamples)*h*4 + h + 1;
+   char* out = new char[size];
+   char* p = out;
+   char* lineStart;
+   int i, j;
+   unsigned int v;
+   size_t nwritten;
+
+   for( i = 0; i < h; ++i, data += pitch )
+   {
+      lineStart = p;
+      for( j = 0; j < rowSamples; ++j )
+      {
+         if( p - lineStart > 66 )
+         {
+            p[-1] = '\n';
+            lineStart = p;
+         }
+
+         v = data[j];
+         if( v >= 100 )
+         {
+            *p++ = '0' + v/100;
+            *p++ = '0' + (v/10)%10;
+         }
+         else if( v >= 10 )
+            *p++ = '0' + v/10;
+         *p++ = '0' + v%10;
+         *p++ = ' ';
+      }
+      if( rowSamples > 0 )
+         p[-1] = '\n';
+   }
+
+   nwritten = fwrite(out, 1, p - out, file);
+   delete[] out;
+   return nwritten == static_cast<size_t>(p - out);
+}
 
 unsigned char* pgmread(const char* filename, int* w, int* h)
 {
@@ -14,7 +287,6 @@ unsigned char* pgmread(const char* filename, int* w, int* h)
     int binary;
     int nread;
     int numpix;
-    int i,j,k,int_tmp;
 
     unsigned char* data;
     
@@ -65,6 +337,13 @@ unsigned char* pgmread(const char* filename, int* w, int* h)
     }
     sscanf(line, "%d", &maxval);
     
+    if( maxval < 0 || maxval > 255 )
+    {
+       fprintf(stderr, "Error: maximum value %d is bad.\n", maxval);
+       fclose(file);
+       return NULL;
+    }
+    
     numpix = (*w)*(*h);
     
     if ((data = new unsigned char[numpix]()) == NULL)
@@ -78,24 +357,20 @@ unsigned char* pgmread(const char* filename, int* w, int* h)
        nread = fread( (void*)data, sizeof(unsigned char), numpix, file);
        if( nread != numpix )
        {
-         fprintf(stderr, "Error: read %d/%d pixels.", nread, numpix);
-         exit(1);
+         fprintf(stderr, "Error: read %d/%d pixels.\n", nread, numpix);
+         delete[] data;
+         fclose(file);
+         return NULL;
        }
     }
     else
     {
-       k = 0;
-       for (i = 0; i < (*h); i++)
+       if( !readAsciiSamples(file, data, numpix) )
        {
-          for (j = 0; j < (*w); j++)
-          {
-             if( fscanf(file, "%d", &int_tmp) != 1 )
-             {
-                fprintf(stderr, "ERROR: Something wrong with the file.\n");
-                exit(1);
-             }
-             data[k++] = (unsigned char)int_tmp;
-          }  
+          fprintf(stderr, "ERROR: Something wrong with the file.\n");
+          delete[] data;
+          fclose(file);
+          return NULL;
        }
     }
     
@@ -143,7 +418,6 @@ unsigned char* ppmread(const char* filename, int* w, int* h, int* maxval)
     int binary;
     int nread;
     int numpix;
-    int i,j,k,int_tmp;
 
     unsigned char* data;
     
@@ -197,7 +471,8 @@ unsigned char* ppmread(const char* filename, int* w, int* h, int* maxval)
     if( *maxval < 0 || *maxval > 255 )
     {
        fprintf(stderr, "Error: maximum value %d is bad.\n", *maxval);
-       exit(1);
+       fclose(file);
+       return NULL;
     }
     
     numpix = (*w)*(*h);
@@ -213,24 +488,20 @@ unsigned char* ppmread(const char* filename, int* w, int* h, int* maxval)
        nread = fread( (void*)data, sizeof(unsigned char), numpix*3, file);
        if( nread != numpix*3 )
        {
-          fprintf(stderr, "Error: read %d/%d pixels.", nread/3, numpix);
-          exit(1);
+          fprintf(stderr, "Error: read %d/%d pixels.\n", nread/3, numpix);
+          delete[] data;
+          fclose(file);
+          return NULL;
        }
     }
     else
     {
-       k = 0;
-       for (i = 0; i < (*h); i++)
+       if( !readAsciiSamples(file, data, numpix*3) )
        {
-          for (j = 0; j < (*w)*3; j++)
-          {
-             if( fscanf(file, "%d", &int_tmp) != 1 )
-             {
-                fprintf(stderr, "ERROR: Something wrong with the file.\n");
-                exit(1);
-             }
-             data[k++] = (unsigned char)int_tmp;
-          }  
+          fprintf(stderr, "ERROR: Something wrong with the file.\n");
+          delete[] data;
+          fclose(file);
+          return NULL;
        }
     }
     
@@ -267,7 +538,6 @@ int pgmwrite(
     FILE* file;
     int maxval;
     int nread;
-    int i,j,k;
     
     if ((file = fopen(filename, "w")) == NULL)
     {
@@ -304,14 +574,10 @@ int pgmwrite(
     }
     else
     {
-      printf("Writing to %s as ascii.\n", filename);
-
-      for(i=0; i<h; i++)
+      if( !writeAsciiSamples(file, data, w, h, pitch) )
       {
-        k = 0;
-        for(j=0; j<w; j++)
-          fprintf(file,"%d ", (int)data[k++]);
-        data += pitch;
+        fprintf(stderr, "Error: could not write %s.", filename);
+        exit(1);
       }
     }     
    
@@ -346,7 +612,8 @@ int ppmwrite(
    const char* filename,
    int w, int h, int pitch,
    unsigned char const* data,
-   const char* comment_string
+   const char* comment_string,
+   bool binsave
 )
 {
     FILE* file;
@@ -360,7 +627,10 @@ int ppmwrite(
        return(-1);
     }
 
-    fprintf(file,"P6\n");
+    if (binsave)
+      fprintf(file,"P6\n");
+    else
+      fprintf(file,"P3\n");
     if (comment_string)
       fprintf(file,"# %s\n", comment_string);
     fprintf(file,"%d %d\n", w, h);
@@ -368,16 +638,165 @@ int ppmwrite(
     maxval = 255;
     fprintf(file, "%d\n", maxval);
 
-    while(h--){
-      nread = fwrite(data, sizeof(unsigned char), rowpix, file);
-      if( nread != rowpix )
+    if (binsave)
+    {
+      while(h--){
+        nread = fwrite(data, sizeof(unsigned char), rowpix, file);
+        if( nread != rowpix )
+        {
+          fprintf(stderr, "Error: wrote %d/%d pixels.", nread, rowpix);
+          exit(1);
+        }
+        data += pitch;
+      }
+    }
+    else
+    {
+      if( !writeAsciiSamples(file, data, rowpix, h, pitch) )
       {
-        fprintf(stderr, "Error: wrote %d/%d pixels.", nread, rowpix);
+        fprintf(stderr, "Error: could not write %s.", filename);
         exit(1);
       }
-      data += pitch;
     }
 
     fclose(file);
     return 0;
 }
+
+int pnmchannels(const char* filename)
+{
+   char magic[2];
+   FILE* file = fopen(filename, "rb");
+   size_t nread;
+
+   if( !file )
+      return 0;
+   nread = fread(magic, 1, 2, file);
+   fclose(file);
+
+   if( nread != 2 || magic[0] != 'P' )
+      return 0;
+   switch( magic[1] )
+   {
+   case '2': case '5': return 1;
+   case '3': case '6': return 3;
+   default: return 0;
+   }
+}
+
+/*
+ * Parse a PNM header: the magic number, then width, height and maxval
+ * separated by whitespace and comments, then exactly one whitespace
+ * character. Returns the offset of the first pixel, or 0 on failure.
+ */
+static size_t parsePnmHeader(
+   const unsigned char* buf, size_t len,
+   char* magic, int* w, int* h, int* maxval
+)
+{
+   int vals[3];
+   size_t pos = 2;
+   int k;
+
+   if( len < 2 || buf[0] != 'P' )
+      return 0;
+   *magic = buf[1];
+
+   for( k = 0; k < 3; ++k )
+   {
+      // Skip whitespace and comments
+      while( pos < len && (isspace(buf[pos]) || buf[pos] == '#') )
+      {
+         if( buf[pos] == '#' )
+         {
+            while( pos < len && buf[pos] != '\n' )
+               ++pos;
+         }
+         else
+            ++pos;
+      }
+
+      if( pos >= len || !isdigit(buf[pos]) )
+         return 0;
+
+      vals[k] = 0;
+      while( pos < len && isdigit(buf[pos]) )
+      {
+         vals[k] = 10*vals[k] + (buf[pos] - '0');
+         if( vals[k] > (1<<24) )
+            return 0;
+         ++pos;
+      }
+   }
+
+   // Exactly one whitespace character separates the header from the raster
+   if( pos >= len || !isspace(buf[pos]) )
+      return 0;
+
+   *w = vals[0];
+   *h = vals[1];
+   *maxval = vals[2];
+   return pos + 1;
+}
+
+int pnmmap(const char* filename, PnmMap* map)
+{
+   struct stat st;
+   size_t offset;
+   size_t rasterBytes;
+   char magic = 0;
+   int fd;
+
+   memset(map, 0, sizeof(*map));
+
+   if( (fd = open(filename, O_RDONLY)) < 0 )
+      return -1;
+   if( fstat(fd, &st) != 0 || st.st_size <= 0 )
+   {
+      close(fd);
+      return -1;
+   }
+
+   map->length = st.st_size;
+   map->base = mmap(0, map->length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+   // The mapping keeps its own reference to the file
+   close(fd);
+   if( map->base == MAP_FAILED )
+   {
+      memset(map, 0, sizeof(*map));
+      return -1;
+   }
+
+   offset = parsePnmHeader(
+      static_cast<unsigned char*>(map->base), map->length,
+      &magic, &map->w, &map->h, &map->maxval
+   );
+
+   if( magic == '5' )
+      map->channels = 1;
+   else if( magic == '6' )
+      map->channels = 3;
+
+   // Samples above 255 take two big-endian bytes
+   map->sampleBytes = map->maxval > 255 ? 2 : 1;
+   rasterBytes = static_cast<size_t>(map->w)*map->h*map->channels*map->sampleBytes;
+   if( offset == 0 ||
+      map->channels == 0 ||
+      map->maxval < 1 || map->maxval > 65535 ||
+      offset + rasterBytes > map->length )
+   {
+      pnmunmap(map);
+      return -1;
+   }
+
+   map->data = static_cast<unsigned char*>(map->base) + offset;
+   madvise(map->base, map->length, MADV_SEQUENTIAL);
+   return 0;
+}
+
+void pnmunmap(PnmMap* map)
+{
+   if( map->base )
+      munmap(map->base, map->length);
+   memset(map, 0, sizeof(*map));
+}
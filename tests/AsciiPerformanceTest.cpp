@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include "config.h"
+#include <Image.h>
+#include <ppm.h>
+#include <time.h>
+
+// The fscanf()-based reader that pgmread() used to use for P2 files
+static unsigned char* referencePgmread(const char* filename, int* w, int* h) {
+   char line[256];
+   int maxval, v;
+   FILE* file = fopen(filename, "r");
+
+   if( !file || !fgets(line, 256, file) || !fgets(line, 256, file) )
+      return 0;
+   while( line[0] == '#' )
+      if( !fgets(line, 256, file) )
+         return 0;
+   sscanf(line, "%d %d", w, h);
+   if( !fgets(line, 256, file) )
+      return 0;
+   sscanf(line, "%d", &maxval);
+
+   unsigned char* data = new unsigned char[(*w)*(*h)];
+   for( int i = 0; i < (*w)*(*h); ++i ) {
+      if( fscanf(file, "%d", &v) != 1 )
+         break;
+      data[i] = static_cast<unsigned char>(v);
+   }
+
+   fclose(file);
+   return data;
+}
+
+// The fprintf()-based writer that pgmwrite() used to use for P2 files
+static void referencePgmwrite(const char* filename, int w, int h, int pitch, unsigned char const* data) {
+   FILE* file = fopen(filename, "w");
+
+   fprintf(file, "P2\n%d %d\n255\n", w, h);
+   for( int i = 0; i < h; ++i, data += pitch )
+      for( int j = 0; j < w; ++j )
+         fprintf(file, "%d ", (int)data[j]);
+
+   fclose(file);
+}
+
+int main() {
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena_gray.pgm");
+   char const* filename = "/tmp/pgvl-ascii-perf.pgm";
+   double const megabytes = static_cast<double>(lena.rows())*lena.cols()/(1<<20);
+   int w, h;
+
+   volatile int numLoops = 20;
+   clock_t beg, end;
+
+   beg = clock();
+   for(int i = 0; i < numLoops; ++i)
+      referencePgmwrite(filename, lena.cols(), lena.rows(), lena.rowWidth(), lena[0]);
+   end = clock();
+   printf("fprintf write: %.1f MB/s\n", megabytes*numLoops*CLOCKS_PER_SEC/(end-beg));
+
+   beg = clock();
+   for(int i = 0; i < numLoops; ++i)
+      pgmwrite(filename, lena.cols(), lena.rows(), lena.rowWidth(), lena[0], 0, false);
+   end = clock();
+   printf("pgmwrite:      %.1f MB/s\n", megabytes*numLoops*CLOCKS_PER_SEC/(end-beg));
+
+   beg = clock();
+   for(int i = 0; i < numLoops; ++i)
+      delete[] referencePgmread(filename, &w, &h);
+   end = clock();
+   printf("fscanf read:   %.1f MB/s\n", megabytes*numLoops*CLOCKS_PER_SEC/(end-beg));
+
+   beg = clock();
+   for(int i = 0; i < numLoops; ++i)
+      delete[] pgmread(filename, &w, &h);
+   end = clock();
+   printf("pgmread:       %.1f MB/s\n", megabytes*numLoops*CLOCKS_PER_SEC/(end-beg));
+
+   return 0;
+}
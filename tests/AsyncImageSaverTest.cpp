@@ -0,0 +1,10 @@
+#include "AsyncImageSaverTest.h"
+
+AsyncImageSaverTest::AsyncImageSaverTest() {
+}
+
+void AsyncImageSaverTest::SetUp() {
+}
+
+void AsyncImageSaverTest::TearDown() {
+}
@@ -0,0 +1,74 @@
+#ifndef ASYNCIMAGESAVERTEST_H
+#define ASYNCIMAGESAVERTEST_H
+
+#include <gtest/gtest.h>
+#include "config.h"
+#include <Image.h>
+#include <AsyncImageSaver.h>
+
+class AsyncImageSaverTest : public testing::Test {
+public:
+   AsyncImageSaverTest();
+
+   // From class Test
+   virtual void SetUp();
+   virtual void TearDown();
+
+private:
+};
+
+// Images written in the background match synchronous saves
+TEST_F(AsyncImageSaverTest, save) {
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   AsyncImageSaver saver;
+
+   saver.save(Image<uint8_t>(lena), "/tmp/pgvl-async.0");
+   saver.save(AsyncImageSaver::ImagePtr(new Image<uint8_t>(lena)), "/tmp/pgvl-async.1");
+   saver.flush();
+   EXPECT_EQ( saver.imagesWritten(), 2u );
+   EXPECT_EQ( saver.queuedBytes(), 0u );
+
+   for( int k = 0; k < 2; ++k ) {
+      Image<uint8_t> back(k == 0 ? "/tmp/pgvl-async.0.ppm" : "/tmp/pgvl-async.1.ppm");
+      ASSERT_EQ( back.rows(), lena.rows() );
+      bool different = false;
+      for( int i = 0; i < lena.rows(); ++i )
+         different |= memcmp(back[i], lena[i], lena.cols()*3) != 0;
+      EXPECT_FALSE( different );
+   }
+}
+
+// The queue never holds more than its bound
+TEST_F(AsyncImageSaverTest, backpressure) {
+   Image<uint8_t> img(64, 64, 1);
+   size_t const bytes = img.rowWidth()*img.rows();
+   AsyncImageSaver saver(2*bytes);
+
+   int refused = 0;
+   for( int i = 0; i < 50; ++i ) {
+      Image<uint8_t> frame(img);
+      frame[0][0] = i;
+      if( !saver.trySave(std::move(frame), "/tmp/pgvl-async-bp") ) {
+         // Refused images are handed back intact
+         EXPECT_EQ( frame.rows(), 64 );
+         EXPECT_EQ( frame[0][0], i );
+         ++refused;
+      }
+      EXPECT_LE( saver.queuedBytes(), 2*bytes );
+   }
+   for( int i = 0; i < 20; ++i ) {
+      saver.save(Image<uint8_t>(img), "/tmp/pgvl-async-bp");
+      EXPECT_LE( saver.queuedBytes(), 2*bytes );
+   }
+
+   saver.flush();
+   EXPECT_EQ( saver.imagesWritten(), 70u - refused );
+
+   // Oversized images still go through
+   AsyncImageSaver tiny(1);
+   tiny.save(Image<uint8_t>(img), "/tmp/pgvl-async-big");
+   tiny.flush();
+   EXPECT_EQ( tiny.imagesWritten(), 1u );
+}
+
+#endif /*ASYNCIMAGESAVERTEST_H*/
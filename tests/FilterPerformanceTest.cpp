@@ -0,0 +1,129 @@
+#include <stdio.h>
+#include "config.h"
+#include <Image.h>
+#include <ImageProcessing.h>
+#include <time.h>
+
+static char const* levelName(SimdLevel level) {
+   switch( level ) {
+      case SIMD_SSE2:
+         return "SSE2";
+      case SIMD_SSE41:
+         return "SSE4.1";
+      case SIMD_AVX2:
+         return "AVX2";
+      default:
+         return "scalar";
+   }
+}
+
+// Time the uint8_t filter with each instruction set the CPU has
+static void timeKernel(Image<uint8_t> const& img, Image<uint8_t> const& kern, int shift, char const* what) {
+   Image<uint8_t> out(img.rows(), img.cols(), img.channels());
+   double const megapixels = static_cast<double>(img.rows())*img.cols()/1e6;
+   SimdLevel const best = simdLevel();
+
+   volatile int numLoops = 10;
+   clock_t beg, end;
+
+   for( int level = SIMD_NONE; level <= best; ++level ) {
+      if( setSimdLevel(static_cast<SimdLevel>(level)) != level )
+         continue;
+
+      beg = clock();
+      for(int i = 0; i < numLoops; ++i) {
+         if( shift < 0 )
+            filter(out, img, kern);
+         else
+            filterShift(out, img, kern, shift);
+      }
+      end = clock();
+      printf("%s %-6s: %.1f Mpixel/s\n", what, levelName(static_cast<SimdLevel>(level)), megapixels*numLoops*CLOCKS_PER_SEC/(end-beg));
+   }
+   setSimdLevel(best);
+}
+
+// The generic filter on a 4K frame, where rows no longer fit in cache
+static void timeFloat4k(int ksize) {
+   Image<float> img(2160, 3840, 3);
+   Image<float> out(2160, 3840, 3);
+   Image<float> kern(ksize, ksize, 1);
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols()*3; ++j )
+         img[i][j] = static_cast<float>((i*j) % 7);
+   for( int i = 0; i < ksize; ++i )
+      for( int j = 0; j < ksize; ++j )
+         kern[i][j] = 1.f/(ksize*ksize);
+
+   clock_t beg = clock();
+   filter(out, img, kern);
+   clock_t end = clock();
+   printf("4K float %dx%d:     %.1f Mpixel/s\n", ksize, ksize, img.rows()*img.cols()/1e6*CLOCKS_PER_SEC/(end-beg));
+
+   beg = clock();
+   filterFft(out, img, kern);
+   end = clock();
+   printf("4K float %dx%d fft: %.1f Mpixel/s\n", ksize, ksize, img.rows()*img.cols()/1e6*CLOCKS_PER_SEC/(end-beg));
+}
+
+// lowpassFilter() cost as the radius grows, in each mode
+static void timeLowpass(Image<uint8_t> const& lena) {
+   Image<float> lenaf(lena.rows(), lena.cols(), 3);
+   Image<float> outf(lena.rows(), lena.cols(), 3);
+   Image<uint8_t> out(lena.rows(), lena.cols(), 3);
+   for( int i = 0; i < lena.rows(); ++i )
+      for( int j = 0; j < lena.cols()*3; ++j )
+         lenaf[i][j] = lena[i][j];
+
+   int const radii[] = {4, 16, 64};
+   for( int r = 0; r < 3; ++r ) {
+      clock_t beg = clock();
+      lowpassFilter(outf, lenaf, radii[r]);
+      clock_t mid = clock();
+      lowpassFilter(outf, lenaf, radii[r], LOWPASS_RECURSIVE);
+      clock_t end = clock();
+      printf("lowpass radius %2d float: FIR %.1f ms, recursive %.1f ms\n", radii[r],
+         1e3*(mid-beg)/CLOCKS_PER_SEC, 1e3*(end-mid)/CLOCKS_PER_SEC);
+
+      beg = clock();
+      lowpassFilter(out, lena, radii[r]);
+      mid = clock();
+      lowpassFilter(out, lena, radii[r], LOWPASS_RECURSIVE);
+      end = clock();
+      printf("lowpass radius %2d uint8: FIR %.1f ms, recursive %.1f ms\n", radii[r],
+         1e3*(mid-beg)/CLOCKS_PER_SEC, 1e3*(end-mid)/CLOCKS_PER_SEC);
+   }
+}
+
+int main() {
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+
+   // 16-bit sums: a 5x5 box with 255 meaning 1.0
+   Image<uint8_t> box(5, 5, 3);
+   for( int i = 0; i < 5; ++i )
+      for( int j = 0; j < 5*3; ++j )
+         box[i][j] = 10;
+   timeKernel(lena, box, -1, "5x5 box, 16-bit");
+
+   // 32-bit sums
+   Image<uint8_t> heavy(5, 5, 3);
+   for( int i = 0; i < 5; ++i )
+      for( int j = 0; j < 5*3; ++j )
+         heavy[i][j] = 200;
+   timeKernel(lena, heavy, -1, "5x5 box, 32-bit");
+
+   // Binomial kernel scaled by 256
+   int const binomial[5] = {1, 4, 6, 4, 1};
+   Image<uint8_t> gauss(5, 5, 3);
+   for( int i = 0; i < 5; ++i )
+      for( int j = 0; j < 5*3; ++j )
+         gauss[i][j] = binomial[i]*binomial[j/3];
+   timeKernel(lena, gauss, 8, "5x5 binomial, shift");
+
+   timeLowpass(lena);
+
+   timeFloat4k(7);
+   timeFloat4k(25);
+
+   return 0;
+}
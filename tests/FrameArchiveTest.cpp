@@ -0,0 +1,10 @@
+#include "FrameArchiveTest.h"
+
+FrameArchiveTest::FrameArchiveTest() {
+}
+
+void FrameArchiveTest::SetUp() {
+}
+
+void FrameArchiveTest::TearDown() {
+}
@@ -0,0 +1,132 @@
+#ifndef FRAMEARCHIVETEST_H
+#define FRAMEARCHIVETEST_H
+
+#include <gtest/gtest.h>
+#include "config.h"
+#include <Image.h>
+#include <FrameArchive.h>
+#include <fstream>
+#include <iterator>
+#include <string.h>
+
+class FrameArchiveTest : public testing::Test {
+public:
+   FrameArchiveTest();
+
+   // From class Test
+   virtual void SetUp();
+   virtual void TearDown();
+
+private:
+};
+
+// Frames come back unchanged, aligned, and in any order
+TEST_F(FrameArchiveTest, roundTrip) {
+   Image<uint8_t> office0(TEST_IMAGE_DIR "office.0.ppm");
+   Image<uint8_t> rubic(TEST_IMAGE_DIR "rubic.0.pgm");
+   Image<float> ramp(3, 5, 2);
+   for( int i = 0; i < ramp.rows(); ++i )
+      for( int j = 0; j < ramp.cols()*2; ++j )
+         ramp[i][j] = 0.25f*(i*10 + j);
+
+   {
+      FrameArchiveWriter writer("/tmp/pgvl-archive.pgvl");
+      ASSERT_TRUE( writer.good() );
+      EXPECT_TRUE( writer.append(office0) );
+      EXPECT_TRUE( writer.append(ramp) );
+      // Views with a stride wider than the frame are packed on the way in
+      EXPECT_TRUE( writer.append(rubic.view(1, 30, 2, 20)) );
+      EXPECT_EQ( writer.frameCount(), 3u );
+      EXPECT_TRUE( writer.close() );
+   }
+
+   FrameArchiveReader reader("/tmp/pgvl-archive.pgvl");
+   ASSERT_TRUE( reader.good() );
+   ASSERT_EQ( reader.frameCount(), 3u );
+
+   ImageView<uint8_t> roi = reader.frame<uint8_t>(2);
+   EXPECT_EQ( roi.rows(), 19 );
+   EXPECT_EQ( roi.cols(), 30 );
+   EXPECT_EQ( roi.channels(), 1 );
+   EXPECT_EQ( roi[5][7], rubic[7][8] );
+
+   ImageView<float> f = reader.frame<float>(1);
+   EXPECT_EQ( f.channels(), 2 );
+   EXPECT_EQ( f.rowWidth() % CACHE_LINE_SIZE, 0 );
+   EXPECT_EQ( reinterpret_cast<size_t>(f[0]) % CACHE_LINE_SIZE, 0u );
+   EXPECT_FLOAT_EQ( f[2][7], ramp[2][7] );
+
+   ImageView<uint8_t> frame0 = reader.frame<uint8_t>(0);
+   EXPECT_EQ( frame0.rowWidth(), office0.rowWidth() );
+   bool different = false;
+   for( int i = 0; i < office0.rows(); ++i )
+      different |= memcmp(frame0[i], office0[i], office0.cols()*3) != 0;
+   EXPECT_FALSE( different );
+
+   EXPECT_EQ( reader.info(1).type, FRAME_FLOAT );
+}
+
+// Mismatched types and bad files are rejected
+TEST_F(FrameArchiveTest, errors) {
+   {
+      FrameArchiveWriter writer("/tmp/pgvl-archive-small.pgvl");
+      writer.append(Image<uint16_t>(4, 4, 1));
+   }
+
+   FrameArchiveReader reader("/tmp/pgvl-archive-small.pgvl");
+   ASSERT_TRUE( reader.good() );
+   EXPECT_EQ( reader.frame<float>(0).rows(), 0 );
+   EXPECT_EQ( reader.frame<uint16_t>(1).rows(), 0 );
+   EXPECT_EQ( reader.frame<uint16_t>(0).rows(), 4 );
+
+   FrameArchiveReader notArchive(TEST_IMAGE_DIR "lena.ppm");
+   EXPECT_FALSE( notArchive.good() );
+   EXPECT_EQ( notArchive.frameCount(), 0u );
+
+   FrameArchiveReader missing("/nonexistent.pgvl");
+   EXPECT_FALSE( missing.good() );
+}
+
+// Archives with a damaged index or missing tail are rejected whole
+TEST_F(FrameArchiveTest, corruptHeaders) {
+   {
+      FrameArchiveWriter writer("/tmp/pgvl-archive-corrupt.pgvl");
+      writer.append(Image<float>(4, 5, 3));
+   }
+
+   std::vector<char> bytes;
+   {
+      std::ifstream in("/tmp/pgvl-archive-corrupt.pgvl", std::ios::binary);
+      bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+   }
+   ASSERT_GT( bytes.size(), sizeof(FrameArchiveHeader) + sizeof(FrameInfo) );
+   FrameArchiveHeader header;
+   memcpy(&header, &bytes[0], sizeof(header));
+   ASSERT_EQ( header.frameCount, 1u );
+
+   // Rewrites the archive with its one index entry changed and reopens it
+   auto reopen = [&](void (*damage)(FrameInfo&), size_t length) {
+      std::vector<char> copy(bytes.begin(), bytes.begin() + length);
+      if( damage )
+         damage(*reinterpret_cast<FrameInfo*>(&copy[header.indexOffset]));
+      std::ofstream out("/tmp/pgvl-archive-corrupt2.pgvl", std::ios::binary);
+      out.write(&copy[0], copy.size());
+      out.close();
+      return FrameArchiveReader("/tmp/pgvl-archive-corrupt2.pgvl").good();
+   };
+
+   EXPECT_TRUE( reopen(0, bytes.size()) );
+   // Rows narrower than cols*channels*sizeof(float)
+   EXPECT_FALSE( reopen([](FrameInfo& fi) { fi.rowWidth = fi.cols*fi.channels; }, bytes.size()) );
+   EXPECT_FALSE( reopen([](FrameInfo& fi) { fi.cols = 1 << 30; }, bytes.size()) );
+   // Unknown channel types
+   EXPECT_FALSE( reopen([](FrameInfo& fi) { fi.type = 0; }, bytes.size()) );
+   EXPECT_FALSE( reopen([](FrameInfo& fi) { fi.type = 0x7f7f7f7f; }, bytes.size()) );
+   // Frames past the end of the file
+   EXPECT_FALSE( reopen([](FrameInfo& fi) { fi.rows = 1 << 20; }, bytes.size()) );
+   // Truncated in the index, or in the header itself
+   EXPECT_FALSE( reopen(0, bytes.size() - 1) );
+   EXPECT_FALSE( reopen(0, sizeof(FrameArchiveHeader) - 1) );
+}
+
+#endif /*FRAMEARCHIVETEST_H*/
@@ -0,0 +1,10 @@
+#include "FrameSequenceReaderTest.h"
+
+FrameSequenceReaderTest::FrameSequenceReaderTest() {
+}
+
+void FrameSequenceReaderTest::SetUp() {
+}
+
+void FrameSequenceReaderTest::TearDown() {
+}
@@ -0,0 +1,59 @@
+#ifndef FRAMESEQUENCEREADERTEST_H
+#define FRAMESEQUENCEREADERTEST_H
+
+#include <gtest/gtest.h>
+#include "config.h"
+#include <Image.h>
+#include <FrameSequenceReader.h>
+
+class FrameSequenceReaderTest : public testing::Test {
+public:
+   FrameSequenceReaderTest();
+
+   // From class Test
+   virtual void SetUp();
+   virtual void TearDown();
+
+private:
+};
+
+// Frames come back in order and match synchronous loads
+TEST_F(FrameSequenceReaderTest, readsSequence) {
+   Image<uint8_t> office0(TEST_IMAGE_DIR "office.0.ppm");
+   Image<uint8_t> office1(TEST_IMAGE_DIR "office.1.ppm");
+   FrameSequenceReader<uint8_t> reader(TEST_IMAGE_DIR "office.%d.ppm");
+
+   Image<uint8_t> const* frame = reader.next();
+   ASSERT_TRUE( frame != 0 );
+   EXPECT_EQ( frame->rows(), office0.rows() );
+   EXPECT_EQ( frame->cols(), office0.cols() );
+   EXPECT_EQ( (*frame)[20][30], office0[20][30] );
+
+   frame = reader.next();
+   ASSERT_TRUE( frame != 0 );
+   EXPECT_EQ( (*frame)[40][50], office1[40][50] );
+
+   // No office.2.ppm
+   EXPECT_TRUE( reader.next() == 0 );
+   EXPECT_TRUE( reader.next() == 0 );
+   EXPECT_EQ( reader.framesRead(), 2 );
+   EXPECT_LE( reader.stalls(), 3 );
+   EXPECT_GE( reader.stallSeconds(), 0.0 );
+}
+
+// The frame limit, typed decoding and a shallow ring
+TEST_F(FrameSequenceReaderTest, limits) {
+   FrameSequenceReader<float, 1> reader(TEST_IMAGE_DIR "rubic.%d.pgm", 0, 1, 2);
+
+   Image<float, 1> const* frame = reader.next();
+   ASSERT_TRUE( frame != 0 );
+   EXPECT_GT( frame->rows(), 0 );
+   EXPECT_TRUE( reader.next() == 0 );
+
+   // Stopping early joins the thread cleanly
+   FrameSequenceReader<uint8_t> unused(TEST_IMAGE_DIR "rubic.%d.pgm", 1);
+   FrameSequenceReader<uint8_t> missing("/nonexistent/%d.pgm");
+   EXPECT_TRUE( missing.next() == 0 );
+}
+
+#endif /*FRAMESEQUENCEREADERTEST_H*/
@@ -0,0 +1,10 @@
+#include "ImageAllocatorTest.h"
+
+ImageAllocatorTest::ImageAllocatorTest() {
+}
+
+void ImageAllocatorTest::SetUp() {
+}
+
+void ImageAllocatorTest::TearDown() {
+}
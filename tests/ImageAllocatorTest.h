@@ -0,0 +1,118 @@
+#ifndef IMAGEALLOCATORTEST_H
+#define IMAGEALLOCATORTEST_H
+
+#include <gtest/gtest.h>
+#include "config.h"
+#include <ImageAllocator.h>
+#include <Image.h>
+#include <ImageProcessing.h>
+
+class ImageAllocatorTest : public testing::Test {
+public:
+   ImageAllocatorTest();
+
+   // From class Test
+   virtual void SetUp();
+   virtual void TearDown();
+
+private:
+};
+
+// Blocks must be cache-line aligned and big enough
+TEST_F(ImageAllocatorTest, alignment) {
+   PoolAllocator pool;
+   size_t sizes[] = {1, 63, 64, 65, 300, 1000, 4097, 512*512*3};
+
+   for( size_t i = 0; i < sizeof(sizes)/sizeof(sizes[0]); ++i ) {
+      size_t capacity = 0;
+      uint8_t* block = pool.allocate(sizes[i], &capacity);
+
+      EXPECT_TRUE( block != 0 );
+      EXPECT_EQ( 0u, reinterpret_cast<size_t>(block) % CACHE_LINE_SIZE );
+      EXPECT_GE( capacity, sizes[i] );
+      // At most a quarter wasted past the first cache line
+      EXPECT_LE( capacity, sizes[i] + sizes[i]/4 + CACHE_LINE_SIZE );
+
+      pool.deallocate(block, capacity);
+   }
+}
+
+// Released blocks are recycled for requests in the same size class
+TEST_F(ImageAllocatorTest, recycles) {
+   PoolAllocator pool;
+   size_t capacity;
+
+   uint8_t* a = pool.allocate(10000, &capacity);
+   EXPECT_EQ( 0u, pool.hits() );
+   EXPECT_EQ( 1u, pool.misses() );
+
+   pool.deallocate(a, capacity);
+   EXPECT_EQ( capacity, pool.cachedBytes() );
+
+   uint8_t* b = pool.allocate(9999, &capacity);
+   EXPECT_EQ( a, b );
+   EXPECT_EQ( 1u, pool.hits() );
+   EXPECT_EQ( 1u, pool.misses() );
+   EXPECT_EQ( 0u, pool.cachedBytes() );
+
+   pool.deallocate(b, capacity);
+   pool.release();
+   EXPECT_EQ( 0u, pool.cachedBytes() );
+}
+
+// The pool never holds more than it is allowed to
+TEST_F(ImageAllocatorTest, maxCachedBytes) {
+   PoolAllocator pool(4096);
+   size_t capA, capB;
+
+   uint8_t* a = pool.allocate(4096, &capA);
+   uint8_t* b = pool.allocate(4096, &capB);
+   pool.deallocate(a, capA);
+   pool.deallocate(b, capB);
+
+   EXPECT_EQ( 4096u, pool.cachedBytes() );
+}
+
+// Shrinking an image must not reallocate
+TEST_F(ImageAllocatorTest, resizeReusesCapacity) {
+   PoolAllocator pool;
+   Image<float> img(100, 100, 3, &pool);
+   float* data = img[0];
+   size_t const capacity = img.capacity();
+
+   img.resize(50, 60, 2);
+   EXPECT_EQ( data, img[0] );
+   EXPECT_EQ( capacity, img.capacity() );
+
+   img.resize(100, 100, 3);
+   EXPECT_EQ( data, img[0] );
+   EXPECT_EQ( 1u, pool.misses() );
+}
+
+// Once warmed up, optical flow should not touch the heap for its images
+TEST_F(ImageAllocatorTest, steadyStateFlow) {
+   PoolAllocator pool;
+   ImageAllocator::setDefaultAllocator(&pool);
+   {
+      Image<float> frame0(64, 64, 1);
+      Image<float> frame1(64, 64, 1);
+      Image<float> flow(64, 64, 2);
+
+      for( int i = 0; i < 64; ++i ) {
+         for( int j = 0; j < 64; ++j ) {
+            frame0[i][j] = ((i/8 + j/8) % 2) ? 1.f : 0.f;
+            frame1[i][j] = (((i+1)/8 + j/8) % 2) ? 1.f : 0.f;
+         }
+      }
+
+      hsOpticalFlow(flow, frame0, frame1);
+      pool.resetStats();
+      hsOpticalFlow(flow, frame0, frame1);
+
+      EXPECT_GT( pool.hits(), 0u );
+      EXPECT_EQ( 0u, pool.misses() );
+   }
+   ImageAllocator::setDefaultAllocator(0);
+}
+
+#endif /*IMAGEALLOCATORTEST_H*/
@@ -0,0 +1,10 @@
+#include "ImageBatchTest.h"
+
+ImageBatchTest::ImageBatchTest() {
+}
+
+void ImageBatchTest::SetUp() {
+}
+
+void ImageBatchTest::TearDown() {
+}
@@ -0,0 +1,92 @@
+#ifndef IMAGEBATCHTEST_H
+#define IMAGEBATCHTEST_H
+
+#include <gtest/gtest.h>
+#include "config.h"
+#include <Image.h>
+#include <ImageBatch.h>
+#include <stdio.h>
+#include <sys/stat.h>
+
+class ImageBatchTest : public testing::Test {
+public:
+   ImageBatchTest();
+
+   // From class Test
+   virtual void SetUp();
+   virtual void TearDown();
+
+private:
+};
+
+// Results line up with the file list, and failures are reported in order
+TEST_F(ImageBatchTest, loadImages) {
+   std::vector<std::string> files;
+   files.push_back(TEST_IMAGE_DIR "office.1.ppm");
+   files.push_back("/nonexistent.ppm");
+   files.push_back(TEST_IMAGE_DIR "rubic.0.pgm");
+   files.push_back(TEST_IMAGE_DIR "lena.ppm");
+
+   std::vector< Image<uint8_t> > images;
+   std::vector<std::string> failed;
+   EXPECT_EQ( loadImages(images, files, &failed), 3u );
+   ASSERT_EQ( images.size(), 4u );
+   ASSERT_EQ( failed.size(), 1u );
+   EXPECT_EQ( failed[0], "/nonexistent.ppm" );
+
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   Image<uint8_t> rubic(TEST_IMAGE_DIR "rubic.0.pgm");
+   EXPECT_EQ( images[1].rows(), 0 );
+   EXPECT_EQ( images[2].channels(), 1 );
+   EXPECT_EQ( images[2][5][9], rubic[5][9] );
+   EXPECT_EQ( images[3].rows(), 512 );
+   EXPECT_EQ( images[3][100][200], lena[100][200] );
+
+   // Reloading into the same vector keeps the buffers
+   uint8_t const* buffer = images[3][0];
+   loadImages(images, files);
+   EXPECT_EQ( images[3][0], buffer );
+
+   // Grayscale files do not fit a 3-channel image
+   std::vector< Image<uint8_t, 3> > color;
+   failed.clear();
+   EXPECT_EQ( loadImages(color, files, &failed), 2u );
+   EXPECT_EQ( failed.size(), 2u );
+}
+
+// Directories are filtered by magic number and sorted
+TEST_F(ImageBatchTest, loadDirectory) {
+   std::string const dir("/tmp/pgvl-batch");
+   mkdir(dir.c_str(), 0755);
+
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena_gray.pgm");
+   Image<uint8_t> office(TEST_IMAGE_DIR "office.0.ppm");
+   office.save(dir + "/b");
+   pgmwrite((dir + "/a.ascii").c_str(), lena.cols(), lena.rows(), lena.rowWidth(), lena[0], 0, false);
+
+   FILE* f = fopen((dir + "/c.txt").c_str(), "w");
+   fprintf(f, "not an image\n");
+   fclose(f);
+   f = fopen((dir + "/d.ppm").c_str(), "w");
+   fprintf(f, "P6\n100 100\n255\ntruncated");
+   fclose(f);
+
+   std::vector< Image<uint8_t> > images;
+   std::vector<std::string> names;
+   std::vector<std::string> failed;
+   EXPECT_EQ( loadDirectory(images, dir, &names, &failed), 2u );
+   ASSERT_EQ( names.size(), 3u );
+   EXPECT_EQ( names[0], dir + "/a.ascii" );
+   EXPECT_EQ( names[1], dir + "/b.ppm" );
+   EXPECT_EQ( names[2], dir + "/d.ppm" );
+   ASSERT_EQ( failed.size(), 1u );
+   EXPECT_EQ( failed[0], dir + "/d.ppm" );
+
+   EXPECT_EQ( images[0][300][10], lena[300][10] );
+   EXPECT_EQ( images[1].channels(), 3 );
+   EXPECT_EQ( images[2].rows(), 0 );
+
+   EXPECT_TRUE( listDirectory("/nonexistent").empty() );
+}
+
+#endif /*IMAGEBATCHTEST_H*/
@@ -77,6 +77,140 @@ TEST_F(ImageProcessingTest, integrateSquare) {
    EXPECT_EQ( 0 + 1 + 4 + 9 + 16 + 25, img[1][2] );
 }
 
+// In-place integration of a non-byte type stays inside each row
+TEST_F(ImageProcessingTest, integrateFloat) {
+   Image<float> img(5, 7, 2);
+   Image<float> expected(5, 7, 2);
+   for( int i = 0; i < 5; ++i )
+      for( int j = 0; j < 7*2; ++j )
+         img[i][j] = static_cast<float>((i*3 + j) % 5);
+
+   for( int i = 0; i < 5; ++i ) {
+      for( int j = 0; j < 7*2; ++j ) {
+         float sum = 0.f;
+         for( int m = 0; m <= i; ++m )
+            for( int n = j%2; n <= j; n += 2 )
+               sum += img[m][n];
+         expected[i][j] = sum;
+      }
+   }
+
+   integrate(img);
+   for( int i = 0; i < 5; ++i )
+      for( int j = 0; j < 7*2; ++j )
+         EXPECT_EQ( expected[i][j], img[i][j] );
+}
+
+// uint8_t integrals into wider types, with the zero row and column
+TEST_F(ImageProcessingTest, integrateWide) {
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   int const rows = lena.rows();
+   int const cols = lena.cols();
+
+   Image<uint32_t> sum(rows+1, cols+1, 3);
+   Image<uint64_t> sumSq(rows+1, cols+1, 3);
+   Image<double> sumD(rows+1, cols+1, 3);
+   integrate(sum, lena);
+   integrateSquare(sumSq, lena);
+   integrate(sumD, lena);
+
+   for( int j = 0; j < (cols+1)*3; ++j ) {
+      EXPECT_EQ( 0u, sum[0][j] );
+      EXPECT_EQ( 0u, sumSq[0][j] );
+   }
+   for( int i = 0; i <= rows; ++i ) {
+      for( int k = 0; k < 3; ++k ) {
+         EXPECT_EQ( 0u, sum[i][k] );
+         EXPECT_EQ( 0u, sumSq[i][k] );
+      }
+   }
+
+   // Running totals down the last column
+   for( int k = 0; k < 3; ++k ) {
+      uint64_t total = 0, totalSq = 0;
+      for( int i = 0; i < rows; ++i ) {
+         for( int j = 0; j < cols; ++j ) {
+            total += lena[i][j*3+k];
+            totalSq += lena[i][j*3+k]*lena[i][j*3+k];
+         }
+         EXPECT_EQ( total, sum[i+1][cols*3+k] );
+         EXPECT_EQ( totalSq, sumSq[i+1][cols*3+k] );
+         EXPECT_EQ( static_cast<double>(total), sumD[i+1][cols*3+k] );
+      }
+   }
+
+   // A wrongly shaped output is refused
+   Image<uint32_t> wrong(rows, cols, 3);
+   wrong[0][0] = 17;
+   integrate(wrong, lena);
+   EXPECT_EQ( 17u, wrong[0][0] );
+}
+
+// The fused integral matches the separate ones, however many row bands
+TEST_F(ImageProcessingTest, integrateFused) {
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   int const rows = lena.rows();
+   int const cols = lena.cols();
+
+   Image<uint32_t> sum(rows+1, cols+1, 3);
+   Image<uint64_t> sumSq(rows+1, cols+1, 3);
+   integrate(sum, lena);
+   integrateSquare(sumSq, lena);
+
+   int const threads[] = {1, 3, 8};
+   for( int t = 0; t < 3; ++t ) {
+#ifdef _OPENMP
+      int const oldThreads = omp_get_max_threads();
+      omp_set_num_threads(threads[t]);
+#endif
+      Image<uint32_t> fused(rows+1, cols+1, 3);
+      Image<uint64_t> fusedSq(rows+1, cols+1, 3);
+      integrate(fused, fusedSq, lena);
+#ifdef _OPENMP
+      omp_set_num_threads(oldThreads);
+#endif
+
+      for( int i = 0; i <= rows; ++i ) {
+         for( int j = 0; j < (cols+1)*3; ++j ) {
+            ASSERT_EQ( sum[i][j], fused[i][j] ) << threads[t] << " threads";
+            ASSERT_EQ( sumSq[i][j], fusedSq[i][j] ) << threads[t] << " threads";
+         }
+      }
+   }
+}
+
+// boxSum() and boxVariance() against direct sums
+TEST_F(ImageProcessingTest, boxStatistics) {
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   Image<uint32_t> sum(lena.rows()+1, lena.cols()+1, 3);
+   Image<uint64_t> sumSq(lena.rows()+1, lena.cols()+1, 3);
+   integrate(sum, lena);
+   integrateSquare(sumSq, lena);
+
+   Rect const rects[] = {
+      Rect(0, 0, 0, 0),
+      Rect(0, lena.cols()-1, 0, lena.rows()-1),
+      Rect(17, 40, 300, 301),
+      Rect(lena.cols()-5, lena.cols()-1, 2, 90)
+   };
+   for( int r = 0; r < 4; ++r ) {
+      Rect const& rect = rects[r];
+      for( int k = 0; k < 3; ++k ) {
+         double total = 0.0, totalSq = 0.0;
+         for( int i = rect.top; i <= rect.bottom; ++i ) {
+            for( int j = rect.left; j <= rect.right; ++j ) {
+               double const v = lena[i][j*3+k];
+               total += v;
+               totalSq += v*v;
+            }
+         }
+         double const mean = total / rect.area();
+         EXPECT_EQ( total, boxSum(sum, rect, k) );
+         EXPECT_NEAR( totalSq/rect.area() - mean*mean, boxVariance(sum, sumSq, rect, k), 1e-6 );
+      }
+   }
+}
+
 TEST_F(ImageProcessingTest, filter) {
 
    // img:
@@ -110,6 +244,407 @@ TEST_F(ImageProcessingTest, filter) {
    EXPECT_EQ(out[1][1], -4);
 }
 
+// Filtering a view must only touch the view, and match filtering a copy
+TEST_F(ImageProcessingTest, filterView) {
+   Image<float> img(32, 32, 3);
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols()*img.channels(); ++j )
+         img[i][j] = static_cast<float>((i*37 + j*11) % 17);
+
+   Image<float> kern(3, 3, 3);
+   for( int i = 0; i < kern.rows(); ++i )
+      for( int j = 0; j < kern.cols()*kern.channels(); ++j )
+         kern[i][j] = static_cast<float>(i - j%3);
+
+   Image<float> patch;
+   img.patch(patch, 4, 19, 8, 23);
+   Image<float> expected(patch.rows(), patch.cols(), patch.channels());
+   filter(expected, patch, kern);
+
+   Image<float> out(32, 32, 3);
+   filter(out.view(4, 19, 8, 23), img.view(4, 19, 8, 23), kern);
+
+   for( int i = 0; i < out.rows(); ++i ) {
+      for( int j = 0; j < out.cols(); ++j ) {
+         for( int k = 0; k < out.channels(); ++k ) {
+            bool inside = i >= 8 && i <= 23 && j >= 4 && j <= 19;
+            float want = inside ? expected[i-8][(j-4)*3+k] : 0.f;
+            EXPECT_EQ( want, out[i][j*3+k] );
+         }
+      }
+   }
+}
+
+// Blocks must cover the image exactly once and sum like the plain loop
+TEST_F(ImageProcessingTest, filterBlocks) {
+   Image<float> img(150, 1300, 3);
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols()*3; ++j )
+         img[i][j] = static_cast<float>((i*37 + j*11) % 17) - 8.f;
+
+   Image<float> kern(7, 5, 3);
+   for( int i = 0; i < kern.rows(); ++i )
+      for( int j = 0; j < kern.cols()*3; ++j )
+         kern[i][j] = 0.01f*((i*5 + j*3) % 11);
+
+   Image<float> out(img.rows(), img.cols(), 3);
+   filter(out, img, kern, Point(1, 4), 0.5f);
+
+   bool different = false;
+   for( int i = 0; i < img.rows(); ++i ) {
+      for( int j = 0; j < img.cols(); ++j ) {
+         for( int k = 0; k < 3; ++k ) {
+            float want = 0.f;
+            if( i >= 4 && i < img.rows() - 2 && j >= 1 && j < img.cols() - 3 ) {
+               want = 0.5f;
+               for( int m = 0; m < 7; ++m )
+                  for( int n = 0; n < 5; ++n )
+                     want += kern[m][n*3+k] * img[i+m-4][(j+n-1)*3+k];
+            }
+            different |= want != out[i][j*3+k];
+         }
+      }
+   }
+   EXPECT_FALSE( different );
+}
+
+// A one-channel kernel applies to every channel
+TEST_F(ImageProcessingTest, filterBroadcast) {
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   Image<uint8_t> kern1(3, 3, 1);
+   Image<uint8_t> kern3(3, 3, 3);
+   for( int i = 0; i < 3; ++i ) {
+      for( int j = 0; j < 3; ++j ) {
+         kern1[i][j] = static_cast<uint8_t>(10 + 7*i + 3*j);
+         for( int k = 0; k < 3; ++k )
+            kern3[i][j*3+k] = kern1[i][j];
+      }
+   }
+
+   Image<uint8_t> expected(lena.rows(), lena.cols(), 3);
+   Image<uint8_t> actual(lena.rows(), lena.cols(), 3);
+   filter(expected, lena, kern3);
+   filter(actual, lena, kern1);
+
+   bool different = false;
+   for( int i = 0; i < lena.rows(); ++i )
+      different |= memcmp(expected[i], actual[i], lena.cols()*3) != 0;
+   EXPECT_FALSE( different );
+
+   Image<float> img(20, 30, 3);
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols()*3; ++j )
+         img[i][j] = static_cast<float>((i*j) % 13);
+   Image<float> kernf1(1, 3, 1);
+   Image<float> kernf3(1, 3, 3);
+   for( int j = 0; j < 3; ++j ) {
+      kernf1[0][j] = 0.25f*(j+1);
+      for( int k = 0; k < 3; ++k )
+         kernf3[0][j*3+k] = kernf1[0][j];
+   }
+   Image<float> expectedf(20, 30, 3);
+   Image<float> actualf(20, 30, 3);
+   filter(expectedf, img, kernf3);
+   filter(actualf, img, kernf1);
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols()*3; ++j )
+         EXPECT_EQ( expectedf[i][j], actualf[i][j] );
+}
+
+// Compare filterFft() with filter() within float rounding
+static void checkFilterFft(int rows, int cols, int chans, int krows, int kcols, int kchans) {
+   Image<float> img(rows, cols, chans);
+   for( int i = 0; i < rows; ++i )
+      for( int j = 0; j < cols*chans; ++j )
+         img[i][j] = static_cast<float>((i*37 + j*11) % 17) - 8.f;
+
+   Image<float> kern(krows, kcols, kchans);
+   for( int i = 0; i < krows; ++i )
+      for( int j = 0; j < kcols*kchans; ++j )
+         kern[i][j] = 0.01f*((i*5 + j*3) % 11) - 0.03f;
+
+   Point const anchor(kcols/3, krows-1);
+   Image<float> expected(rows, cols, chans);
+   Image<float> actual(rows, cols, chans);
+   filter(expected, img, kern, anchor, 1.5f);
+   filterFft(actual, img, kern, anchor, 1.5f);
+
+   float maxErr = 0.f;
+   for( int i = 0; i < rows; ++i )
+      for( int j = 0; j < cols*chans; ++j )
+         maxErr = std::max(maxErr, std::abs(expected[i][j] - actual[i][j]));
+   EXPECT_LT( maxErr, 1e-3f ) << rows << "x" << cols << "x" << chans << " image, "
+      << krows << "x" << kcols << "x" << kchans << " kernel";
+}
+
+TEST_F(ImageProcessingTest, filterFft) {
+   // Several tiles each way, including partial ones
+   checkFilterFft(300, 410, 1, 21, 17, 1);
+   checkFilterFft(150, 200, 3, 9, 31, 3);
+   // One-channel kernel on a three-channel image
+   checkFilterFft(100, 90, 3, 15, 15, 1);
+   // Image smaller than a tile, and a 1D kernel
+   checkFilterFft(40, 50, 2, 1, 25, 2);
+}
+
+// Fixed and dynamic channel counts must give identical results
+TEST_F(ImageProcessingTest, fixedChannelFilter) {
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   Image<uint8_t, 3> fixedLena(TEST_IMAGE_DIR "lena.ppm");
+
+   Image<uint8_t> lpf(lena.rows(), lena.cols(), lena.channels());
+   Image<uint8_t, 3> fixedLpf(lena.rows(), lena.cols());
+   lowpassFilter(lpf, lena, 3);
+   lowpassFilter(fixedLpf, fixedLena, 3);
+
+   bool different = false;
+   for( int i = 0; i < lena.rows(); ++i )
+      for( int j = 0; j < lena.cols()*3; ++j )
+         different |= (lpf[i][j] != fixedLpf[i][j]);
+   EXPECT_FALSE( different );
+}
+
+// A separable filter matches filtering with each kernel in turn
+TEST_F(ImageProcessingTest, filterSeparable) {
+   Image<float> img(70, 41, 3);
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols()*img.channels(); ++j )
+         img[i][j] = static_cast<float>((i*37 + j*11) % 17);
+
+   Image<float> kx(1, 5, 3);
+   Image<float> ky(4, 1, 3);
+   for( int j = 0; j < 5*3; ++j )
+      kx[0][j] = 0.1f*(j%7) - 0.2f;
+   for( int i = 0; i < 4; ++i )
+      for( int k = 0; k < 3; ++k )
+         ky[i][k] = 0.3f*i - 0.1f*k;
+
+   // Off-center anchor and a delta
+   Image<float> tmp(img.rows(), img.cols(), 3);
+   Image<float> expected(img.rows(), img.cols(), 3);
+   Image<float> actual(img.rows(), img.cols(), 3);
+   filter(tmp, img, kx, Point(1, 0));
+   filter(expected, tmp, ky, Point(0, 3), 2.f);
+   filterSeparable(actual, img, kx, ky, Point(1, 3), 2.f);
+
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols()*3; ++j ) {
+         // Columns 1-37 and rows 3-69 have the whole kernel inside
+         bool const valid = i >= 3 && j >= 1*3 && j < 38*3;
+         EXPECT_EQ( valid ? expected[i][j] : 0.f, actual[i][j] );
+      }
+
+   // uint8_t rounds like two calls to filter()
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   Image<uint8_t> kx8(1, 3, 3);
+   Image<uint8_t> ky8(3, 1, 3);
+   for( int k = 0; k < 3; ++k ) {
+      kx8[0][0*3+k] = 60; kx8[0][1*3+k] = 130; kx8[0][2*3+k] = 65;
+      ky8[0][k] = 50; ky8[1][k] = 150; ky8[2][k] = 55;
+   }
+   Image<uint8_t> tmp8(lena.rows(), lena.cols(), 3);
+   Image<uint8_t> expected8(lena.rows(), lena.cols(), 3);
+   Image<uint8_t> actual8(lena.rows(), lena.cols(), 3);
+   filter(tmp8, lena, kx8);
+   filter(expected8.view(1, lena.cols()-2, 0, lena.rows()-1), tmp8.view(1, lena.cols()-2, 0, lena.rows()-1), ky8);
+   filterSeparable(actual8, lena, kx8, ky8);
+
+   bool different = false;
+   for( int i = 0; i < lena.rows(); ++i )
+      different |= memcmp(expected8[i], actual8[i], lena.cols()*3) != 0;
+   EXPECT_FALSE( different );
+
+   // One-channel kernels apply to every channel
+   Image<float> kx1(1, 5, 1);
+   Image<float> ky1(4, 1, 1);
+   Image<float> kx3(1, 5, 3);
+   Image<float> ky3(4, 1, 3);
+   for( int n = 0; n < 5; ++n )
+      for( int k = 0; k < 3; ++k )
+         kx3[0][n*3+k] = kx1[0][n] = 0.1f*n - 0.15f;
+   for( int m = 0; m < 4; ++m )
+      for( int k = 0; k < 3; ++k )
+         ky3[m][k] = ky1[m][0] = 0.25f*m + 0.05f;
+   Image<float> perChannel(img.rows(), img.cols(), 3);
+   Image<float> broadcast(img.rows(), img.cols(), 3);
+   filterSeparable(perChannel, img, kx3, ky3);
+   filterSeparable(broadcast, img, kx1, ky1);
+   different = false;
+   for( int i = 0; i < img.rows(); ++i )
+      different |= memcmp(perChannel[i], broadcast[i], img.cols()*3*sizeof(float)) != 0;
+   EXPECT_FALSE( different );
+
+   // Any other channel count is refused
+   Image<float> kx2(1, 5, 2);
+   Image<float> untouched(img.rows(), img.cols(), 3);
+   filterSeparable(untouched, img, kx2, ky1);
+   filterSeparable(untouched, img, kx1, ky3);
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols()*3; ++j )
+         EXPECT_EQ( untouched[i][j], 0.f );
+}
+
+// Filter with every instruction set and compare against the scalar code
+static void checkUint8Simd(
+   int chans,
+   int krows,
+   int kcols,
+   int kmax,
+   int shift,
+   int delta
+) {
+   Image<uint8_t> img(45, 71, chans);
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols()*chans; ++j )
+         img[i][j] = static_cast<uint8_t>((i*37 + j*11 + i*j) % 256);
+
+   Image<uint8_t> kern(krows, kcols, chans);
+   for( int i = 0; i < krows; ++i )
+      for( int j = 0; j < kcols*chans; ++j )
+         kern[i][j] = static_cast<uint8_t>((i*7 + j*13) % (kmax+1));
+
+   // An odd-sized view at an odd offset, with an off-center anchor
+   Point const anchor(kcols-1, 0);
+   SimdLevel const saved = simdLevel();
+   Image<uint8_t> expected(img.rows(), img.cols(), chans);
+   setSimdLevel(SIMD_NONE);
+   if( shift < 0 )
+      filter(expected.view(3, 69, 1, 40), img.view(3, 69, 1, 40), kern, anchor, delta);
+   else
+      filterShift(expected.view(3, 69, 1, 40), img.view(3, 69, 1, 40), kern, shift, anchor, delta);
+
+   for( int level = SIMD_SSE2; level <= SIMD_AVX2; ++level ) {
+      if( setSimdLevel(static_cast<SimdLevel>(level)) != level )
+         continue;
+
+      Image<uint8_t> actual(img.rows(), img.cols(), chans);
+      if( shift < 0 )
+         filter(actual.view(3, 69, 1, 40), img.view(3, 69, 1, 40), kern, anchor, delta);
+      else
+         filterShift(actual.view(3, 69, 1, 40), img.view(3, 69, 1, 40), kern, shift, anchor, delta);
+
+      bool different = false;
+      for( int i = 0; i < img.rows(); ++i )
+         different |= memcmp(expected[i], actual[i], img.cols()*chans) != 0;
+      EXPECT_FALSE( different ) << "level " << level << ", " << chans << " channels, "
+         << krows << "x" << kcols << " kernel, shift " << shift << ", delta " << delta;
+   }
+   setSimdLevel(saved);
+}
+
+TEST_F(ImageProcessingTest, filterUint8Simd) {
+   int const chans[] = {1, 3, 4};
+   for( int c = 0; c < 3; ++c ) {
+      // Sums fit in 16 bits
+      checkUint8Simd(chans[c], 3, 3, 28, -1, 0);
+      checkUint8Simd(chans[c], 1, 5, 50, -1, 17);
+      // Sums need 32 bits
+      checkUint8Simd(chans[c], 5, 5, 255, -1, 0);
+      checkUint8Simd(chans[c], 3, 4, 200, -1, 100000);
+      // Power-of-two scaling, both widths
+      checkUint8Simd(chans[c], 3, 3, 4, 4, 8);
+      checkUint8Simd(chans[c], 5, 5, 255, 12, 0);
+      // Negative sums stay on the scalar path
+      checkUint8Simd(chans[c], 3, 3, 28, -1, -3000);
+   }
+}
+
+// [1 2 1] scaled by 4 averages exactly
+TEST_F(ImageProcessingTest, filterShift) {
+   Image<uint8_t> img(4, 40, 1);
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols(); ++j )
+         img[i][j] = static_cast<uint8_t>(j*6);
+
+   Image<uint8_t> kern(1, 3, 1);
+   kern[0][0] = 1; kern[0][1] = 2; kern[0][2] = 1;
+
+   Image<uint8_t> out(4, 40, 1);
+   filterShift(out, img, kern, 2);
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 1; j < img.cols()-1; ++j )
+         EXPECT_EQ( j*6, out[i][j] );
+}
+
+// Largest and mean absolute difference away from the FIR kernel's border
+template<class T>
+static void lowpassDifference(Image<T> const& a, Image<T> const& b, int margin, float* maxDiff, float* meanDiff) {
+   double sum = 0.0;
+   long count = 0;
+   *maxDiff = 0.f;
+   for( int i = margin; i < a.rows() - margin; ++i ) {
+      for( int j = margin*a.channels(); j < (a.cols() - margin)*a.channels(); ++j ) {
+         float const d = std::abs(static_cast<float>(a[i][j]) - static_cast<float>(b[i][j]));
+         *maxDiff = std::max(*maxDiff, d);
+         sum += d;
+         ++count;
+      }
+   }
+   *meanDiff = sum / count;
+}
+
+/*
+ * The recursive modes against the float FIR kernel on lena, in grey levels
+ * out of 255, away from the border. Measured at the time of writing:
+ *
+ *   radius  float IIR max/mean  uint8 box max/mean  uint8 FIR max/mean
+ *        8         5.5 / 0.51          2.5 / 0.33         20.4 / 10.9
+ *       24         3.1 / 0.59          2.2 / 0.38         53.9 / 29.8
+ *
+ * The uint8 FIR kernel darkens the image because its quantized taps sum to
+ * less than 255, which is why the uint8 box blur is held to the float FIR.
+ */
+TEST_F(ImageProcessingTest, lowpassRecursive) {
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   Image<float> lenaf(lena.rows(), lena.cols(), 3);
+   for( int i = 0; i < lena.rows(); ++i )
+      for( int j = 0; j < lena.cols()*3; ++j )
+         lenaf[i][j] = lena[i][j];
+
+   int const radii[] = {8, 24};
+   for( int r = 0; r < 2; ++r ) {
+      int const radius = radii[r];
+      int const margin = 3*radius + 1;
+      float maxDiff, meanDiff;
+
+      Image<float> firf(lena.rows(), lena.cols(), 3);
+      Image<float> iirf(lena.rows(), lena.cols(), 3);
+      lowpassFilter(firf, lenaf, radius);
+      lowpassFilter(iirf, lenaf, radius, LOWPASS_RECURSIVE);
+      lowpassDifference(firf, iirf, margin, &maxDiff, &meanDiff);
+      EXPECT_LT( maxDiff, 7.f );
+      EXPECT_LT( meanDiff, 0.8f );
+
+      Image<uint8_t> box(lena.rows(), lena.cols(), 3);
+      Image<float> boxf(lena.rows(), lena.cols(), 3);
+      lowpassFilter(box, lena, radius, LOWPASS_RECURSIVE);
+      for( int i = 0; i < lena.rows(); ++i )
+         for( int j = 0; j < lena.cols()*3; ++j )
+            boxf[i][j] = box[i][j];
+      lowpassDifference(firf, boxf, margin, &maxDiff, &meanDiff);
+      EXPECT_LT( maxDiff, 4.f );
+      EXPECT_LT( meanDiff, 0.6f );
+   }
+
+   // Replicated edges keep a constant image constant everywhere
+   Image<float> flat(40, 30, 1);
+   Image<uint8_t> flat8(40, 30, 1);
+   for( int i = 0; i < 40; ++i ) {
+      for( int j = 0; j < 30; ++j ) {
+         flat[i][j] = 100.f;
+         flat8[i][j] = 100;
+      }
+   }
+   lowpassFilter(flat, flat, 12, LOWPASS_RECURSIVE);
+   lowpassFilter(flat8, flat8, 12, LOWPASS_RECURSIVE);
+   for( int i = 0; i < 40; ++i ) {
+      for( int j = 0; j < 30; ++j ) {
+         EXPECT_NEAR( 100.f, flat[i][j], 1e-3f );
+         EXPECT_EQ( 100, flat8[i][j] );
+      }
+   }
+}
+
 TEST_F(ImageProcessingTest, lowpassFilter) {
    Image<uint8_t> lena(TEST_IMAGE_DIR "lena_gray.pgm");
 
@@ -136,6 +671,201 @@ TEST_F(ImageProcessingTest, opticalFlowToRgb) {
 
    opticalFlowToRgb(flowRgb, flow, 1.f);
    flowRgb.save("/tmp/flowkey");
+
+   // Wrongly shaped outputs are left alone rather than overrun
+   Image<uint8_t> small(rows/2, cols/2, 3);
+   Image<uint8_t> gray(rows, cols, 1);
+   opticalFlowToRgb(small, flow, 1.f);
+   opticalFlowToRgb(gray, flow, 1.f);
+   EXPECT_EQ( small[rows/2-1][(cols/2-1)*3+2], 0 );
+   EXPECT_EQ( gray[rows-1][cols-1], 0 );
+}
+
+// A smooth pattern moved by a subpixel shift, at several window radii
+TEST_F(ImageProcessingTest, hsOpticalFlowRadius) {
+   int const rows = 96;
+   int const cols = 128;
+   float const shiftX = 0.5f;
+   float const shiftY = 0.25f;
+   Image<float> frame0(rows, cols, 1);
+   Image<float> frame1(rows, cols, 1);
+   Image<float> flow(rows, cols, 2);
+   for( int i = 0; i < rows; ++i ) {
+      for( int j = 0; j < cols; ++j ) {
+         frame0[i][j] = 100.f*std::sin(0.3f*j) + 100.f*std::cos(0.25f*i);
+         frame1[i][j] = 100.f*std::sin(0.3f*(j - shiftX)) + 100.f*std::cos(0.25f*(i - shiftY));
+      }
+   }
+
+   int const radii[] = {1, 3, 8};
+   for( int r = 0; r < 3; ++r ) {
+      hsOpticalFlow(flow, frame0, frame1, radii[r]);
+
+      // Away from the lowpass and gradient edge effects
+      double meanX = 0.0, meanY = 0.0;
+      int n = 0;
+      for( int i = 16; i < rows-16; ++i ) {
+         for( int j = 16; j < cols-16; ++j ) {
+            meanX += flow[i][j*2+0];
+            meanY += flow[i][j*2+1];
+            ++n;
+         }
+      }
+      EXPECT_NEAR( shiftX, meanX/n, 0.05 ) << "radius " << radii[r];
+      EXPECT_NEAR( shiftY, meanY/n, 0.05 ) << "radius " << radii[r];
+   }
+}
+
+// Low frequencies to find a large shift with, high ones to confuse one scale
+static float flowPattern(float i, float j) {
+   return 100.f*std::sin(0.08f*j + 0.03f*i) + 100.f*std::cos(0.07f*i) + 60.f*std::sin(0.4f*j)*std::cos(0.35f*i);
+}
+
+// Mean flow away from the edges, where the warp runs out of image
+static void meanFlow(Image<float> const& flow, double* meanX, double* meanY) {
+   int const border = 32;
+   int n = 0;
+   *meanX = *meanY = 0.0;
+   for( int i = border; i < flow.rows()-border; ++i ) {
+      for( int j = border; j < flow.cols()-border; ++j ) {
+         *meanX += flow[i][j*2+0];
+         *meanY += flow[i][j*2+1];
+         ++n;
+      }
+   }
+   *meanX /= n;
+   *meanY /= n;
+}
+
+// A shift too large for one scale, found coarse-to-fine
+TEST_F(ImageProcessingTest, pyramidOpticalFlow) {
+   int const rows = 160;
+   int const cols = 192;
+   float const shiftX = 5.f;
+   float const shiftY = -3.f;
+   Image<float> frame0(rows, cols, 1);
+   Image<float> frame1(rows, cols, 1);
+   Image<float> flow(rows, cols, 2);
+   for( int i = 0; i < rows; ++i ) {
+      for( int j = 0; j < cols; ++j ) {
+         frame0[i][j] = flowPattern(i, j);
+         frame1[i][j] = flowPattern(i - shiftY, j - shiftX);
+      }
+   }
+
+   std::vector< Image<float> > pyramid;
+   gaussianPyramid(pyramid, frame0, 4);
+   ASSERT_EQ( 4u, pyramid.size() );
+   EXPECT_EQ( 80, pyramid[1].rows() );
+   EXPECT_EQ( 96, pyramid[1].cols() );
+   EXPECT_EQ( 20, pyramid[3].rows() );
+
+   double meanX, meanY;
+   pyramidOpticalFlow(flow, frame0, frame1, 1);
+   meanFlow(flow, &meanX, &meanY);
+   EXPECT_GT( std::abs(shiftX - meanX), 1.0 ) << "one level should not reach the shift";
+
+   pyramidOpticalFlow(flow, frame0, frame1, 4);
+   meanFlow(flow, &meanX, &meanY);
+   EXPECT_NEAR( shiftX, meanX, 0.1 );
+   EXPECT_NEAR( shiftY, meanY, 0.1 );
+
+   // A warp by the true flow lines frame1 back up with frame0
+   for( int i = 0; i < rows; ++i ) {
+      for( int j = 0; j < cols; ++j ) {
+         flow[i][j*2+0] = shiftX;
+         flow[i][j*2+1] = shiftY;
+      }
+   }
+   Image<float> warped(rows, cols, 1);
+   warp(warped, frame1, flow);
+   for( int i = 8; i < rows-8; ++i )
+      for( int j = 8; j < cols-8; ++j )
+         ASSERT_NEAR( frame0[i][j], warped[i][j], 1e-2f );
+
+   // Mismatched shapes are refused and leave the output alone
+   std::vector< Image<float> > pyramid0, pyramid1;
+   gaussianPyramid(pyramid0, frame0, 3);
+   gaussianPyramid(pyramid1, frame1, 3);
+   Image<float> big(rows+5, cols+7, 2);
+   pyramidOpticalFlow(big, pyramid0, pyramid1, 4);
+   EXPECT_EQ( 0.f, big[rows+4][(cols+6)*2+1] );
+   EXPECT_EQ( 0.f, big[rows/2][cols] );
+
+   Image<float> untouched(rows, cols, 2);
+   pyramid1[1] = Image<float>(pyramid1[1].rows()-1, pyramid1[1].cols(), 1);
+   pyramidOpticalFlow(untouched, pyramid0, pyramid1, 4);
+   EXPECT_EQ( 0.f, untouched[rows/2][cols] );
+}
+
+// Sparse points follow the same shift pyramidOpticalFlow() finds
+TEST_F(ImageProcessingTest, trackFeatures) {
+   int const rows = 160;
+   int const cols = 192;
+   float const shiftX = 5.f;
+   float const shiftY = -3.f;
+   Image<float> frame0(rows, cols, 1);
+   Image<float> frame1(rows, cols, 1);
+   for( int i = 0; i < rows; ++i ) {
+      for( int j = 0; j < cols; ++j ) {
+         frame0[i][j] = flowPattern(i, j);
+         frame1[i][j] = flowPattern(i - shiftY, j - shiftX);
+      }
+   }
+
+   std::vector<Point2f> points;
+   for( int i = 24; i < rows-24; i += 13 )
+      for( int j = 24; j < cols-24; j += 17 )
+         points.push_back(Point2f(j + 0.25f, i + 0.5f));
+   // One point that moves out of the image
+   points.push_back(Point2f(cols - 2.f, 40.f));
+
+   std::vector<Point2f> next;
+   std::vector<uint8_t> status;
+   trackFeatures(next, status, frame0, frame1, points);
+   ASSERT_EQ( points.size(), next.size() );
+   ASSERT_EQ( points.size(), status.size() );
+   for( size_t q = 0; q+1 < points.size(); ++q ) {
+      ASSERT_EQ( 1, status[q] ) << "point " << q;
+      EXPECT_NEAR( points[q].x + shiftX, next[q].x, 0.05f ) << "point " << q;
+      EXPECT_NEAR( points[q].y + shiftY, next[q].y, 0.05f ) << "point " << q;
+   }
+   EXPECT_EQ( 0, status.back() ) << next.back().x << "," << next.back().y;
+
+   // The value range does not matter; [0,1] images track the same way
+   Image<float> small0(rows, cols, 1);
+   Image<float> small1(rows, cols, 1);
+   for( int i = 0; i < rows; ++i ) {
+      for( int j = 0; j < cols; ++j ) {
+         small0[i][j] = frame0[i][j]/400.f + 0.5f;
+         small1[i][j] = frame1[i][j]/400.f + 0.5f;
+      }
+   }
+   std::vector<Point2f> smallNext;
+   std::vector<uint8_t> smallStatus;
+   trackFeatures(smallNext, smallStatus, small0, small1, points);
+   for( size_t q = 0; q < points.size(); ++q ) {
+      ASSERT_EQ( status[q], smallStatus[q] ) << "point " << q;
+      EXPECT_NEAR( next[q].x, smallNext[q].x, 1e-3f ) << "point " << q;
+      EXPECT_NEAR( next[q].y, smallNext[q].y, 1e-3f ) << "point " << q;
+   }
+
+   // Real frames loaded into [0,1] keep most of a grid of points
+   Image<float> rubic0(TEST_IMAGE_DIR "rubic.0.pgm");
+   Image<float> rubic1(TEST_IMAGE_DIR "rubic.1.pgm");
+   std::vector<Point2f> grid;
+   for( int i = 10; i < rubic0.rows()-10; i += 11 )
+      for( int j = 10; j < rubic0.cols()-10; j += 11 )
+         grid.push_back(Point2f(j, i));
+   trackFeatures(next, status, rubic0, rubic1, grid);
+   int const tracked = std::count(status.begin(), status.end(), 1);
+   EXPECT_GT( tracked, 3*static_cast<int>(grid.size())/4 ) << tracked << " of " << grid.size();
+
+   // Nothing to lock onto in a flat image
+   Image<float> flat(rows, cols, 1);
+   trackFeatures(next, status, flat, flat, points);
+   for( size_t q = 0; q < points.size(); ++q )
+      EXPECT_EQ( 0, status[q] );
 }
 
 TEST_F(ImageProcessingTest, hsOpticalFlow) {
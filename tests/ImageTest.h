@@ -5,6 +5,7 @@
 #include "config.h"
 #include <ppm.h>
 #include <Image.h>
+#include <MappedImage.h>
 
 class ImageTest : public testing::Test {
 public:
@@ -45,6 +46,54 @@ TEST_F(ImageTest, loadsPpm) {
    delete[] data;
 }
 
+// ASCII files with comments, odd spacing and long tokens
+TEST_F(ImageTest, loadsAsciiPgm) {
+   FILE* f = fopen("/tmp/pgvl-tokens.pgm", "w");
+   fprintf(f, "P2\n# comment\n4 2\n255\n");
+   fprintf(f, "0 1\t\t22\n# a comment in the raster\n 255\n000000000007 100\r\n19 2");
+   fclose(f);
+
+   int w = 0;
+   int h = 0;
+   unsigned char* data = pgmread("/tmp/pgvl-tokens.pgm", &w, &h);
+   EXPECT_TRUE( data != 0 );
+   EXPECT_EQ( w, 4 );
+   EXPECT_EQ( h, 2 );
+
+   unsigned char const expected[] = {0, 1, 22, 255, 7, 100, 19, 2};
+   for( int i = 0; i < 8; ++i )
+      EXPECT_EQ( expected[i], data[i] );
+
+   delete[] data;
+}
+
+// Writing ASCII and reading it back is lossless
+TEST_F(ImageTest, asciiRoundTrip) {
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   ppmwrite("/tmp/pgvl-ascii.ppm", lena.cols(), lena.rows(), lena.rowWidth(), lena[0], "ascii", false);
+
+   // Lines must stay within the 70 characters the format allows
+   FILE* f = fopen("/tmp/pgvl-ascii.ppm", "r");
+   char line[256];
+   size_t longest = 0;
+   while( fgets(line, sizeof(line), f) )
+      longest = std::max(longest, strlen(line));
+   fclose(f);
+   EXPECT_LE( longest, 71u );
+
+   int w, h, maxval;
+   unsigned char* data = ppmread("/tmp/pgvl-ascii.ppm", &w, &h, &maxval);
+   EXPECT_EQ( w, 512 );
+   EXPECT_EQ( h, 512 );
+
+   bool different = false;
+   for( int i = 0; i < h; ++i )
+      different |= memcmp(lena[i], data + i*w*3, w*3) != 0;
+   EXPECT_FALSE( different );
+
+   delete[] data;
+}
+
 // Test Image loading
 TEST_F(ImageTest, loadsImage) {
    Image<uint8_t> ppm(TEST_IMAGE_DIR "lena.ppm");
@@ -127,6 +176,222 @@ TEST_F(ImageTest, patch) {
    EXPECT_EQ( different, false );
 }
 
+// Views share memory with their parent
+TEST_F(ImageTest, view) {
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   ImageView<uint8_t> roi = lena.view(10, 19, 20, 39);
+
+   EXPECT_EQ( roi.rows(), 20 );
+   EXPECT_EQ( roi.cols(), 10 );
+   EXPECT_EQ( roi.channels(), 3 );
+   EXPECT_EQ( roi.rowWidth(), lena.rowWidth() );
+   EXPECT_EQ( roi[0], lena[20] + 10*3 );
+
+   roi[1][2] = 0x42;
+   EXPECT_EQ( lena[21][10*3+2], 0x42 );
+
+   // Views of views
+   ImageView<uint8_t> sub = roi.view(1, 2, 1, 2);
+   EXPECT_EQ( sub[0], lena[21] + 11*3 );
+
+   // Out of bounds
+   EXPECT_EQ( lena.view(0, 512, 0, 10).rows(), 0 );
+   EXPECT_EQ( roi.view(0, 10, 0, 10).cols(), 0 );
+}
+
+// Const images and views cannot be handed out as writable views
+TEST_F(ImageTest, constViews) {
+   static_assert( std::is_convertible<Image<float>&, ImageView<float> >::value, "writable image as output" );
+   static_assert( !std::is_convertible<Image<float> const&, ImageView<float> >::value, "const image as output" );
+   static_assert( !std::is_convertible<ImageView<float> const&, ImageView<float> >::value, "const view as output" );
+   static_assert( !std::is_convertible<Image<float, 3> const&, ImageView<float> >::value, "const fixed image as output" );
+   static_assert( std::is_convertible<Image<float, 3> const&, ImageView<float> const&>::value, "const fixed image as input" );
+   static_assert( std::is_convertible<ImageView<float const>, ImageView<float> const&>::value, "read-only view as input" );
+   static_assert( !std::is_convertible<ImageView<float const>, ImageView<float> >::value, "read-only view as output" );
+
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   Image<uint8_t> const& constLena = lena;
+   ImageView<uint8_t const> roi = constLena.view(10, 19, 20, 39);
+   EXPECT_EQ( roi.rows(), 20 );
+   EXPECT_EQ( roi[0], lena[20] + 10*3 );
+
+   // Read-only views still bind to const& inputs
+   auto corner = [](ImageView<uint8_t> const& in) { return in[0][0]; };
+   EXPECT_EQ( corner(roi), lena[20][10*3] );
+}
+
+// Compile-time channel counts
+TEST_F(ImageTest, fixedChannels) {
+   Image<uint8_t, 3> lena(TEST_IMAGE_DIR "lena.ppm");
+   Image<uint8_t> dynamicLena(TEST_IMAGE_DIR "lena.ppm");
+
+   EXPECT_EQ( lena.rows(), 512 );
+   EXPECT_EQ( lena.channels(), 3 );
+   EXPECT_EQ( lena[100][50*3+2], dynamicLena[100][50*3+2] );
+
+   // Fixed views convert implicitly to dynamic ones, and back explicitly
+   ImageView<uint8_t> dyn = lena;
+   EXPECT_EQ( dyn.channels(), 3 );
+   EXPECT_EQ( dyn[7], lena[7] );
+   ImageView<uint8_t, 3> fixed(dyn);
+   EXPECT_EQ( fixed.view(1, 2, 1, 2)[0], lena[1] + 3 );
+
+   // Channel mismatch gives an empty image
+   Image<uint8_t, 3> gray(TEST_IMAGE_DIR "lena_gray.pgm");
+   EXPECT_EQ( gray.rows(), 0 );
+   EXPECT_EQ( gray.channels(), 3 );
+}
+
+// Colorspace conversions give the same answer for every channel layout
+TEST_F(ImageTest, fixedChannelColorspace) {
+   Image<float, 3> fixed(4, 5);
+   Image<float> dynamic(4, 5, 3);
+   Image<float> rgba(4, 5, 4);
+
+   for( int i = 0; i < 4; ++i ) {
+      for( int j = 0; j < 5; ++j ) {
+         for( int k = 0; k < 3; ++k ) {
+            float v = static_cast<float>((i*5 + j*3 + k*7) % 11) / 11.f;
+            fixed[i][j*3+k] = dynamic[i][j*3+k] = rgba[i][j*4+k] = v;
+         }
+         rgba[i][j*4+3] = 0.5f;
+      }
+   }
+
+   rgb2hsv(fixed);
+   rgb2hsv(dynamic);
+   rgb2hsv(rgba);
+
+   for( int i = 0; i < 4; ++i ) {
+      for( int j = 0; j < 5; ++j ) {
+         for( int k = 0; k < 3; ++k ) {
+            EXPECT_EQ( dynamic[i][j*3+k], fixed[i][j*3+k] );
+            EXPECT_EQ( dynamic[i][j*3+k], rgba[i][j*4+k] );
+         }
+         EXPECT_EQ( rgba[i][j*4+3], 0.5f );
+      }
+   }
+}
+
+// Memory-mapping binary files
+TEST_F(ImageTest, pnmmap) {
+   PnmMap map;
+
+   EXPECT_EQ( 0, pnmmap(TEST_IMAGE_DIR "lena.ppm", &map) );
+   EXPECT_EQ( map.w, 512 );
+   EXPECT_EQ( map.h, 512 );
+   EXPECT_EQ( map.channels, 3 );
+   EXPECT_EQ( map.maxval, 255 );
+   pnmunmap(&map);
+   EXPECT_TRUE( map.base == 0 );
+
+   // ASCII files cannot be mapped
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena_gray.pgm");
+   pgmwrite("/tmp/pgvl-ascii.pgm", lena.cols(), lena.rows(), lena.rowWidth(), lena[0], 0, false);
+   EXPECT_EQ( -1, pnmmap("/tmp/pgvl-ascii.pgm", &map) );
+   EXPECT_EQ( -1, pnmmap("/nonexistent.pgm", &map) );
+
+   // ...but still load through the slow path
+   Image<uint8_t> ascii("/tmp/pgvl-ascii.pgm");
+   EXPECT_EQ( ascii.rows(), 512 );
+   EXPECT_EQ( ascii[300][200], lena[300][200] );
+}
+
+// Decoding into wider types while loading
+TEST_F(ImageTest, typedLoad) {
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   Image<float> lenaFloat(TEST_IMAGE_DIR "lena.ppm");
+
+   EXPECT_EQ( lenaFloat.rows(), 512 );
+   EXPECT_EQ( lenaFloat.channels(), 3 );
+   float maxError = 0.f;
+   for( int i = 0; i < lena.rows(); ++i )
+      for( int j = 0; j < lena.cols()*3; ++j )
+         maxError = std::max(maxError, fabsf(lenaFloat[i][j] - lena[i][j]/255.f));
+   EXPECT_LT( maxError, 1e-6f );
+
+   Image<uint16_t, 3> lena16(TEST_IMAGE_DIR "lena.ppm");
+   EXPECT_EQ( lena16[100][30], lena[100][30] );
+
+   // 16-bit big-endian samples
+   FILE* f = fopen("/tmp/pgvl-16bit.pgm", "wb");
+   unsigned char const raster[] = {0x00, 0x01, 0x12, 0x34, 0xFF, 0xFF, 0x80, 0x00};
+   fprintf(f, "P5\n2 2\n65535\n");
+   fwrite(raster, 1, sizeof(raster), f);
+   fclose(f);
+
+   Image<uint16_t> deep("/tmp/pgvl-16bit.pgm");
+   EXPECT_EQ( deep.rows(), 2 );
+   EXPECT_EQ( deep.cols(), 2 );
+   EXPECT_EQ( deep[0][0], 0x0001 );
+   EXPECT_EQ( deep[0][1], 0x1234 );
+   EXPECT_EQ( deep[1][0], 0xFFFF );
+   EXPECT_EQ( deep[1][1], 0x8000 );
+
+   Image<float> deepFloat("/tmp/pgvl-16bit.pgm");
+   EXPECT_FLOAT_EQ( deepFloat[1][0], 1.f );
+   EXPECT_NEAR( deepFloat[1][1], 0x8000/65535.f, 1e-6f );
+
+   Image<uint8_t> shallow("/tmp/pgvl-16bit.pgm");
+   EXPECT_EQ( shallow[1][0], 255 );
+
+   // MappedImage only views 8-bit data
+   MappedImage mapped("/tmp/pgvl-16bit.pgm");
+   EXPECT_EQ( mapped.rows(), 0 );
+
+   // ASCII files honor their maxval too
+   f = fopen("/tmp/pgvl-16bit-ascii.pgm", "w");
+   fprintf(f, "P2\n2 2\n65535\n1 4660\n65535 32768\n");
+   fclose(f);
+   Image<uint16_t> deepAscii("/tmp/pgvl-16bit-ascii.pgm");
+   ASSERT_EQ( deepAscii.rows(), 2 );
+   EXPECT_EQ( deepAscii[0][0], 0x0001 );
+   EXPECT_EQ( deepAscii[0][1], 0x1234 );
+   EXPECT_EQ( deepAscii[1][0], 0xFFFF );
+   EXPECT_EQ( deepAscii[1][1], 0x8000 );
+
+   f = fopen("/tmp/pgvl-4bit-ascii.pgm", "w");
+   fprintf(f, "P2\n3 1\n15\n0 5 15\n");
+   fclose(f);
+   Image<float> shallowFloat("/tmp/pgvl-4bit-ascii.pgm");
+   ASSERT_EQ( shallowFloat.cols(), 3 );
+   EXPECT_FLOAT_EQ( shallowFloat[0][0], 0.f );
+   EXPECT_FLOAT_EQ( shallowFloat[0][1], 1.f/3.f );
+   EXPECT_FLOAT_EQ( shallowFloat[0][2], 1.f );
+
+   // Samples above maxval are an error rather than wrapped
+   f = fopen("/tmp/pgvl-bad-ascii.pgm", "w");
+   fprintf(f, "P2\n2 1\n15\n3 16\n");
+   fclose(f);
+   Image<uint8_t> bad("/tmp/pgvl-bad-ascii.pgm");
+   EXPECT_EQ( bad.rows(), 0 );
+}
+
+// Zero-copy views of files
+TEST_F(ImageTest, mappedImage) {
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   MappedImage mapped(TEST_IMAGE_DIR "lena.ppm");
+
+   EXPECT_EQ( mapped.rows(), lena.rows() );
+   EXPECT_EQ( mapped.cols(), lena.cols() );
+   EXPECT_EQ( mapped.channels(), 3 );
+   EXPECT_EQ( mapped.maxval(), 255 );
+
+   bool different = false;
+   for( int i = 0; i < lena.rows(); ++i )
+      different |= memcmp(lena[i], mapped[i], lena.cols()*3) != 0;
+   EXPECT_FALSE( different );
+
+   // Writes stay private
+   mapped[0][0] ^= 0xFF;
+   MappedImage again(TEST_IMAGE_DIR "lena.ppm");
+   EXPECT_EQ( again[0][0], lena[0][0] );
+
+   MappedImage moved(std::move(mapped));
+   EXPECT_EQ( mapped.rows(), 0 );
+   EXPECT_EQ( moved[10][10], lena[10][10] );
+}
+
 TEST_F(ImageTest, sdlDisplay) {
    Image<uint8_t> lenaColor(TEST_IMAGE_DIR "lena.ppm");
 
@@ -0,0 +1,95 @@
+#include <stdio.h>
+#include "config.h"
+#include <Image.h>
+#include <ImageProcessing.h>
+#include <time.h>
+
+// integrate(out, img) as it was, scanning rows and then walking down
+// one column at a time
+template<class Acc, class T>
+static void integrateColumns(ImageView<Acc> out, ImageView<T> const& img) {
+   int i,j;
+   int const channels = img.channels();
+   int const samples = img.cols()*channels;
+
+   std::fill(out[0], out[0] + samples + channels, Acc(0));
+#pragma omp parallel for shared(out,img) private(i,j)
+   for( i = 0; i < img.rows(); ++i ) {
+      T const* src = img[i];
+      Acc* dst = out[i+1];
+      for( j = 0; j < channels; ++j )
+         dst[j] = Acc(0);
+      for( j = 0; j < samples; ++j )
+         dst[j+channels] = dst[j] + Acc(src[j]);
+   }
+
+#pragma omp parallel for shared(out) private(i,j)
+   for( j = channels; j < samples + channels; ++j )
+      for( i = 2; i <= img.rows(); ++i )
+         out[i][j] += out[i-1][j];
+}
+
+static double megapixelsPerSecond(ImageView<uint8_t> const& img, int loops, clock_t beg, clock_t end) {
+   return static_cast<double>(img.rows())*img.cols()/1e6*loops*CLOCKS_PER_SEC/(end-beg);
+}
+
+// Integral images of a 4K frame with the given channels
+static void time4k(int channels) {
+   Image<uint8_t> img(2160, 3840, channels);
+   Image<uint32_t> sum(img.rows()+1, img.cols()+1, channels);
+   Image<uint64_t> sumSq(img.rows()+1, img.cols()+1, channels);
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols()*channels; ++j )
+         img[i][j] = static_cast<uint8_t>((i*7 + j*13) % 251);
+
+   volatile int numLoops = 10;
+   clock_t beg, end;
+
+   beg = clock();
+   for( int l = 0; l < numLoops; ++l )
+      integrateColumns(sum, img);
+   end = clock();
+   printf("4K x%d column scan:     %.1f Mpixel/s\n", channels, megapixelsPerSecond(img, numLoops, beg, end));
+
+   beg = clock();
+   for( int l = 0; l < numLoops; ++l )
+      integrate(sum, img);
+   end = clock();
+   printf("4K x%d integrate:       %.1f Mpixel/s\n", channels, megapixelsPerSecond(img, numLoops, beg, end));
+
+   beg = clock();
+   for( int l = 0; l < numLoops; ++l ) {
+      integrate(sum, img);
+      integrateSquare(sumSq, img);
+   }
+   end = clock();
+   printf("4K x%d sum and square:  %.1f Mpixel/s\n", channels, megapixelsPerSecond(img, numLoops, beg, end));
+
+   beg = clock();
+   for( int l = 0; l < numLoops; ++l )
+      integrate(sum, sumSq, img);
+   end = clock();
+   printf("4K x%d fused:           %.1f Mpixel/s\n", channels, megapixelsPerSecond(img, numLoops, beg, end));
+}
+
+// The in-place integral, on floats
+static void time4kInPlace() {
+   Image<float> img(2160, 3840, 1);
+   volatile int numLoops = 10;
+
+   clock_t const beg = clock();
+   for( int l = 0; l < numLoops; ++l ) {
+      for( int i = 0; i < img.rows(); ++i )
+         std::fill(img[i], img[i] + img.cols(), 1.f);
+      integrate(img);
+   }
+   clock_t const end = clock();
+   printf("4K float in place:     %.1f Mpixel/s\n", static_cast<double>(img.rows())*img.cols()/1e6*numLoops*CLOCKS_PER_SEC/(end-beg));
+}
+
+int main() {
+   time4k(1);
+   time4k(3);
+   time4kInPlace();
+   return 0;
+}
@@ -0,0 +1,26 @@
+#include "OpticalFlowStreamTest.h"
+#include <new>
+#include <stdlib.h>
+
+std::atomic<long> OpticalFlowStreamTest::heapAllocations(0);
+
+// Counts every heap allocation made through new in the test binary
+void* operator new(size_t bytes) {
+   ++OpticalFlowStreamTest::heapAllocations;
+   if( void* p = malloc(bytes ? bytes : 1) )
+      return p;
+   throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+   free(p);
+}
+
+OpticalFlowStreamTest::OpticalFlowStreamTest() {
+}
+
+void OpticalFlowStreamTest::SetUp() {
+}
+
+void OpticalFlowStreamTest::TearDown() {
+}
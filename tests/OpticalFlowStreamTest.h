@@ -0,0 +1,255 @@
+#ifndef OPTICALFLOWSTREAMTEST_H
+#define OPTICALFLOWSTREAMTEST_H
+
+#include <gtest/gtest.h>
+#include "config.h"
+#include <Image.h>
+#include <ImageAllocator.h>
+#include <ImageProcessing.h>
+#include <OpticalFlowStream.h>
+#include <atomic>
+#include <cmath>
+#include <vector>
+
+class OpticalFlowStreamTest : public testing::Test {
+public:
+   OpticalFlowStreamTest();
+
+   // From class Test
+   virtual void SetUp();
+   virtual void TearDown();
+
+   //! Calls to the global operator new, which the test binary replaces
+   static std::atomic<long> heapAllocations;
+
+   // Frame t of a pattern drifting by (0.4, -0.3) pixels per frame
+   static void frame(Image<float>& img, int t, int rows = 48, int cols = 64) {
+      img.resize(rows, cols, 2);
+      for( int i = 0; i < rows; ++i ) {
+         for( int j = 0; j < cols; ++j ) {
+            float const x = j - 0.4f*t;
+            float const y = i + 0.3f*t;
+            img[i][j*2+0] = 50.f*std::sin(0.3f*x) + 50.f*std::cos(0.2f*y);
+            img[i][j*2+1] = 40.f*std::cos(0.25f*x + 0.1f*y);
+         }
+      }
+   }
+
+   /*
+    * Flow as the original hsOpticalFlow() computed it: every window summed
+    * directly over [i-r, i+r) x [j-r, j+r), and solved with LDLT
+    */
+   static void referenceFlow(
+      Image<float>& flow,
+      Image<float> const& img0,
+      Image<float> const& img1,
+      int radius
+   ) {
+      int const rows = img0.rows();
+      int const cols = img0.cols();
+      int const chans = img0.channels();
+      float const gamma = 1e-2 * (2*radius+1)*(2*radius+1)*chans;
+      Image<float> x0(rows, cols, chans);
+      Image<float> x1(rows, cols, chans);
+      Image<float> dx(rows, cols, chans);
+      Image<float> dy(rows, cols, chans);
+      lowpassFilter(x0, img0, 2);
+      lowpassFilter(x1, img1, 2);
+      gradient(dx, dy, x0);
+
+      flow.resize(rows, cols, 2);
+      for( int i = radius; i < rows - radius; ++i ) {
+         for( int j = radius; j < cols - radius; ++j ) {
+            Eigen::Matrix2f A = Eigen::Matrix2f::Zero();
+            Eigen::Vector2f b = Eigen::Vector2f::Zero();
+            for( int m = i-radius; m < i+radius; ++m ) {
+               for( int n = j-radius; n < j+radius; ++n ) {
+                  for( int k = 0; k < chans; ++k ) {
+                     float const ix = dx[m][n*chans+k];
+                     float const iy = dy[m][n*chans+k];
+                     float const it = x0[m][n*chans+k] - x1[m][n*chans+k];
+                     A(0,0) += ix*ix;
+                     A(0,1) += ix*iy;
+                     A(1,1) += iy*iy;
+                     b(0) += ix*it;
+                     b(1) += iy*it;
+                  }
+               }
+            }
+            A(1,0) = A(0,1);
+            A(0,0) += gamma;
+            A(1,1) += gamma;
+
+            Eigen::Vector2f const x = A.ldlt().solve(b);
+            flow[i][j*2+0] = x(0);
+            flow[i][j*2+1] = x(1);
+         }
+      }
+   }
+
+private:
+};
+
+// Every flow matches direct window sums on the same pair of frames, as does
+// hsOpticalFlow()
+TEST_F(OpticalFlowStreamTest, matchesPairs) {
+   int const radius = 4;
+   OpticalFlowStream stream(radius);
+   Image<float> prev, next;
+   Image<float> expected;
+
+   frame(next, 0);
+   EXPECT_FALSE( stream.push(next) );
+   for( int t = 1; t < 5; ++t ) {
+      std::swap(prev, next);
+      frame(next, t);
+      ASSERT_TRUE( stream.push(next) );
+      EXPECT_EQ( t+1, stream.frames() );
+
+      referenceFlow(expected, prev, next, radius);
+      for( int i = radius; i < 48-radius; ++i )
+         for( int j = radius*2; j < (64-radius)*2; ++j )
+            ASSERT_NEAR( expected[i][j], stream.flow()[i][j], 1e-3f*std::max(1.f, std::abs(expected[i][j])) )
+               << "frame " << t << " at " << i << "," << j/2;
+   }
+
+   Image<float> flow(48, 64, 2);
+   hsOpticalFlow(flow, prev, next, 3);
+   referenceFlow(expected, prev, next, 3);
+   for( int i = 3; i < 48-3; ++i )
+      for( int j = 3*2; j < (64-3)*2; ++j )
+         ASSERT_NEAR( expected[i][j], flow[i][j], 1e-3f*std::max(1.f, std::abs(expected[i][j])) )
+            << "at " << i << "," << j/2;
+}
+
+// Once the shape is known, pushing frames takes nothing from the heap: no
+// new, and the only images created are scratch that the pool recycles
+TEST_F(OpticalFlowStreamTest, steadyState) {
+   PoolAllocator pool;
+   ImageAllocator::setDefaultAllocator(&pool);
+   {
+      OpticalFlowStream stream;
+      Image<float> img;
+      frame(img, 0);
+      stream.push(img);
+      frame(img, 1);
+      stream.push(img);
+
+      std::vector<Image<float> > frames(4);
+      for( int t = 0; t < 4; ++t )
+         frame(frames[t], t+2);
+
+      pool.resetStats();
+      long const before = heapAllocations;
+      bool pushed = true;
+      for( int t = 0; t < 4; ++t )
+         pushed &= stream.push(frames[t]);
+      long const allocations = heapAllocations - before;
+
+      EXPECT_TRUE( pushed );
+      EXPECT_EQ( 0, allocations );
+      EXPECT_EQ( 0u, pool.misses() );
+   }
+   ImageAllocator::setDefaultAllocator(0);
+}
+
+// A new frame shape starts over, and reset() forgets the last frame
+TEST_F(OpticalFlowStreamTest, restart) {
+   OpticalFlowStream stream;
+   Image<float> img;
+
+   frame(img, 0);
+   EXPECT_FALSE( stream.push(img) );
+   frame(img, 1);
+   EXPECT_TRUE( stream.push(img) );
+
+   frame(img, 2, 40, 64);
+   EXPECT_FALSE( stream.push(img) );
+   EXPECT_EQ( 40, stream.flow().rows() );
+   frame(img, 3, 40, 64);
+   EXPECT_TRUE( stream.push(img) );
+
+   stream.reset();
+   EXPECT_FALSE( stream.push(img) );
+   EXPECT_EQ( 1, stream.frames() );
+}
+
+// The closed-form solve agrees with an LDLT solve of the same regularized
+// system where it is close to singular: flat windows, where the determinant
+// is about gamma^2, and windows whose gradients all point one way
+TEST_F(OpticalFlowStreamTest, illConditioned) {
+   int const rows = 60;
+   int const cols = 64;
+   int const radius = 4;
+   Image<float> frames[2];
+   for( int t = 0; t < 2; ++t ) {
+      frames[t].resize(rows, cols, 1);
+      for( int i = 0; i < rows; ++i ) {
+         for( int j = 0; j < cols; ++j ) {
+            float const x = j - 0.4f*t;
+            float& p = frames[t][i][j];
+            if( i < 20 )
+               p = 10.f + 0.5f*t;
+            else if( i < 40 )
+               p = 50.f*std::sin(0.3f*x);
+            else
+               p = 50.f*std::sin(0.2f*(x + i));
+         }
+      }
+   }
+
+   OpticalFlowStream stream(radius);
+   stream.push(frames[0]);
+   ASSERT_TRUE( stream.push(frames[1]) );
+
+   // Same smoothing, gradient and window sums as the stream
+   Image<float> kx, ky;
+   lowpassKernels(kx, ky, 2, 1);
+   Image<float> x0(rows, cols, 1), x1(rows, cols, 1);
+   filterSeparable(x0, frames[0], kx, ky);
+   filterSeparable(x1, frames[1], kx, ky);
+   Image<float> dx(rows, cols, 1), dy(rows, cols, 1);
+   gradient(dx, dy, x0);
+   Image<float> products(rows, cols, 5);
+   for( int i = 0; i < rows; ++i ) {
+      for( int j = 0; j < cols; ++j ) {
+         float const it = x0[i][j] - x1[i][j];
+         float* p = &products[i][j*5];
+         p[0] = dx[i][j]*dx[i][j];
+         p[1] = dx[i][j]*dy[i][j];
+         p[2] = dy[i][j]*dy[i][j];
+         p[3] = dx[i][j]*it;
+         p[4] = dy[i][j]*it;
+      }
+   }
+   Image<double> sums(rows+1, cols+1, 5);
+   integrate(sums, products);
+
+   float const gamma = 1e-2 * (2*radius+1)*(2*radius+1);
+   double worst = 0.0;
+   for( int i = radius; i < rows-radius; ++i ) {
+      for( int j = radius; j < cols-radius; ++j ) {
+         Rect const window(j-radius, j+radius-1, i-radius, i+radius-1);
+         Eigen::Matrix2f A;
+         Eigen::Vector2f b;
+         A(0,0) = boxSum(sums, window, 0) + gamma;
+         A(0,1) = A(1,0) = boxSum(sums, window, 1);
+         A(1,1) = boxSum(sums, window, 2) + gamma;
+         b(0) = boxSum(sums, window, 3);
+         b(1) = boxSum(sums, window, 4);
+         Eigen::Vector2f const x = A.ldlt().solve(b);
+
+         for( int k = 0; k < 2; ++k ) {
+            double const err = std::abs(stream.flow()[i][j*2+k] - x(k)) / std::max(1.f, std::abs(x(k)));
+            worst = std::max(worst, err);
+         }
+      }
+   }
+   EXPECT_LT( worst, 1e-3 );
+
+   // Flat windows only see the brightness change, which gives no flow
+   EXPECT_NEAR( stream.flow()[10][32*2+0], 0.f, 1e-6f );
+   EXPECT_NEAR( stream.flow()[10][32*2+1], 0.f, 1e-6f );
+}
+
+#endif /*OPTICALFLOWSTREAMTEST_H*/
@@ -0,0 +1,10 @@
+#include "PlanarImageTest.h"
+
+PlanarImageTest::PlanarImageTest() {
+}
+
+void PlanarImageTest::SetUp() {
+}
+
+void PlanarImageTest::TearDown() {
+}
@@ -0,0 +1,114 @@
+#ifndef PLANARIMAGETEST_H
+#define PLANARIMAGETEST_H
+
+#include <gtest/gtest.h>
+#include "config.h"
+#include <Image.h>
+#include <PlanarImage.h>
+#include <ImageProcessing.h>
+
+class PlanarImageTest : public testing::Test {
+public:
+   PlanarImageTest();
+
+   // From class Test
+   virtual void SetUp();
+   virtual void TearDown();
+
+private:
+};
+
+// Planes are aligned, single-channel, and do not overlap
+TEST_F(PlanarImageTest, planes) {
+   PlanarImage<float> img(5, 7, 3);
+
+   EXPECT_EQ( img.rows(), 5 );
+   EXPECT_EQ( img.cols(), 7 );
+   EXPECT_EQ( img.channels(), 3 );
+
+   for( int k = 0; k < img.channels(); ++k ) {
+      ImageView<float> p = img.plane(k);
+      EXPECT_EQ( p.rows(), 5 );
+      EXPECT_EQ( p.cols(), 7 );
+      EXPECT_EQ( p.channels(), 1 );
+      for( int i = 0; i < p.rows(); ++i ) {
+         EXPECT_EQ( 0u, reinterpret_cast<size_t>(p[i]) % CACHE_LINE_SIZE );
+         for( int j = 0; j < p.cols(); ++j )
+            p[i][j] = 100*k + 10*i + j;
+      }
+   }
+
+   EXPECT_EQ( img.plane(0)[4][6], 46.f );
+   EXPECT_EQ( img.plane(1)[0][0], 100.f );
+   EXPECT_EQ( img.plane(2)[2][3], 223.f );
+}
+
+// Deinterleaving then interleaving must reproduce the input
+TEST_F(PlanarImageTest, roundTrip) {
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   PlanarImage<uint8_t> planar;
+   Image<uint8_t> back(lena.rows(), lena.cols(), lena.channels());
+
+   deinterleave(planar, lena);
+   EXPECT_EQ( planar.channels(), 3 );
+   EXPECT_EQ( planar.plane(1)[7][9], lena[7][9*3+1] );
+
+   interleave(back, planar);
+   bool different = false;
+   for( int i = 0; i < lena.rows(); ++i )
+      for( int j = 0; j < lena.cols()*lena.channels(); ++j )
+         different |= (lena[i][j] != back[i][j]);
+   EXPECT_FALSE( different );
+
+   // Non-specialized channel counts
+   Image<int> five(3, 4, 5);
+   for( int i = 0; i < 3; ++i )
+      for( int j = 0; j < 4*5; ++j )
+         five[i][j] = i*100 + j;
+   PlanarImage<int> fivePlanar;
+   deinterleave(fivePlanar, five);
+   EXPECT_EQ( fivePlanar.plane(4)[2][3], 200 + 3*5 + 4 );
+}
+
+// Planar filtering matches interleaved filtering
+TEST_F(PlanarImageTest, filter) {
+   Image<uint8_t> lena(TEST_IMAGE_DIR "lena.ppm");
+   Image<uint8_t> expected(lena.rows(), lena.cols(), lena.channels());
+   Image<uint8_t> actual(lena.rows(), lena.cols(), lena.channels());
+   lowpassFilter(expected, lena, 3);
+
+   PlanarImage<uint8_t> in;
+   PlanarImage<uint8_t> out(lena.rows(), lena.cols(), lena.channels());
+   deinterleave(in, lena);
+   lowpassFilter(out, in, 3);
+   interleave(actual, out);
+
+   bool different = false;
+   for( int i = 0; i < lena.rows(); ++i )
+      for( int j = 0; j < lena.cols()*lena.channels(); ++j )
+         different |= (expected[i][j] != actual[i][j]);
+   EXPECT_FALSE( different );
+}
+
+// Planar color conversion matches interleaved conversion
+TEST_F(PlanarImageTest, rgb2xyz) {
+   Image<float> img(9, 11, 3);
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols()*3; ++j )
+         img[i][j] = static_cast<float>((i*7 + j*3) % 13) / 13.f;
+
+   PlanarImage<float> planar;
+   deinterleave(planar, img);
+
+   rgb2xyz(img);
+   rgb2xyz(planar);
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols(); ++j )
+         for( int k = 0; k < 3; ++k )
+            EXPECT_NEAR( img[i][j*3+k], planar.plane(k)[i][j], 1e-5 );
+
+   xyz2rgb(planar);
+   EXPECT_NEAR( planar.plane(2)[3][4], static_cast<float>((3*7 + (4*3+2)*3) % 13) / 13.f, 1e-5 );
+}
+
+#endif /*PLANARIMAGETEST_H*/
@@ -0,0 +1,10 @@
+#include "StencilTest.h"
+
+StencilTest::StencilTest() {
+}
+
+void StencilTest::SetUp() {
+}
+
+void StencilTest::TearDown() {
+}
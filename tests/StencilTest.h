@@ -0,0 +1,155 @@
+#ifndef STENCILTEST_H
+#define STENCILTEST_H
+
+#include <Image.h>
+#include <ImageProcessing.h>
+#include <Stencil.h>
+#include <gtest/gtest.h>
+
+class StencilTest : public testing::Test {
+public:
+   StencilTest();
+   virtual void SetUp();
+   virtual void TearDown();
+private:
+};
+
+// Small integers, so every sum below is exact in float
+static Image<float> stencilTestImage(int rows, int cols, int chans) {
+   Image<float> img(rows, cols, chans);
+   for( int i = 0; i < rows; ++i )
+      for( int j = 0; j < cols*chans; ++j )
+         img[i][j] = static_cast<float>((i*37 + j*11 + i*j) % 23) - 11.f;
+   return img;
+}
+
+// Stencil S must match filter() with the same taps, and leave the border alone
+template<class S>
+static void checkStencil(int const* taps) {
+   int const chans = 3;
+   Image<float> img = stencilTestImage(29, 34, chans);
+
+   Image<float> kern(S::rows, S::cols, 1);
+   for( int m = 0; m < S::rows; ++m )
+      for( int n = 0; n < S::cols; ++n )
+         kern[m][n] = static_cast<float>(taps[m*S::cols + n]) / S::divisor;
+
+   Image<float> expected(img.rows(), img.cols(), chans);
+   Image<float> actual(img.rows(), img.cols(), chans);
+   for( int i = 0; i < img.rows(); ++i ) {
+      for( int j = 0; j < img.cols()*chans; ++j ) {
+         expected[i][j] = -1000.f;
+         actual[i][j] = -1000.f;
+      }
+   }
+   filter(expected, img, kern);
+   applyStencil<S>(actual, img);
+
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols()*chans; ++j )
+         EXPECT_EQ( expected[i][j], actual[i][j] ) << "at " << i << "," << j;
+}
+
+TEST_F(StencilTest, matchesFilter) {
+   int const centralX[] = {-1, 0, 1};
+   int const centralY[] = {-1, 0, 1};
+   int const sobelX[] = {-1, 0, 1, -2, 0, 2, -1, 0, 1};
+   int const sobelY[] = {-1, -2, -1, 0, 0, 0, 1, 2, 1};
+   int const scharrX[] = {-3, 0, 3, -10, 0, 10, -3, 0, 3};
+   int const scharrY[] = {-3, -10, -3, 0, 0, 0, 3, 10, 3};
+   int const laplacian[] = {0, 1, 0, 1, -4, 1, 0, 1, 0};
+   int const binomial3[] = {1, 2, 1, 2, 4, 2, 1, 2, 1};
+   int const binomial5[] = {
+      1,  4,  6,  4, 1,
+      4, 16, 24, 16, 4,
+      6, 24, 36, 24, 6,
+      4, 16, 24, 16, 4,
+      1,  4,  6,  4, 1
+   };
+
+   checkStencil<CentralDiffX>(centralX);
+   checkStencil<CentralDiffY>(centralY);
+   checkStencil<SobelX>(sobelX);
+   checkStencil<SobelY>(sobelY);
+   checkStencil<ScharrX>(scharrX);
+   checkStencil<ScharrY>(scharrY);
+   checkStencil<Laplacian>(laplacian);
+   checkStencil<Binomial3>(binomial3);
+   checkStencil<Binomial5>(binomial5);
+}
+
+// Integer outputs sum in int and truncate, like filter() on uint8_t
+TEST_F(StencilTest, integerOutput) {
+   Image<uint8_t> img(20, 25, 1);
+   for( int i = 0; i < img.rows(); ++i )
+      for( int j = 0; j < img.cols(); ++j )
+         img[i][j] = static_cast<uint8_t>((i*53 + j*97) % 256);
+
+   Image<uint8_t> out(img.rows(), img.cols(), 1);
+   applyStencil<Binomial3>(out, img);
+
+   int const w[3] = {1, 2, 1};
+   for( int i = 1; i < img.rows()-1; ++i ) {
+      for( int j = 1; j < img.cols()-1; ++j ) {
+         int sum = 0;
+         for( int m = 0; m < 3; ++m )
+            for( int n = 0; n < 3; ++n )
+               sum += w[m]*w[n]*img[i+m-1][j+n-1];
+         EXPECT_EQ( sum/16, out[i][j] );
+      }
+   }
+}
+
+// The fused pass matches separate passes, including what it leaves alone
+TEST_F(StencilTest, fusedPair) {
+   Image<float> img = stencilTestImage(31, 27, 2);
+   Image<float> x1(img.rows(), img.cols(), 2), y1(img.rows(), img.cols(), 2);
+   Image<float> x2(img.rows(), img.cols(), 2), y2(img.rows(), img.cols(), 2);
+   for( int i = 0; i < img.rows(); ++i ) {
+      for( int j = 0; j < img.cols()*2; ++j ) {
+         x1[i][j] = y1[i][j] = x2[i][j] = y2[i][j] = 7.f;
+      }
+   }
+
+   applyStencil<CentralDiffX>(x1, img);
+   applyStencil<Binomial5>(y1, img);
+   applyStencils<CentralDiffX, Binomial5>(x2, y2, img);
+
+   for( int i = 0; i < img.rows(); ++i ) {
+      for( int j = 0; j < img.cols()*2; ++j ) {
+         EXPECT_EQ( x1[i][j], x2[i][j] );
+         EXPECT_EQ( y1[i][j], y2[i][j] );
+      }
+   }
+}
+
+// gradient() gives what the two separable filter passes used to
+TEST_F(StencilTest, gradient) {
+   Image<float> img = stencilTestImage(40, 33, 3);
+   Image<float> diff(1, 3, 3);
+   Image<float> one(1, 1, 3);
+   for( int k = 0; k < 3; ++k ) {
+      diff[0][0*3+k] = -0.5f;
+      diff[0][1*3+k] = 0.f;
+      diff[0][2*3+k] = 0.5f;
+      one[0][k] = 1.f;
+   }
+   ImageView<float> const diffT(diff[0], 3, 1, 3, 3*sizeof(float));
+
+   Image<float> expectedDx(img.rows(), img.cols(), 3);
+   Image<float> expectedDy(img.rows(), img.cols(), 3);
+   Image<float> dx(img.rows(), img.cols(), 3);
+   Image<float> dy(img.rows(), img.cols(), 3);
+   filterSeparable(expectedDx, img, diff, one);
+   filterSeparable(expectedDy, img, one, diffT);
+   gradient(dx, dy, img);
+
+   for( int i = 0; i < img.rows(); ++i ) {
+      for( int j = 0; j < img.cols()*3; ++j ) {
+         EXPECT_EQ( expectedDx[i][j], dx[i][j] );
+         EXPECT_EQ( expectedDy[i][j], dy[i][j] );
+      }
+   }
+}
+
+#endif /*STENCILTEST_H*/
@@ -0,0 +1,10 @@
+#include "Y4mTest.h"
+
+Y4mTest::Y4mTest() {
+}
+
+void Y4mTest::SetUp() {
+}
+
+void Y4mTest::TearDown() {
+}
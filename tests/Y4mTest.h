@@ -0,0 +1,138 @@
+#ifndef Y4MTEST_H
+#define Y4MTEST_H
+
+#include <gtest/gtest.h>
+#include "config.h"
+#include <Image.h>
+#include <Y4m.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+class Y4mTest : public testing::Test {
+public:
+   Y4mTest();
+
+   // From class Test
+   virtual void SetUp();
+   virtual void TearDown();
+
+private:
+};
+
+// Luma and 4:4:4 chroma survive exactly, RGB nearly so
+TEST_F(Y4mTest, roundTrip) {
+   Image<uint8_t> office0(TEST_IMAGE_DIR "office.0.ppm");
+   Image<uint8_t> office1(TEST_IMAGE_DIR "office.1.ppm");
+   int const rows = office0.rows();
+   int const cols = office0.cols();
+
+   {
+      Y4mWriter writer("/tmp/pgvl-444.y4m", cols, rows, Y4M_444, 25, 1);
+      ASSERT_TRUE( writer.good() );
+      EXPECT_TRUE( writer.writeYuv(office0) );
+      EXPECT_TRUE( writer.writeRgb(office1) );
+      // Wrong shapes are refused
+      EXPECT_FALSE( writer.writeYuv(office0.view(0, 10, 0, 10)) );
+   }
+
+   Y4mReader reader("/tmp/pgvl-444.y4m");
+   ASSERT_TRUE( reader.good() );
+   EXPECT_EQ( reader.width(), cols );
+   EXPECT_EQ( reader.height(), rows );
+   EXPECT_EQ( reader.chroma(), Y4M_444 );
+   EXPECT_EQ( reader.fpsNum(), 25 );
+
+   Image<uint8_t> frame;
+   ASSERT_TRUE( reader.readYuv(frame) );
+   bool different = false;
+   for( int i = 0; i < rows; ++i )
+      different |= memcmp(frame[i], office0[i], cols*3) != 0;
+   EXPECT_FALSE( different );
+
+   ASSERT_TRUE( reader.readRgb(frame) );
+   int maxError = 0;
+   for( int i = 0; i < rows; ++i )
+      for( int j = 0; j < cols*3; ++j )
+         maxError = std::max(maxError, abs(frame[i][j] - office1[i][j]));
+   EXPECT_LE( maxError, 3 );
+
+   EXPECT_FALSE( reader.readGray(frame) );
+   EXPECT_TRUE( reader.good() );
+}
+
+// Reads the two rubic frames written by grayFastPath
+static void checkGrayStream(Y4mReader& reader, Image<uint8_t> const& rubic0, Image<uint8_t> const& rubic1) {
+   int const rows = rubic0.rows();
+   int const cols = rubic0.cols();
+   Image<uint8_t> y;
+   Image<uint8_t> yuv;
+
+   ASSERT_TRUE( reader.readGray(y) );
+   EXPECT_EQ( y.channels(), 1 );
+   EXPECT_EQ( y[10][20], rubic0[10][20] );
+
+   // Chroma of a grayscale frame is neutral
+   ASSERT_TRUE( reader.readYuv(yuv) );
+   EXPECT_EQ( yuv[rows-1][3*(cols-1)+0], rubic1[rows-1][cols-1] );
+   EXPECT_EQ( yuv[rows-1][3*(cols-1)+1], 128 );
+   EXPECT_EQ( yuv[rows-1][3*(cols-1)+2], 128 );
+
+   EXPECT_FALSE( reader.readGray(y) );
+}
+
+// Grayscale frames through 4:2:0, read both seekably and from a pipe
+TEST_F(Y4mTest, grayFastPath) {
+   Image<uint8_t> rubic0(TEST_IMAGE_DIR "rubic.0.pgm");
+   Image<uint8_t> rubic1(TEST_IMAGE_DIR "rubic.1.pgm");
+
+   {
+      Y4mWriter writer("/tmp/pgvl-420.y4m", rubic0.cols(), rubic0.rows());
+      EXPECT_TRUE( writer.writeGray(rubic0) );
+      EXPECT_TRUE( writer.writeGray(rubic1) );
+   }
+
+   Y4mReader file("/tmp/pgvl-420.y4m");
+   checkGrayStream(file, rubic0, rubic1);
+
+   FILE* pipe = popen("cat /tmp/pgvl-420.y4m", "r");
+   ASSERT_TRUE( pipe != 0 );
+   {
+      Y4mReader piped(pipe);
+      checkGrayStream(piped, rubic0, rubic1);
+   }
+   pclose(pipe);
+}
+
+// Malformed streams
+TEST_F(Y4mTest, errors) {
+   Y4mReader notY4m(TEST_IMAGE_DIR "lena.ppm");
+   EXPECT_FALSE( notY4m.good() );
+
+   FILE* f = fopen("/tmp/pgvl-bad.y4m", "wb");
+   fprintf(f, "YUV4MPEG2 W4 H2 F30:1 Cmono\nFRAME\n0123");
+   fclose(f);
+
+   Y4mReader truncated("/tmp/pgvl-bad.y4m");
+   Image<uint8_t> y;
+   EXPECT_TRUE( truncated.good() );
+   EXPECT_EQ( truncated.chroma(), Y4M_MONO );
+   EXPECT_FALSE( truncated.readGray(y) );
+   EXPECT_FALSE( truncated.good() );
+
+   // Only 8-bit 4:2:0 tags are 4:2:0
+   char const* const tags[] = {"420", "420jpeg", "420paldv", "420mpeg2", "420p10", "420p16", "420foo"};
+   bool const supported[] = {true, true, true, true, false, false, false};
+   for( int t = 0; t < 7; ++t ) {
+      f = fopen("/tmp/pgvl-chroma.y4m", "wb");
+      fprintf(f, "YUV4MPEG2 W4 H2 F30:1 C%s\n", tags[t]);
+      fclose(f);
+
+      Y4mReader tagged("/tmp/pgvl-chroma.y4m");
+      EXPECT_EQ( tagged.good(), supported[t] ) << tags[t];
+      if( supported[t] ) {
+         EXPECT_EQ( tagged.chroma(), Y4M_420 ) << tags[t];
+      }
+   }
+}
+
+#endif /*Y4MTEST_H*/
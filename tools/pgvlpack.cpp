@@ -0,0 +1,36 @@
+/*
+ * pgvlpack.cpp is part of pgvl and is
+ * Copyright 2015 Philip G. Lee <rocketman768@gmail.com>
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <FrameArchive.h>
+#include <FrameSequenceReader.h>
+
+// Pack a numbered PGM/PPM sequence into a frame archive
+int main(int argc, char** argv) {
+   if( argc < 3 || argc > 4 ) {
+      fprintf(stderr, "Usage: %s <pattern> <archive> [first]\n", argv[0]);
+      fprintf(stderr, "  e.g. %s office.%%d.ppm office.pgvl\n", argv[0]);
+      return 1;
+   }
+
+   int const first = argc > 3 ? atoi(argv[3]) : 0;
+   FrameSequenceReader<uint8_t> reader(argv[1], first);
+   FrameArchiveWriter writer(argv[2]);
+
+   if( !writer.good() )
+      return 1;
+
+   while( Image<uint8_t> const* frame = reader.next() ) {
+      if( !writer.append(*frame) )
+         return 1;
+   }
+
+   if( !writer.close() )
+      return 1;
+
+   printf("Packed %d frames into %s\n", reader.framesRead(), argv[2]);
+   return 0;
+}